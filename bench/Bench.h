@@ -0,0 +1,145 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_BENCH_H
+#define LIBMAV_EXAMPLE_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+
+/*
+ * Minimal benchmark harness for libmav-bench. A benchmark is a function taking a State, and runs its
+ * measured section inside `for (auto _ : state) { ... }`. Only that loop is timed, setup before it is
+ * not. The runner picks the iteration count so that every benchmark runs for roughly the same wall time.
+ */
+namespace bench {
+
+    template <typename T>
+    inline void doNotOptimize(const T &value) {
+        asm volatile("" : : "r"(&value) : "memory");
+    }
+
+    inline void clobberMemory() {
+        asm volatile("" : : : "memory");
+    }
+
+    class State {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        uint64_t _iterations;
+        uint64_t _bytes_per_iteration = 0;
+        uint64_t _items_per_iteration = 0;
+        Clock::time_point _start;
+        Clock::time_point _stop;
+
+    public:
+        explicit State(uint64_t iterations) : _iterations(iterations) {}
+
+        // Non-trivial destructor, so `for (auto _ : state)` does not trigger unused variable warnings
+        struct Iteration {
+            ~Iteration() {}     // NOLINT(modernize-use-equals-default)
+        };
+
+        class Iterator {
+        private:
+            State *_state;
+            uint64_t _remaining;
+        public:
+            Iterator(State *state, uint64_t remaining) : _state(state), _remaining(remaining) {}
+            bool operator!=(const Iterator &other) const {
+                if (_remaining != other._remaining) {
+                    return true;
+                }
+                // the loop is done, stop the clock before any teardown in the benchmark
+                _state->_stop = Clock::now();
+                return false;
+            }
+            void operator++() { _remaining--; }
+            Iteration operator*() const { return {}; }
+        };
+
+        // The clock starts when iteration begins
+        Iterator begin() {
+            _start = Clock::now();
+            _stop = _start;
+            return Iterator{this, _iterations};
+        }
+        Iterator end() { return Iterator{this, 0}; }
+
+        [[nodiscard]] uint64_t iterations() const { return _iterations; }
+
+        // Wall time of the measured loop
+        [[nodiscard]] double seconds() const { return std::chrono::duration<double>(_stop - _start).count(); }
+
+        // Reports throughput in MB/s next to the time per iteration
+        void setBytesPerIteration(uint64_t bytes) { _bytes_per_iteration = bytes; }
+        [[nodiscard]] uint64_t bytesPerIteration() const { return _bytes_per_iteration; }
+
+        // Reports throughput in items/s next to the time per iteration
+        void setItemsPerIteration(uint64_t items) { _items_per_iteration = items; }
+        [[nodiscard]] uint64_t itemsPerIteration() const { return _items_per_iteration; }
+    };
+
+    using Function = std::function<void(State&)>;
+
+    inline std::vector<std::pair<std::string, Function>>& registry() {
+        static std::vector<std::pair<std::string, Function>> benchmarks;
+        return benchmarks;
+    }
+
+    struct Register {
+        Register(std::string name, Function function) {
+            registry().emplace_back(std::move(name), std::move(function));
+        }
+    };
+
+    /*
+     * The message set is loaded once and shared by all benchmarks. Like the example, libmav-bench
+     * expects to be run from the build directory.
+     */
+    inline const mav::MessageSet& messageSet() {
+        static const mav::MessageSet message_set{"mavlink/development.xml"};
+        return message_set;
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_BENCH_H
@@ -0,0 +1,109 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <cstdint>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/Broadcaster.h>
+
+#include "Bench.h"
+
+/*
+ * Fan-out of one ATTITUDE message to 32 targets over an interface that discards everything, so only the
+ * cost of serializing is measured: finalizing per target, against finalizing once and renumbering.
+ */
+
+namespace {
+
+    constexpr int TARGETS = 32;
+
+    class NullInterface : public mav::NetworkInterface {
+    public:
+        uint64_t bytes = 0;
+
+        void close() const override {}
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return true;
+        }
+
+        void send(const uint8_t *, uint32_t size, mav::ConnectionPartner) override {
+            bytes += size;
+        }
+
+        mav::ConnectionPartner receive(uint8_t *, uint32_t) override {
+            throw mav::NetworkInterfaceInterrupt();
+        }
+    };
+
+    mav::Message attitude() {
+        auto message = bench::messageSet().create("ATTITUDE");
+        message["roll"] = 0.5f;
+        message["yawspeed"] = -0.1f;
+        return message;
+    }
+}
+
+static bench::Register finalize_per_target{"broadcast/finalize_per_target", [](bench::State &state) {
+    NullInterface interface;
+    auto message = attitude();
+    uint8_t sequences[TARGETS] = {};
+    for (auto _ : state) {
+        for (int i = 0; i < TARGETS; i++) {
+            auto length = message.finalize(sequences[i]++, {1, 1});
+            interface.send(message.data(), length, mav::ConnectionPartner(0x7F000001, 14550 + i, false));
+        }
+    }
+    bench::doNotOptimize(interface.bytes);
+    state.setItemsPerIteration(TARGETS);
+}};
+
+static bench::Register broadcaster{"broadcast/broadcaster", [](bench::State &state) {
+    NullInterface interface;
+    example::Broadcaster broadcaster(interface, {1, 1});
+    for (int i = 0; i < TARGETS; i++) {
+        broadcaster.addPartner(mav::ConnectionPartner(0x7F000001, 14550 + i, false));
+    }
+    auto message = attitude();
+    for (auto _ : state) {
+        broadcaster.broadcast(message);
+    }
+    bench::doNotOptimize(interface.bytes);
+    state.setItemsPerIteration(TARGETS);
+}};
@@ -0,0 +1,81 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <example/Crc.h>
+
+#include "Bench.h"
+
+/*
+ * Checksum throughput for typical MAVLink payload sizes: HEARTBEAT (9), ATTITUDE (28), COMMAND_LONG (33),
+ * AUTOPILOT_VERSION (78) and the maximum payload (255), each with the 9 checksummed header bytes.
+ */
+
+static std::vector<uint8_t> crcInput(size_t length) {
+    std::vector<uint8_t> input(length);
+    for (size_t i = 0; i < length; i++) {
+        input[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+    return input;
+}
+
+static void registerCrcBenchmarks() {
+    for (size_t payload_size : {9, 28, 33, 78, 255}) {
+        size_t length = payload_size + 9;
+        bench::Register{"crc/bytewise/" + std::to_string(payload_size), [length](bench::State &state) {
+            auto input = crcInput(length);
+            for (auto _ : state) {
+                auto crc = example::detail::crcAccumulateBytewise(0xFFFF, input.data(), input.size());
+                bench::doNotOptimize(crc);
+            }
+            state.setBytesPerIteration(length);
+        }};
+        bench::Register{"crc/sliced/" + std::to_string(payload_size), [length](bench::State &state) {
+            auto input = crcInput(length);
+            for (auto _ : state) {
+                example::Crc crc;
+                crc.accumulate(input.data(), input.size());
+                auto value = crc.value();
+                bench::doNotOptimize(value);
+            }
+            state.setBytesPerIteration(length);
+        }};
+    }
+}
+
+static const bool crc_benchmarks_registered = (registerCrcBenchmarks(), true);
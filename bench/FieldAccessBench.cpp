@@ -0,0 +1,166 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <string>
+#include <string_view>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+
+#include <example/FieldHandle.h>
+#include <example/MessageFields.h>
+
+#include "Bench.h"
+
+/*
+ * Compares the three ways of accessing a field: by name, through a FieldHandle resolved once from the
+ * message definition, and through the generated constexpr descriptors.
+ */
+
+static bench::Register get_by_name{"field/get_by_name", [](bench::State &state) {
+    auto message = bench::messageSet().create("PARAM_VALUE");
+    message["param_value"] = 1.5f;
+    for (auto _ : state) {
+        float value = message["param_value"];
+        bench::doNotOptimize(value);
+    }
+}};
+
+static bench::Register get_by_handle{"field/get_by_handle", [](bench::State &state) {
+    auto message = bench::messageSet().create("PARAM_VALUE");
+    auto param_value = example::field(bench::messageSet(), "PARAM_VALUE", "param_value");
+    message["param_value"] = 1.5f;
+    for (auto _ : state) {
+        auto value = example::get<float>(message, param_value);
+        bench::doNotOptimize(value);
+    }
+}};
+
+static bench::Register get_by_descriptor{"field/get_by_descriptor", [](bench::State &state) {
+    auto message = bench::messageSet().create("PARAM_VALUE");
+    message["param_value"] = 1.5f;
+    for (auto _ : state) {
+        auto value = example::get(message, example::msg::PARAM_VALUE::param_value);
+        bench::doNotOptimize(value);
+    }
+}};
+
+static bench::Register set_heartbeat_by_name{"field/set_heartbeat_by_name", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    auto message = message_set.create("HEARTBEAT");
+    for (auto _ : state) {
+        message.set({
+            {"type", message_set.e("MAV_TYPE_GCS")},
+            {"autopilot", message_set.e("MAV_AUTOPILOT_INVALID")},
+            {"base_mode", message_set.e("MAV_MODE_FLAG_CUSTOM_MODE_ENABLED")},
+            {"custom_mode", 0},
+            {"system_status", message_set.e("MAV_STATE_ACTIVE")}
+        });
+        bench::clobberMemory();
+    }
+}};
+
+static bench::Register set_heartbeat_by_handle{"field/set_heartbeat_by_handle", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    auto message = message_set.create("HEARTBEAT");
+    const auto type = example::field(message_set, "HEARTBEAT", "type");
+    const auto autopilot = example::field(message_set, "HEARTBEAT", "autopilot");
+    const auto base_mode = example::field(message_set, "HEARTBEAT", "base_mode");
+    const auto custom_mode = example::field(message_set, "HEARTBEAT", "custom_mode");
+    const auto system_status = example::field(message_set, "HEARTBEAT", "system_status");
+    const auto mav_type_gcs = message_set.e("MAV_TYPE_GCS");
+    const auto mav_autopilot_invalid = message_set.e("MAV_AUTOPILOT_INVALID");
+    const auto custom_mode_enabled = message_set.e("MAV_MODE_FLAG_CUSTOM_MODE_ENABLED");
+    const auto mav_state_active = message_set.e("MAV_STATE_ACTIVE");
+    for (auto _ : state) {
+        example::set(message, {
+            {type, mav_type_gcs},
+            {autopilot, mav_autopilot_invalid},
+            {base_mode, custom_mode_enabled},
+            {custom_mode, 0},
+            {system_status, mav_state_active}
+        });
+        bench::clobberMemory();
+    }
+}};
+
+static bench::Register set_command_long_by_name{"field/set_command_long_by_name", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    auto message = message_set.create("COMMAND_LONG");
+    for (auto _ : state) {
+        message["command"] = 512;
+        message["param1"] = 148;
+        message["target_system"] = 1;
+        message["target_component"] = 1;
+        message["param7"] = 1;
+        bench::clobberMemory();
+    }
+}};
+
+static bench::Register set_command_long_by_handle{"field/set_command_long_by_handle", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    auto message = message_set.create("COMMAND_LONG");
+    const auto command = example::field(message_set, "COMMAND_LONG", "command");
+    const auto param1 = example::field(message_set, "COMMAND_LONG", "param1");
+    const auto target_system = example::field(message_set, "COMMAND_LONG", "target_system");
+    const auto target_component = example::field(message_set, "COMMAND_LONG", "target_component");
+    const auto param7 = example::field(message_set, "COMMAND_LONG", "param7");
+    for (auto _ : state) {
+        example::set(message, command, 512);
+        example::set(message, param1, 148);
+        example::set(message, target_system, 1);
+        example::set(message, target_component, 1);
+        example::set(message, param7, 1);
+        bench::clobberMemory();
+    }
+}};
+
+static bench::Register get_string_by_name{"field/get_string_by_name", [](bench::State &state) {
+    auto message = bench::messageSet().create("PARAM_VALUE");
+    message["param_id"] = "SYS_AUTOSTART";
+    for (auto _ : state) {
+        std::string param_id = message["param_id"];
+        bench::doNotOptimize(param_id);
+    }
+}};
+
+static bench::Register get_string_view_by_descriptor{"field/get_string_view_by_descriptor", [](bench::State &state) {
+    auto message = bench::messageSet().create("PARAM_VALUE");
+    message["param_id"] = "SYS_AUTOSTART";
+    for (auto _ : state) {
+        std::string_view param_id = example::getString(message, example::msg::PARAM_VALUE::param_id);
+        bench::doNotOptimize(param_id);
+    }
+}};
@@ -0,0 +1,114 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <string>
+#include <vector>
+
+#include <mav/MessageSet.h>
+
+#include <example/MessageTables.h>
+
+#include "Bench.h"
+
+/*
+ * Name and enum lookups through the message set versus the generated flat tables in
+ * <example/MessageTables.h>. The names rotate through a few typical ones, and are runtime strings so the
+ * constexpr table lookups can not be folded away.
+ */
+
+static const std::vector<std::string> MESSAGE_NAMES = {"AUTOPILOT_VERSION", "HEARTBEAT", "COMMAND_LONG", "ATTITUDE"};
+static const std::vector<std::string> ENUM_NAMES = {"MAV_CMD_REQUEST_MESSAGE", "MAV_STATE_ACTIVE",
+                                                    "MAV_TYPE_QUADROTOR", "MAV_RESULT_ACCEPTED"};
+static const std::vector<int> MESSAGE_IDS = {148, 0, 76, 30};
+
+static bench::Register message_id_by_name_message_set{"lookup/message_id/message_set", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    size_t i = 0;
+    for (auto _ : state) {
+        auto id = message_set.idForMessage(MESSAGE_NAMES[i++ & 3]);
+        bench::doNotOptimize(id);
+    }
+}};
+
+static bench::Register message_id_by_name_table{"lookup/message_id/table", [](bench::State &state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        auto id = example::msg::messageId(MESSAGE_NAMES[i++ & 3]);
+        bench::doNotOptimize(id);
+    }
+}};
+
+static bench::Register enum_by_name_message_set{"lookup/enum_value/message_set", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    size_t i = 0;
+    for (auto _ : state) {
+        auto value = message_set.e(ENUM_NAMES[i++ & 3]);
+        bench::doNotOptimize(value);
+    }
+}};
+
+static bench::Register enum_by_name_table{"lookup/enum_value/table", [](bench::State &state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        auto value = example::msg::enumValue(ENUM_NAMES[i++ & 3]);
+        bench::doNotOptimize(value);
+    }
+}};
+
+static bench::Register message_name_by_id_message_set{"lookup/message_name/message_set", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto &name = message_set.getMessageDefinition(MESSAGE_IDS[i++ & 3]).get().name();
+        bench::doNotOptimize(name);
+    }
+}};
+
+static bench::Register message_name_by_id_table{"lookup/message_name/table", [](bench::State &state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        auto name = example::msg::messageName(static_cast<uint32_t>(MESSAGE_IDS[i++ & 3]));
+        bench::doNotOptimize(name);
+    }
+}};
+
+static bench::Register enum_entry_name_table{"lookup/enum_entry_name/table", [](bench::State &state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        auto name = example::msg::enumEntryName("MAV_STATE", i++ & 7);
+        bench::doNotOptimize(name);
+    }
+}};
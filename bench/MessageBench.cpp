@@ -0,0 +1,124 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <cstdint>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+
+#include <example/MessageFields.h>
+#include <example/Snapshot.h>
+#include <example/TickArena.h>
+
+#include "Bench.h"
+
+/*
+ * Startup and per-message costs: loading the message set, creating messages and finalizing them for
+ * sending, which includes the CRC.
+ */
+
+static bench::Register load_xml{"message_set/load_xml", [](bench::State &state) {
+    for (auto _ : state) {
+        mav::MessageSet message_set{"mavlink/development.xml"};
+        bench::doNotOptimize(message_set);
+    }
+}};
+
+static bench::Register load_snapshot{"message_set/load_snapshot", [](bench::State &state) {
+    for (auto _ : state) {
+        mav::MessageSet message_set;
+        bool loaded = example::addFromSnapshot(message_set, "mavlink/development.snapshot.xml",
+                                               example::msg::SOURCE_HASH);
+        bench::doNotOptimize(loaded);
+    }
+}};
+
+static bench::Register create_heartbeat{"message/create_heartbeat", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    for (auto _ : state) {
+        auto message = message_set.create("HEARTBEAT");
+        bench::doNotOptimize(message);
+    }
+}};
+
+static bench::Register create_command_long{"message/create_command_long", [](bench::State &state) {
+    const auto &message_set = bench::messageSet();
+    for (auto _ : state) {
+        auto message = message_set.create("COMMAND_LONG");
+        bench::doNotOptimize(message);
+    }
+}};
+
+static bench::Register create_command_long_from_prototype{"message/create_command_long_prototype_arena",
+                                                          [](bench::State &state) {
+    example::MessagePrototypes prototypes(bench::messageSet(), {"COMMAND_LONG"});
+    const auto &prototype = prototypes.get("COMMAND_LONG");
+    example::TickArena arena(64 * 1024);
+    uint64_t made = 0;
+    for (auto _ : state) {
+        auto &message = arena.message(prototype);
+        bench::doNotOptimize(message);
+        // rewind like a control loop would once per tick
+        if (++made % 64 == 0) {
+            arena.reset();
+        }
+    }
+}};
+
+static bench::Register finalize_heartbeat{"message/finalize_heartbeat", [](bench::State &state) {
+    auto message = bench::messageSet().create("HEARTBEAT");
+    uint8_t sequence = 0;
+    uint32_t length = 0;
+    for (auto _ : state) {
+        length = message.finalize(sequence++, {1, 1});
+        bench::doNotOptimize(length);
+    }
+    state.setBytesPerIteration(length);
+}};
+
+static bench::Register finalize_command_long{"message/finalize_command_long", [](bench::State &state) {
+    auto message = bench::messageSet().create("COMMAND_LONG");
+    message["command"] = 512;
+    message["param1"] = 148;
+    message["param7"] = 1;
+    uint8_t sequence = 0;
+    uint32_t length = 0;
+    for (auto _ : state) {
+        length = message.finalize(sequence++, {1, 1});
+        bench::doNotOptimize(length);
+    }
+    state.setBytesPerIteration(length);
+}};
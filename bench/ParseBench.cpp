@@ -0,0 +1,186 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/Frame.h>
+#include <example/FrameAssembler.h>
+#include <example/FrameReader.h>
+
+#include "Bench.h"
+
+/*
+ * Framing and decoding a synthetic stream: a mix of HEARTBEAT, ATTITUDE, COMMAND_LONG and
+ * AUTOPILOT_VERSION frames, served from memory so that only parsing is measured.
+ */
+
+namespace {
+
+    struct SyntheticStream {
+        std::vector<uint8_t> bytes;
+        uint64_t frames = 0;
+    };
+
+    const SyntheticStream& syntheticStream() {
+        static const SyntheticStream stream = [] {
+            const auto &message_set = bench::messageSet();
+            SyntheticStream result;
+            uint8_t sequence = 0;
+            for (int i = 0; i < 256; i++) {
+                const char *name = i % 4 == 0 ? "HEARTBEAT" : i % 4 == 1 ? "ATTITUDE" :
+                                   i % 4 == 2 ? "COMMAND_LONG" : "AUTOPILOT_VERSION";
+                auto message = message_set.create(name);
+                if (i % 4 == 1) {
+                    message["roll"] = 0.1f * static_cast<float>(i);
+                    message["time_boot_ms"] = i * 10;
+                }
+                auto length = message.finalize(sequence++, {1, 1});
+                result.bytes.insert(result.bytes.end(), message.data(), message.data() + length);
+                result.frames++;
+            }
+            return result;
+        }();
+        return stream;
+    }
+
+    // Serves the stream over and over, as a byte stream interface like a serial port would
+    class LoopInterface : public mav::NetworkInterface {
+    private:
+        const std::vector<uint8_t> &_bytes;
+        size_t _position = 0;
+
+    public:
+        explicit LoopInterface(const std::vector<uint8_t> &bytes) : _bytes(bytes) {}
+
+        void close() const override {}
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return true;
+        }
+
+        void send(const uint8_t *, uint32_t, mav::ConnectionPartner) override {}
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            while (copied < size) {
+                auto chunk = std::min<size_t>(size - copied, _bytes.size() - _position);
+                std::memcpy(destination + copied, _bytes.data() + _position, chunk);
+                copied += static_cast<uint32_t>(chunk);
+                _position = (_position + chunk) % _bytes.size();
+            }
+            return {};
+        }
+    };
+}
+
+static bench::Register parse_frame_reader{"parse/frame_reader", [](bench::State &state) {
+    const auto &stream = syntheticStream();
+    LoopInterface interface(stream.bytes);
+    example::FrameReader reader(bench::messageSet(), interface);
+    std::array<uint8_t, example::MAX_FRAME_SIZE> frame{};
+    mav::ConnectionPartner partner;
+    for (auto _ : state) {
+        for (uint64_t i = 0; i < stream.frames; i++) {
+            auto length = reader.read(frame.data(), partner);
+            bench::doNotOptimize(length);
+        }
+    }
+    state.setItemsPerIteration(stream.frames);
+}};
+
+static bench::Register parse_frame_reader_to_message{"parse/frame_reader_to_message", [](bench::State &state) {
+    const auto &stream = syntheticStream();
+    LoopInterface interface(stream.bytes);
+    example::FrameReader reader(bench::messageSet(), interface);
+    std::array<uint8_t, example::MAX_FRAME_SIZE> frame{};
+    mav::ConnectionPartner partner;
+    for (auto _ : state) {
+        for (uint64_t i = 0; i < stream.frames; i++) {
+            auto length = reader.read(frame.data(), partner);
+            auto message = example::toMessage(bench::messageSet(), example::FrameView{frame.data(), length});
+            bench::doNotOptimize(message);
+        }
+    }
+    state.setItemsPerIteration(stream.frames);
+}};
+
+static bench::Register parse_frame_assembler{"parse/frame_assembler", [](bench::State &state) {
+    const auto &stream = syntheticStream();
+    example::CrcExtraCache crc_extra(bench::messageSet());
+    example::FrameAssembler assembler;
+    uint64_t frames = 0;
+    for (auto _ : state) {
+        // 64 byte chunks, like non-blocking reads from a serial port
+        for (size_t offset = 0; offset < stream.bytes.size(); offset += 64) {
+            assembler.push(stream.bytes.data() + offset, std::min<size_t>(64, stream.bytes.size() - offset),
+                           &crc_extra, [&frames](const uint8_t *, int) { frames++; });
+        }
+    }
+    bench::doNotOptimize(frames);
+    state.setItemsPerIteration(stream.frames);
+    state.setBytesPerIteration(stream.bytes.size());
+}};
+
+static bench::Register parse_frame_assembler_noise{"parse/frame_assembler_noise", [](bench::State &state) {
+    // line noise without any magic bytes, e.g. a radio link at the wrong baud rate
+    std::vector<uint8_t> noise(64 * 1024);
+    uint32_t x = 12345;
+    for (auto &byte : noise) {
+        x = x * 1103515245 + 12345;
+        byte = static_cast<uint8_t>(x >> 16);
+        if (example::FrameHeader::isMagic(byte)) {
+            byte = 0;
+        }
+    }
+    example::FrameAssembler assembler;
+    uint64_t frames = 0;
+    for (auto _ : state) {
+        for (size_t offset = 0; offset < noise.size(); offset += 4096) {
+            assembler.push(noise.data() + offset, std::min<size_t>(4096, noise.size() - offset),
+                           nullptr, [&frames](const uint8_t *, int) { frames++; });
+        }
+    }
+    bench::doNotOptimize(frames);
+    state.setBytesPerIteration(noise.size());
+}};
@@ -0,0 +1,123 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <example/Frame.h>
+#include <example/Sha256.h>
+#include <example/Signing.h>
+
+#include "Bench.h"
+
+/*
+ * Cost of MAVLink v2 signing per frame. sha256/ compares the compression function picked at startup
+ * with the portable one, over the 32 byte key plus a signed ATTITUDE frame.
+ */
+
+namespace {
+
+    constexpr size_t SIGNED_ATTITUDE_HASHED = 32 + 10 + 28 + 2 + 7;
+
+    void compressBlocks(bench::State &state, example::detail::Sha256Compress compress) {
+        std::array<uint8_t, 128> blocks{};
+        uint32_t digest[8] = {};
+        for (auto _ : state) {
+            compress(digest, blocks.data(), 2);
+            bench::doNotOptimize(digest);
+        }
+        state.setBytesPerIteration(blocks.size());
+    }
+
+    std::array<uint8_t, example::MAX_FRAME_SIZE> attitudeFrame(int &length) {
+        std::array<uint8_t, example::MAX_FRAME_SIZE> frame{0xFD, 28, 0, 0, 0, 1, 1, 30, 0, 0};
+        for (int i = 0; i < 28; i++) {
+            frame[10 + i] = static_cast<uint8_t>(i * 7);
+        }
+        length = 10 + 28 + 2;
+        example::detail::writeChecksum(frame.data(), 39);
+        return frame;
+    }
+}
+
+static bench::Register sha256_selected{"sha256/compress_selected", [](bench::State &state) {
+    compressBlocks(state, example::detail::SHA256_COMPRESS);
+}};
+
+static bench::Register sha256_portable{"sha256/compress_portable", [](bench::State &state) {
+    compressBlocks(state, example::detail::sha256CompressGeneric);
+}};
+
+static bench::Register sha256_frame{"sha256/signed_attitude", [](bench::State &state) {
+    std::array<uint8_t, SIGNED_ATTITUDE_HASHED> data{};
+    for (auto _ : state) {
+        auto digest = example::sha256(data.data(), data.size());
+        bench::doNotOptimize(digest);
+    }
+    state.setBytesPerIteration(data.size());
+}};
+
+static bench::Register sign_attitude{"signing/sign", [](bench::State &state) {
+    example::Signer signer(example::SigningKey::fromPassphrase("bench"), 1);
+    int length = 0;
+    auto unsigned_frame = attitudeFrame(length);
+    for (auto _ : state) {
+        auto frame = unsigned_frame;
+        auto signed_length = signer.sign(frame.data(), length, 39);
+        bench::doNotOptimize(signed_length);
+    }
+}};
+
+static bench::Register verify_attitude{"signing/verify", [](bench::State &state) {
+    auto key = example::SigningKey::fromPassphrase("bench");
+    example::Signer signer(key, 1);
+    // a fresh signature for every check, otherwise all but the first would be rejected as replays
+    int length = 0;
+    auto unsigned_frame = attitudeFrame(length);
+    std::vector<std::array<uint8_t, example::MAX_FRAME_SIZE>> frames(4096, unsigned_frame);
+    int signed_length = 0;
+    for (auto &frame : frames) {
+        signed_length = signer.sign(frame.data(), length, 39);
+    }
+    size_t index = 0;
+    example::Verifier verifier(key);
+    for (auto _ : state) {
+        auto result = verifier.check(frames[index % frames.size()].data(), signed_length);
+        bench::doNotOptimize(result);
+        index++;
+    }
+}};
@@ -0,0 +1,134 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+#include <mav/UDPClient.h>
+#include <mav/UDPServer.h>
+
+#include <example/BatchedUDP.h>
+#include <example/Frame.h>
+#include <example/FrameReader.h>
+
+#include "Bench.h"
+
+/*
+ * Loopback UDP: the round trip latency of a single frame, and the rate at which bursts of frames get from
+ * a client to a server. Both sides are driven from the benchmark thread, without a NetworkRuntime, so the
+ * numbers are the cost of the interfaces and the kernel.
+ */
+
+namespace {
+
+    struct Frame {
+        std::array<uint8_t, example::MAX_FRAME_SIZE> data{};
+        uint32_t length = 0;
+    };
+
+    Frame attitudeFrame() {
+        auto message = bench::messageSet().create("ATTITUDE");
+        message["roll"] = 0.5f;
+        Frame frame;
+        frame.length = message.finalize(0, {1, 1});
+        std::copy(message.data(), message.data() + frame.length, frame.data.begin());
+        return frame;
+    }
+
+    template <typename Server, typename Client>
+    void roundTrip(bench::State &state, Server &server, Client &client) {
+        auto frame = attitudeFrame();
+        example::FrameReader server_reader(bench::messageSet(), server);
+        example::FrameReader client_reader(bench::messageSet(), client);
+        std::array<uint8_t, example::MAX_FRAME_SIZE> buffer{};
+        mav::ConnectionPartner partner;
+        for (auto _ : state) {
+            client.send(frame.data.data(), frame.length, {});
+            auto length = server_reader.read(buffer.data(), partner);
+            server.send(buffer.data(), static_cast<uint32_t>(length), partner);
+            client_reader.read(buffer.data(), partner);
+        }
+    }
+
+    template <typename Server, typename Client, typename Begin, typename Flush>
+    void burst(bench::State &state, Server &server, Client &client, Begin begin, Flush flush) {
+        // small enough to fit the default socket buffers, so frames are not dropped
+        constexpr int BURST = 64;
+        auto frame = attitudeFrame();
+        example::FrameReader server_reader(bench::messageSet(), server);
+        std::array<uint8_t, example::MAX_FRAME_SIZE> buffer{};
+        mav::ConnectionPartner partner;
+        for (auto _ : state) {
+            begin();
+            for (int i = 0; i < BURST; i++) {
+                client.send(frame.data.data(), frame.length, {});
+            }
+            flush();
+            for (int i = 0; i < BURST; i++) {
+                server_reader.read(buffer.data(), partner);
+            }
+        }
+        state.setItemsPerIteration(BURST);
+    }
+}
+
+static bench::Register udp_round_trip{"udp/round_trip", [](bench::State &state) {
+    mav::UDPServer server(14700, "127.0.0.1");
+    mav::UDPClient client("127.0.0.1", 14700);
+    roundTrip(state, server, client);
+}};
+
+static bench::Register udp_burst{"udp/burst64", [](bench::State &state) {
+    mav::UDPServer server(14701, "127.0.0.1");
+    mav::UDPClient client("127.0.0.1", 14701);
+    burst(state, server, client, [] {}, [] {});
+}};
+
+static bench::Register batched_udp_round_trip{"udp/batched_round_trip", [](bench::State &state) {
+    example::BatchedUDPServer server(14702, "127.0.0.1");
+    example::BatchedUDPClient client("127.0.0.1", 14702);
+    roundTrip(state, server, client);
+}};
+
+static bench::Register batched_udp_burst{"udp/batched_burst64", [](bench::State &state) {
+    example::BatchedUDPServer server(14703, "127.0.0.1");
+    example::BatchedUDPClient client("127.0.0.1", 14703);
+    burst(state, server, client, [&client] { client.beginSendBatch(); }, [&client] { client.flushSendBatch(); });
+}};
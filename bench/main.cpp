@@ -0,0 +1,85 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#include <cstdio>
+#include <string>
+
+#include "Bench.h"
+
+static double runOnce(const bench::Function &function, uint64_t iterations, bench::State &state) {
+    state = bench::State{iterations};
+    function(state);
+    return state.seconds();
+}
+
+int main(int argc, char** argv) {
+    /*
+     * Usage: libmav-bench [filter]
+     * Only benchmarks whose name contains the filter string are run.
+     */
+    std::string filter = argc > 1 ? argv[1] : "";
+    constexpr double target_seconds = 0.5;
+
+    std::printf("%-44s %14s %14s %16s\n", "benchmark", "iterations", "ns/iter", "throughput");
+    for (const auto &[name, function] : bench::registry()) {
+        if (name.find(filter) == std::string::npos) {
+            continue;
+        }
+        bench::State state{1};
+        uint64_t iterations = 1;
+        double seconds = runOnce(function, iterations, state);
+        while (seconds < target_seconds / 10 && iterations < (1ull << 40)) {
+            iterations *= 10;
+            seconds = runOnce(function, iterations, state);
+        }
+        if (seconds < target_seconds) {
+            iterations = static_cast<uint64_t>(iterations * (target_seconds / std::max(seconds, 1e-9)));
+            seconds = runOnce(function, iterations, state);
+        }
+
+        double ns_per_iteration = seconds * 1e9 / static_cast<double>(iterations);
+        char throughput[32] = "";
+        if (state.bytesPerIteration() > 0) {
+            std::snprintf(throughput, sizeof(throughput), "%.1f MB/s",
+                          static_cast<double>(state.bytesPerIteration() * iterations) / seconds / 1e6);
+        } else if (state.itemsPerIteration() > 0) {
+            std::snprintf(throughput, sizeof(throughput), "%.0f items/s",
+                          static_cast<double>(state.itemsPerIteration() * iterations) / seconds);
+        }
+        std::printf("%-44s %14llu %14.1f %16s\n", name.c_str(),
+                    static_cast<unsigned long long>(iterations), ns_per_iteration, throughput);
+    }
+    return 0;
+}
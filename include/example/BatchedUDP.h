@@ -0,0 +1,478 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_BATCHEDUDP_H
+#define LIBMAV_EXAMPLE_BATCHEDUDP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mav/Network.h>
+
+namespace example {
+
+    struct UDPBatchConfig {
+        // Maximum number of datagrams pulled (and pushed) per syscall
+        int batch_size = 32;
+        // Longer datagrams are truncated and counted in UDPBatchStats::truncated
+        int max_datagram_size = 2048;
+        // Ask the kernel to timestamp received datagrams (SO_TIMESTAMPNS), see lastArrival()
+        bool kernel_timestamps = true;
+    };
+
+    /*
+     * Counters for tuning the batch size. The average batch fill is datagrams_received / receive_calls;
+     * if it is close to batch_size, a larger batch saves further syscalls.
+     */
+    struct UDPBatchStats {
+        uint64_t receive_calls = 0;
+        uint64_t datagrams_received = 0;
+        uint64_t largest_batch = 0;
+        uint64_t truncated = 0;
+        // Unread bytes dropped at the end of a datagram, see BatchedUDPSocket::receive()
+        uint64_t discarded_bytes = 0;
+        uint64_t send_calls = 0;
+        uint64_t datagrams_sent = 0;
+    };
+
+    namespace detail {
+
+        /*
+         * Common part of BatchedUDPServer and BatchedUDPClient. Receiving pulls up to batch_size datagrams
+         * with one recvmmsg() call and serves reads from them. Sends are written through immediately, unless
+         * a send batch is open, in which case they are collected and pushed with one sendmmsg() call.
+         * On platforms without recvmmsg / sendmmsg, the batch is filled with non-blocking recvfrom() calls
+         * after the first blocking one, and flushed with a sendto() per datagram.
+         * As with mav::UDPServer, a read is always served from a single datagram, since the next one may come
+         * from a different partner: bytes left in a datagram that are too few for a read are discarded, and so
+         * is the rest of the current datagram on markMessageBoundary().
+         */
+        class BatchedUDPSocket : public mav::NetworkInterface {
+        protected:
+            int _socket = -1;
+            mutable std::atomic_bool _should_terminate{false};
+            UDPBatchConfig _config;
+
+        private:
+            struct Datagram {
+                sockaddr_in address{};
+                int length = 0;
+                // nanoseconds since the epoch, from the kernel if it timestamped the datagram
+                int64_t arrived_at = 0;
+            };
+
+#ifdef __linux__
+            static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(timespec));
+#endif
+
+            // receive side, only touched by the receiving thread
+            std::vector<uint8_t> _rx_buffers;
+            std::vector<Datagram> _rx_datagrams;
+            int _rx_count = 0;
+            int _rx_index = 0;
+            int _rx_offset = 0;
+#ifdef __linux__
+            std::vector<mmsghdr> _rx_headers;
+            std::vector<iovec> _rx_iovecs;
+            std::vector<uint8_t> _rx_control;
+#endif
+
+            // send side, guarded by _tx_mutex
+            std::mutex _tx_mutex;
+            bool _tx_batching = false;
+            std::vector<uint8_t> _tx_buffers;
+            std::vector<Datagram> _tx_datagrams;
+            int _tx_count = 0;
+
+            mutable std::mutex _stats_mutex;
+            UDPBatchStats _stats;
+
+            void _fillReceiveBatch() {
+                int received = 0;
+#ifdef __linux__
+                for (int i = 0; i < _config.batch_size; i++) {
+                    _rx_headers[i].msg_hdr.msg_name = &_rx_datagrams[i].address;
+                    _rx_headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                    _rx_headers[i].msg_hdr.msg_control = _rx_control.data() + i * CONTROL_SIZE;
+                    _rx_headers[i].msg_hdr.msg_controllen = _config.kernel_timestamps ? CONTROL_SIZE : 0;
+                    _rx_headers[i].msg_len = 0;
+                }
+                do {
+                    received = ::recvmmsg(_socket, _rx_headers.data(), _config.batch_size, MSG_WAITFORONE, nullptr);
+                } while (received < 0 && errno == EINTR && !_should_terminate);
+                if (received < 0 || _should_terminate) {
+                    _throwReceiveError();
+                }
+                uint64_t truncated = 0;
+                auto now = _now();
+                for (int i = 0; i < received; i++) {
+                    _rx_datagrams[i].length = static_cast<int>(_rx_headers[i].msg_len);
+                    _rx_datagrams[i].arrived_at = _kernelTimestamp(_rx_headers[i].msg_hdr, now);
+                    if (_rx_headers[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                        truncated++;
+                    }
+                }
+#else
+                uint64_t truncated = 0;
+                while (received < _config.batch_size) {
+                    socklen_t address_length = sizeof(sockaddr_in);
+                    auto datagram_size = static_cast<size_t>(_config.max_datagram_size);
+                    auto length = ::recvfrom(_socket, _rx_buffers.data() + received * datagram_size, datagram_size,
+                                             received == 0 ? 0 : MSG_DONTWAIT,
+                                             reinterpret_cast<sockaddr*>(&_rx_datagrams[received].address),
+                                             &address_length);
+                    if (length < 0) {
+                        if (received > 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                            break;
+                        }
+                        if (errno == EINTR && !_should_terminate) {
+                            continue;
+                        }
+                        _throwReceiveError();
+                    }
+                    if (_should_terminate) {
+                        _throwReceiveError();
+                    }
+                    _rx_datagrams[received].length = static_cast<int>(length);
+                    _rx_datagrams[received].arrived_at = _now();
+                    received++;
+                }
+#endif
+                _rx_count = received;
+                _rx_index = 0;
+                _rx_offset = 0;
+
+                std::lock_guard<std::mutex> lock(_stats_mutex);
+                _stats.receive_calls++;
+                _stats.datagrams_received += received;
+                _stats.largest_batch = std::max<uint64_t>(_stats.largest_batch, received);
+                _stats.truncated += truncated;
+            }
+
+            static int64_t _now() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            }
+
+#ifdef __linux__
+            static int64_t _kernelTimestamp(msghdr &header, int64_t fallback) {
+                for (auto *control = CMSG_FIRSTHDR(&header); control; control = CMSG_NXTHDR(&header, control)) {
+                    if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_TIMESTAMPNS) {
+                        timespec stamp{};
+                        std::memcpy(&stamp, CMSG_DATA(control), sizeof(stamp));
+                        return static_cast<int64_t>(stamp.tv_sec) * 1000000000 + stamp.tv_nsec;
+                    }
+                }
+                return fallback;
+            }
+#endif
+
+            void _discardDatagram() {
+                if (_rx_index >= _rx_count || _rx_offset >= _rx_datagrams[_rx_index].length) {
+                    return;
+                }
+                auto discarded = static_cast<uint64_t>(_rx_datagrams[_rx_index].length - _rx_offset);
+                _rx_offset = _rx_datagrams[_rx_index].length;
+                std::lock_guard<std::mutex> lock(_stats_mutex);
+                _stats.discarded_bytes += discarded;
+            }
+
+            [[noreturn]] void _throwReceiveError() const {
+                if (_should_terminate) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+                throw mav::NetworkError("Could not receive from socket", errno);
+            }
+
+            void _flushLocked() {
+                if (_tx_count == 0) {
+                    return;
+                }
+                int sent = 0;
+                uint64_t calls = 0;
+                auto datagram_size = static_cast<size_t>(_config.max_datagram_size);
+#ifdef __linux__
+                std::vector<mmsghdr> headers(_tx_count);
+                std::vector<iovec> iovecs(_tx_count);
+                for (int i = 0; i < _tx_count; i++) {
+                    iovecs[i].iov_base = _tx_buffers.data() + i * datagram_size;
+                    iovecs[i].iov_len = static_cast<size_t>(_tx_datagrams[i].length);
+                    headers[i] = {};
+                    headers[i].msg_hdr.msg_name = &_tx_datagrams[i].address;
+                    headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+                    headers[i].msg_hdr.msg_iov = &iovecs[i];
+                    headers[i].msg_hdr.msg_iovlen = 1;
+                }
+                while (sent < _tx_count) {
+                    int result = ::sendmmsg(_socket, headers.data() + sent, _tx_count - sent, 0);
+                    calls++;
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        _tx_count = 0;
+                        throw mav::NetworkError("Could not send to socket", errno);
+                    }
+                    sent += result;
+                }
+#else
+                for (; sent < _tx_count; sent++) {
+                    calls++;
+                    if (::sendto(_socket, _tx_buffers.data() + sent * datagram_size,
+                                 static_cast<size_t>(_tx_datagrams[sent].length), 0,
+                                 reinterpret_cast<const sockaddr*>(&_tx_datagrams[sent].address),
+                                 sizeof(sockaddr_in)) < 0) {
+                        _tx_count = 0;
+                        throw mav::NetworkError("Could not send to socket", errno);
+                    }
+                }
+#endif
+                _tx_count = 0;
+                std::lock_guard<std::mutex> lock(_stats_mutex);
+                _stats.send_calls += calls;
+                _stats.datagrams_sent += sent;
+            }
+
+        protected:
+            explicit BatchedUDPSocket(const UDPBatchConfig &config) : _config(config) {
+                _config.batch_size = std::max(1, _config.batch_size);
+                _config.max_datagram_size = std::max(1, _config.max_datagram_size);
+                auto buffer_size = static_cast<size_t>(_config.batch_size) * _config.max_datagram_size;
+                _rx_buffers.resize(buffer_size);
+                _rx_datagrams.resize(_config.batch_size);
+                _tx_buffers.resize(buffer_size);
+                _tx_datagrams.resize(_config.batch_size);
+#ifdef __linux__
+                _rx_headers.resize(_config.batch_size);
+                _rx_iovecs.resize(_config.batch_size);
+                _rx_control.resize(static_cast<size_t>(_config.batch_size) * CONTROL_SIZE);
+                for (int i = 0; i < _config.batch_size; i++) {
+                    _rx_iovecs[i].iov_base = _rx_buffers.data() + static_cast<size_t>(i) * _config.max_datagram_size;
+                    _rx_iovecs[i].iov_len = static_cast<size_t>(_config.max_datagram_size);
+                    _rx_headers[i] = {};
+                    _rx_headers[i].msg_hdr.msg_iov = &_rx_iovecs[i];
+                    _rx_headers[i].msg_hdr.msg_iovlen = 1;
+                }
+#endif
+                _socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+                if (_socket < 0) {
+                    throw mav::NetworkError("Could not create socket", errno);
+                }
+#ifdef SO_TIMESTAMPNS
+                int enable = 1;
+                if (_config.kernel_timestamps) {
+                    // without kernel timestamps, datagrams are stamped when they are pulled from the socket
+                    ::setsockopt(_socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+                }
+#endif
+            }
+
+            /*
+             * Sends to the given address, or queues the datagram if a send batch is open.
+             */
+            void _sendTo(const uint8_t *data, uint32_t size, const sockaddr_in &address) {
+                std::lock_guard<std::mutex> lock(_tx_mutex);
+                if (!_tx_batching) {
+                    if (::sendto(_socket, data, size, 0, reinterpret_cast<const sockaddr*>(&address),
+                                 sizeof(sockaddr_in)) < 0) {
+                        throw mav::NetworkError("Could not send to socket", errno);
+                    }
+                    std::lock_guard<std::mutex> stats_lock(_stats_mutex);
+                    _stats.send_calls++;
+                    _stats.datagrams_sent++;
+                    return;
+                }
+                if (size > static_cast<uint32_t>(_config.max_datagram_size)) {
+                    throw mav::NetworkError("Datagram exceeds max_datagram_size", EMSGSIZE);
+                }
+                if (_tx_count == _config.batch_size) {
+                    _flushLocked();
+                }
+                std::memcpy(_tx_buffers.data() + static_cast<size_t>(_tx_count) * _config.max_datagram_size, data, size);
+                _tx_datagrams[_tx_count].address = address;
+                _tx_datagrams[_tx_count].length = static_cast<int>(size);
+                _tx_count++;
+            }
+
+            static sockaddr_in _toAddress(const mav::ConnectionPartner &partner) {
+                sockaddr_in address{};
+                address.sin_family = AF_INET;
+                address.sin_addr.s_addr = htonl(partner.address());
+                address.sin_port = htons(static_cast<uint16_t>(partner.port()));
+                return address;
+            }
+
+            static mav::ConnectionPartner _toPartner(const sockaddr_in &address) {
+                return {ntohl(address.sin_addr.s_addr), ntohs(address.sin_port), false};
+            }
+
+        public:
+            BatchedUDPSocket(const BatchedUDPSocket&) = delete;
+            BatchedUDPSocket& operator=(const BatchedUDPSocket&) = delete;
+
+            ~BatchedUDPSocket() override {
+                close();
+            }
+
+            void close() const override {
+                if (_should_terminate.exchange(true)) {
+                    return;
+                }
+                ::shutdown(_socket, SHUT_RDWR);
+                ::close(_socket);
+            }
+
+            [[nodiscard]] bool isConnectionOpen() const override {
+                return !_should_terminate;
+            }
+
+            mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+                while (_rx_index >= _rx_count ||
+                        _rx_datagrams[_rx_index].length - _rx_offset < static_cast<int>(size)) {
+                    _discardDatagram();
+                    if (_rx_index + 1 < _rx_count) {
+                        _rx_index++;
+                        _rx_offset = 0;
+                    } else {
+                        _fillReceiveBatch();
+                    }
+                }
+                const auto &datagram = _rx_datagrams[_rx_index];
+                std::memcpy(destination, _rx_buffers.data() +
+                    static_cast<size_t>(_rx_index) * _config.max_datagram_size + _rx_offset, size);
+                _rx_offset += static_cast<int>(size);
+                return _toPartner(datagram.address);
+            }
+
+            void markMessageBoundary() override {
+                _discardDatagram();
+            }
+
+            /*
+             * Arrival time of the datagram that the last receive() was served from, in nanoseconds since the
+             * epoch (system clock), or 0 before the first one. With kernel_timestamps, this is when the kernel
+             * received it, so InstrumentedInterface::setArrivalClock() can measure the whole receive path.
+             * Only meaningful on the receiving thread.
+             */
+            [[nodiscard]] int64_t lastArrival() const {
+                return _rx_index < _rx_count ? _rx_datagrams[_rx_index].arrived_at : 0;
+            }
+
+            /*
+             * Starts collecting sends, so that they go out with a single sendmmsg() call on flushSendBatch().
+             * A batch is flushed early when it holds batch_size datagrams.
+             */
+            void beginSendBatch() {
+                std::lock_guard<std::mutex> lock(_tx_mutex);
+                _tx_batching = true;
+            }
+
+            void flushSendBatch() {
+                std::lock_guard<std::mutex> lock(_tx_mutex);
+                _tx_batching = false;
+                _flushLocked();
+            }
+
+            [[nodiscard]] UDPBatchStats stats() const {
+                std::lock_guard<std::mutex> lock(_stats_mutex);
+                return _stats;
+            }
+
+            [[nodiscard]] const UDPBatchConfig& config() const {
+                return _config;
+            }
+        };
+    }
+
+    /*
+     * Drop-in replacement for mav::UDPServer that receives and sends in batches.
+     */
+    class BatchedUDPServer : public detail::BatchedUDPSocket {
+    public:
+        explicit BatchedUDPServer(int local_port, const std::string &local_address = "0.0.0.0",
+                                  const UDPBatchConfig &config = {}) : BatchedUDPSocket(config) {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(local_port));
+            if (::inet_pton(AF_INET, local_address.c_str(), &address.sin_addr) != 1) {
+                throw mav::NetworkError("Invalid local address " + local_address, EINVAL);
+            }
+            if (::bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+                throw mav::NetworkError("Could not bind socket", errno);
+            }
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            _sendTo(data, size, _toAddress(partner));
+        }
+    };
+
+    /*
+     * Drop-in replacement for mav::UDPClient that receives and sends in batches.
+     */
+    class BatchedUDPClient : public detail::BatchedUDPSocket {
+    private:
+        sockaddr_in _remote{};
+
+    public:
+        BatchedUDPClient(const std::string &remote_address, int remote_port, const UDPBatchConfig &config = {}) :
+            BatchedUDPSocket(config) {
+            _remote.sin_family = AF_INET;
+            _remote.sin_port = htons(static_cast<uint16_t>(remote_port));
+            if (::inet_pton(AF_INET, remote_address.c_str(), &_remote.sin_addr) != 1) {
+                throw mav::NetworkError("Invalid remote address " + remote_address, EINVAL);
+            }
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner) override {
+            _sendTo(data, size, _remote);
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_BATCHEDUDP_H
@@ -0,0 +1,273 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_BROADCASTER_H
+#define LIBMAV_EXAMPLE_BROADCASTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/Crc.h>
+#include <example/Frame.h>
+
+namespace example {
+
+    struct BroadcastConfig {
+        // Count sequence numbers per target, like a Connection does. Otherwise all targets share one
+        // counter and are sent byte-identical frames.
+        bool per_target_sequence = true;
+    };
+
+    struct BroadcastStats {
+        uint64_t broadcasts = 0;
+        uint64_t frames_sent = 0;
+        uint64_t send_errors = 0;
+    };
+
+    namespace detail {
+
+        /*
+         * The checksum is linear: changing the sequence byte by d changes the CRC by a value that only depends
+         * on d and the number of bytes after it, and is the XOR of the changes of the single bits of d. With
+         * those eight values, a frame can be renumbered without running the CRC over it again.
+         */
+        class SequencePatcher {
+        private:
+            static constexpr int SEQUENCE_OFFSET = 4;
+            std::array<std::array<uint16_t, 8>, MAX_FRAME_SIZE> _basis{};
+            std::array<bool, MAX_FRAME_SIZE> _computed{};
+
+            const std::array<uint16_t, 8>& _basisFor(int trailing) {
+                if (!_computed[trailing]) {
+                    for (int bit = 0; bit < 8; bit++) {
+                        // CRC with a zero start value, over the flipped bit followed by trailing zero bytes
+                        uint16_t crc = 0;
+                        crc = static_cast<uint16_t>((crc >> 8) ^ CRC_TABLES[0][(crc ^ (1u << bit)) & 0xFF]);
+                        for (int i = 0; i < trailing; i++) {
+                            crc = static_cast<uint16_t>((crc >> 8) ^ CRC_TABLES[0][crc & 0xFF]);
+                        }
+                        _basis[trailing][bit] = crc;
+                    }
+                    _computed[trailing] = true;
+                }
+                return _basis[trailing];
+            }
+
+        public:
+            /*
+             * Rewrites the sequence number of an unsigned MAVLink v2 frame of the given length, and its checksum.
+             */
+            void patch(uint8_t *frame, int length, uint8_t sequence) {
+                uint8_t difference = frame[SEQUENCE_OFFSET] ^ sequence;
+                if (difference == 0) {
+                    return;
+                }
+                // checksummed bytes after the sequence number: the rest of header and payload, and CRC_EXTRA
+                const auto &basis = _basisFor(length - 6);
+                uint16_t delta = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    if (difference & (1u << bit)) {
+                        delta ^= basis[bit];
+                    }
+                }
+                uint16_t crc = static_cast<uint16_t>(frame[length - 2] | (frame[length - 1] << 8)) ^ delta;
+                frame[SEQUENCE_OFFSET] = sequence;
+                frame[length - 2] = static_cast<uint8_t>(crc & 0xFF);
+                frame[length - 1] = static_cast<uint8_t>(crc >> 8);
+            }
+        };
+    }
+
+    /*
+     * Sends one message to many targets while finalizing it only once. Every further target costs a patch
+     * of the sequence byte and the checksum, instead of serializing and checksumming the message again
+     * as Connection::send() would. Targets are connections of a runtime, or partners added directly; frames
+     * are written straight to the interface, between the batching hooks if there are any.
+     *
+     *      example::Broadcaster broadcaster(phy, {1, 191});
+     *      broadcaster.attach(runtime);
+     *      broadcaster.broadcast(attitude);
+     *
+     * The sequence numbers are counted by the broadcaster, independently of the ones Connection::send() uses.
+     */
+    class Broadcaster {
+    private:
+        struct Target {
+            mav::ConnectionPartner partner;
+            std::weak_ptr<mav::Connection> connection;
+            bool from_connection;
+            uint8_t sequence = 0;
+        };
+
+        mav::NetworkInterface &_interface;
+        mav::Identifier _sender;
+        BroadcastConfig _config;
+
+        std::mutex _mutex;
+        std::vector<Target> _targets;
+        uint8_t _shared_sequence = 0;
+        std::function<void()> _begin_batch;
+        std::function<void()> _flush_batch;
+        std::array<uint8_t, MAX_FRAME_SIZE> _frame{};
+        detail::SequencePatcher _patcher;
+        BroadcastStats _stats;
+
+        void _add(const mav::ConnectionPartner &partner, const std::shared_ptr<mav::Connection> &connection) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto &target : _targets) {
+                if (target.partner == partner) {
+                    return;
+                }
+            }
+            _targets.push_back({partner, connection, connection != nullptr});
+        }
+
+    public:
+        Broadcaster(mav::NetworkInterface &interface, const mav::Identifier &sender, const BroadcastConfig &config = {}) :
+            _interface(interface), _sender(sender), _config(config) {}
+
+        Broadcaster(const Broadcaster&) = delete;
+        Broadcaster& operator=(const Broadcaster&) = delete;
+
+        /*
+         * Broadcasts to every connection the runtime establishes from now on. The runtime must be driving the
+         * interface this broadcaster writes to.
+         */
+        void attach(mav::NetworkRuntime &runtime) {
+            runtime.onConnection([this](const std::shared_ptr<mav::Connection> &connection) {
+                addConnection(connection);
+            });
+        }
+
+        /*
+         * Adds a connection as a target. It is dropped once it is no longer alive.
+         */
+        void addConnection(const std::shared_ptr<mav::Connection> &connection) {
+            _add(connection->partner(), connection);
+        }
+
+        void addPartner(const mav::ConnectionPartner &partner) {
+            _add(partner, nullptr);
+        }
+
+        void removePartner(const mav::ConnectionPartner &partner) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _targets.erase(std::remove_if(_targets.begin(), _targets.end(),
+                [&partner](const Target &target) { return target.partner == partner; }), _targets.end());
+        }
+
+        /*
+         * Hooks run before and after the writes of a broadcast, e.g. beginSendBatch() / flushSendBatch() of a
+         * BatchedUDPServer, so the whole fan-out goes out in one syscall.
+         */
+        void setBatching(std::function<void()> begin_batch, std::function<void()> flush_batch) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _begin_batch = std::move(begin_batch);
+            _flush_batch = std::move(flush_batch);
+        }
+
+        /*
+         * Finalizes the message once and sends it to all targets. Returns the number of targets it was sent to.
+         */
+        size_t broadcast(mav::Message &message) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _targets.erase(std::remove_if(_targets.begin(), _targets.end(), [](const Target &target) {
+                if (!target.from_connection) {
+                    return false;
+                }
+                auto connection = target.connection.lock();
+                return !connection || !connection->alive();
+            }), _targets.end());
+            _stats.broadcasts++;
+            if (_targets.empty()) {
+                return 0;
+            }
+
+            uint8_t first_sequence = _config.per_target_sequence ? _targets.front().sequence : _shared_sequence++;
+            auto length = static_cast<int>(message.finalize(first_sequence, _sender));
+            std::memcpy(_frame.data(), message.data(), length);
+            // signed frames can not be renumbered, they all keep the sequence they were finalized with
+            bool patchable = _config.per_target_sequence && !FrameHeader{_frame.data()}.isSigned();
+
+            if (_begin_batch) {
+                _begin_batch();
+            }
+            size_t sent = 0;
+            for (auto &target : _targets) {
+                if (patchable) {
+                    _patcher.patch(_frame.data(), length, target.sequence);
+                }
+                target.sequence++;
+                try {
+                    _interface.send(_frame.data(), static_cast<uint32_t>(length), target.partner);
+                    sent++;
+                } catch (const std::exception&) {
+                    _stats.send_errors++;
+                }
+            }
+            if (_flush_batch) {
+                try {
+                    _flush_batch();
+                } catch (const std::exception&) {
+                    _stats.send_errors++;
+                }
+            }
+            _stats.frames_sent += sent;
+            return sent;
+        }
+
+        [[nodiscard]] size_t targetCount() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _targets.size();
+        }
+
+        [[nodiscard]] BroadcastStats stats() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _stats;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_BROADCASTER_H
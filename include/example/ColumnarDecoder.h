@@ -0,0 +1,362 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_COLUMNARDECODER_H
+#define LIBMAV_EXAMPLE_COLUMNARDECODER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <mav/MessageSet.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/FieldHandle.h>
+#include <example/Frame.h>
+#include <example/FrameReader.h>
+#include <example/Tlog.h>
+
+namespace example {
+
+    enum class FrameFormat {
+        // Frames back to back, e.g. a raw serial capture
+        RAW,
+        // Frames prefixed with a big endian microsecond timestamp, see Tlog.h
+        TLOG
+    };
+
+    /*
+     * Typed reference to a selected column, returned by ColumnarDecoder::addColumn().
+     */
+    template <typename T>
+    struct Column {
+        uint32_t message_id;
+        size_t index;
+    };
+
+    /*
+     * Decoded columns, one table per selected message. All columns of a table have rows(message_id) rows,
+     * row i of every column (and of the timestamps, for tlogs) belonging to the same frame.
+     */
+    class ColumnarResult {
+    public:
+        using Storage = std::variant<std::vector<int8_t>, std::vector<uint8_t>, std::vector<int16_t>,
+            std::vector<uint16_t>, std::vector<int32_t>, std::vector<uint32_t>, std::vector<int64_t>,
+            std::vector<uint64_t>, std::vector<float>, std::vector<double>>;
+
+        struct Table {
+            std::vector<uint64_t> timestamps;
+            std::vector<Storage> columns;
+            size_t rows = 0;
+        };
+
+    private:
+        std::unordered_map<uint32_t, Table> _tables;
+
+        friend class ColumnarDecoder;
+
+    public:
+        [[nodiscard]] size_t rows(uint32_t message_id) const {
+            auto it = _tables.find(message_id);
+            return it == _tables.end() ? 0 : it->second.rows;
+        }
+
+        /*
+         * Receive times in microseconds since the epoch. Empty unless the input was a tlog.
+         */
+        [[nodiscard]] const std::vector<uint64_t>& timestamps(uint32_t message_id) const {
+            return _tables.at(message_id).timestamps;
+        }
+
+        template <typename T>
+        [[nodiscard]] const std::vector<T>& column(const Column<T> &column) const {
+            return std::get<std::vector<T>>(_tables.at(column.message_id).columns[column.index]);
+        }
+    };
+
+    /*
+     * Bulk decoder for offline analysis. Instead of building a Message per frame, it walks a buffer of
+     * frames once and appends the selected fields to one contiguous vector per field (structure of arrays),
+     * ready for vectorized processing:
+     *
+     *      ColumnarDecoder decoder(message_set);
+     *      auto roll = decoder.addColumn<float>("ATTITUDE", "roll");
+     *      auto result = decoder.decodeParallel(log.data(), log.size(), FrameFormat::TLOG);
+     *      const std::vector<float> &rolls = result.column(roll);
+     *
+     * Framing is checksum-verified by default; after a bad frame, decoding resynchronizes on the next byte.
+     * Frames of messages the message set does not know are skipped whole.
+     */
+    class ColumnarDecoder {
+    private:
+        struct ColumnSpec {
+            FieldHandle handle;
+            int array_index;
+            // index of the Storage alternative
+            size_t type;
+        };
+
+        struct TableSpec {
+            std::vector<ColumnSpec> columns;
+        };
+
+        const mav::MessageSet &_message_set;
+        std::unordered_map<uint32_t, TableSpec> _tables;
+        bool _verify = true;
+
+        template <typename T, size_t I = 0>
+        static constexpr size_t _typeIndex() {
+            if constexpr (std::is_same_v<std::variant_alternative_t<I, ColumnarResult::Storage>, std::vector<T>>) {
+                return I;
+            } else {
+                return _typeIndex<T, I + 1>();
+            }
+        }
+
+        static void _append(ColumnarResult::Storage &storage, const FrameView &frame, const ColumnSpec &spec) {
+            uint8_t raw[8];
+            int size = detail::baseSize(spec.handle.type);
+            frame.readPayload(raw, spec.handle.offset + spec.array_index * size, size);
+            std::visit([&](auto &values) {
+                using T = typename std::decay_t<decltype(values)>::value_type;
+                values.push_back(detail::readAs<T>(raw, spec.handle.type));
+            }, storage);
+        }
+
+        ColumnarResult _emptyResult() const {
+            ColumnarResult result;
+            for (const auto &[message_id, spec] : _tables) {
+                auto &table = result._tables[message_id];
+                for (const auto &column : spec.columns) {
+                    table.columns.push_back(_makeStorage(column.type));
+                }
+            }
+            return result;
+        }
+
+        template <size_t I = 0>
+        static ColumnarResult::Storage _makeStorage(size_t type) {
+            if constexpr (I < std::variant_size_v<ColumnarResult::Storage>) {
+                if (type == I) {
+                    return ColumnarResult::Storage{std::in_place_index<I>};
+                }
+                return _makeStorage<I + 1>(type);
+            } else {
+                return {};
+            }
+        }
+
+        /*
+         * Decodes the frames starting in [begin, end) of the buffer [data, data + size) into result.
+         * A frame starting before end may extend past it.
+         */
+        void _decodeRange(const uint8_t *data, size_t size, size_t begin, size_t end, FrameFormat format,
+                          bool verify, ColumnarResult &result) const {
+            CrcExtraCache crc_extra(_message_set);
+            const size_t prefix = format == FrameFormat::TLOG ? TLOG_TIMESTAMP_SIZE : 0;
+            size_t position = begin;
+            while (position < end) {
+                const uint8_t *frame = data + position + prefix;
+                size_t available = size - position;
+                if (available < prefix + HEADER_SIZE_V1) {
+                    return;
+                }
+                if (!FrameHeader::isMagic(*frame)) {
+                    if (format == FrameFormat::RAW) {
+                        // skip straight to the next candidate
+                        auto skip = findMagic(frame + 1, end - position - 1);
+                        if (skip == end - position - 1) {
+                            return;
+                        }
+                        position += 1 + skip;
+                    } else {
+                        position++;
+                    }
+                    continue;
+                }
+                if (available < prefix + FrameHeader::headerSize(*frame)) {
+                    return;
+                }
+                FrameHeader header{frame};
+                size_t length = static_cast<size_t>(header.frameLength());
+                if ((header.incompatFlags() & ~INCOMPAT_FLAG_SIGNED) != 0 || available < prefix + length) {
+                    position++;
+                    continue;
+                }
+                if (verify) {
+                    auto verification = verifyFrame(frame, crc_extra);
+                    if (verification == Verification::BAD_CHECKSUM) {
+                        position++;
+                        continue;
+                    }
+                    if (verification == Verification::UNKNOWN_MESSAGE) {
+                        // skipped as a whole only if the next frame lines up behind it, otherwise this may
+                        // be a false magic byte in front of real frames
+                        size_t next = position + prefix + length;
+                        bool aligned = next + prefix >= size || FrameHeader::isMagic(data[next + prefix]);
+                        position = aligned ? next : position + 1;
+                        continue;
+                    }
+                }
+                auto table = result._tables.find(header.messageId());
+                if (table != result._tables.end()) {
+                    FrameView view{frame, static_cast<int>(length)};
+                    const auto &columns = _tables.at(header.messageId()).columns;
+                    for (size_t i = 0; i < columns.size(); i++) {
+                        _append(table->second.columns[i], view, columns[i]);
+                    }
+                    if (prefix) {
+                        table->second.timestamps.push_back(detail::loadBigEndian64(data + position));
+                    }
+                    table->second.rows++;
+                }
+                position += prefix + length;
+            }
+        }
+
+        static void _concatenate(ColumnarResult &target, ColumnarResult &&source) {
+            for (auto &[message_id, table] : source._tables) {
+                auto &destination = target._tables[message_id];
+                destination.rows += table.rows;
+                destination.timestamps.insert(destination.timestamps.end(), table.timestamps.begin(),
+                                              table.timestamps.end());
+                for (size_t i = 0; i < table.columns.size(); i++) {
+                    std::visit([&](auto &values) {
+                        using V = std::decay_t<decltype(values)>;
+                        auto &into = std::get<V>(destination.columns[i]);
+                        into.insert(into.end(), values.begin(), values.end());
+                    }, table.columns[i]);
+                }
+            }
+        }
+
+    public:
+        explicit ColumnarDecoder(const mav::MessageSet &message_set) : _message_set(message_set) {}
+
+        /*
+         * Selects a field to decode, converted to T like Message::get<T> would. T has to be one of the
+         * fixed width integer types, float or double. Array elements are selected by index.
+         */
+        template <typename T>
+        Column<T> addColumn(const std::string &message_name, const std::string &field_name, int array_index = 0) {
+            auto handle = field(_message_set, message_name, field_name);
+            if (array_index < 0 || array_index >= handle.array_length) {
+                throw std::out_of_range("Array index out of range for field " + field_name);
+            }
+            auto &table = _tables[static_cast<uint32_t>(handle.message_id)];
+            table.columns.push_back({handle, array_index, _typeIndex<T>()});
+            return {static_cast<uint32_t>(handle.message_id), table.columns.size() - 1};
+        }
+
+        /*
+         * Turns off checksum verification. Faster on trusted input, but a corrupt frame can then throw
+         * off the framing. decodeParallel() always verifies, since it has to find frame starts.
+         */
+        void setVerification(bool enabled) {
+            _verify = enabled;
+        }
+
+        [[nodiscard]] ColumnarResult decode(const uint8_t *data, size_t size, FrameFormat format) const {
+            auto result = _emptyResult();
+            _decodeRange(data, size, 0, size, format, _verify, result);
+            return result;
+        }
+
+        /*
+         * Splits the buffer into one chunk per thread and decodes them concurrently. Each chunk starts
+         * decoding at the first verified frame in it, which is where the previous chunk stops, so rows come
+         * out in the same order as with decode().
+         */
+        [[nodiscard]] ColumnarResult decodeParallel(const uint8_t *data, size_t size, FrameFormat format,
+                                                    unsigned threads = std::thread::hardware_concurrency()) const {
+            // below this, splitting costs more than it gains
+            constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+            threads = static_cast<unsigned>(std::clamp<size_t>(size / MIN_CHUNK_SIZE, 1, std::max(1u, threads)));
+            if (threads == 1) {
+                auto result = _emptyResult();
+                _decodeRange(data, size, 0, size, format, true, result);
+                return result;
+            }
+
+            const size_t prefix = format == FrameFormat::TLOG ? TLOG_TIMESTAMP_SIZE : 0;
+            std::vector<size_t> starts(threads + 1, size);
+            starts[0] = 0;
+            CrcExtraCache crc_extra(_message_set);
+            for (unsigned i = 1; i < threads; i++) {
+                // first position in the chunk where a frame verifies: a frame of a known message with a
+                // correct checksum is practically never a coincidence
+                size_t position = std::max(starts[i - 1], size / threads * i);
+                while (position + prefix + HEADER_SIZE_V1 <= size) {
+                    const uint8_t *frame = data + position + prefix;
+                    if (FrameHeader::isMagic(*frame) &&
+                        position + prefix + FrameHeader::headerSize(*frame) <= size &&
+                        position + prefix + FrameHeader{frame}.frameLength() <= size &&
+                        verifyFrame(frame, crc_extra) == Verification::VALID) {
+                        break;
+                    }
+                    position++;
+                }
+                starts[i] = std::min(position, size);
+            }
+
+            std::vector<ColumnarResult> partial(threads);
+            std::vector<std::thread> workers;
+            for (unsigned i = 0; i < threads; i++) {
+                partial[i] = _emptyResult();
+                workers.emplace_back([&, i] {
+                    _decodeRange(data, size, starts[i], starts[i + 1], format, true, partial[i]);
+                });
+            }
+            for (auto &worker : workers) {
+                worker.join();
+            }
+            auto result = std::move(partial[0]);
+            for (unsigned i = 1; i < threads; i++) {
+                _concatenate(result, std::move(partial[i]));
+            }
+            return result;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_COLUMNARDECODER_H
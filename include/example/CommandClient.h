@@ -0,0 +1,373 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_COMMANDCLIENT_H
+#define LIBMAV_EXAMPLE_COMMANDCLIENT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/FieldHandle.h>
+#include <example/Frame.h>
+
+namespace example {
+
+    struct CommandResult {
+        // MAV_RESULT of the final COMMAND_ACK, meaningless if timed_out is set
+        int result = -1;
+        int progress = 0;
+        int32_t result_param2 = 0;
+        // Number of times the command was sent
+        int attempts = 0;
+        bool timed_out = false;
+    };
+
+    struct CommandClientConfig {
+        // Sends per command, including the first one
+        int attempts = 3;
+        int timeout_ms = 500;
+    };
+
+    /*
+     * Asynchronous COMMAND_LONG / COMMAND_INT transactions on any number of connections, driven by a single
+     * worker thread. submit() only queues the command and returns; the worker sends it, matches the
+     * COMMAND_ACK by command id and target (the sender of the ack), and retransmits on timeout. COMMAND_LONG
+     * retransmissions increase the confirmation field, as the command protocol requires.
+     * Commands with the same id to the same target are sent one after the other, since their acks can not be
+     * told apart. MAV_RESULT_IN_PROGRESS acks extend the timeout instead of completing the command.
+     */
+    class CommandClient {
+    public:
+        using Callback = std::function<void(const CommandResult &result)>;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        using Key = std::tuple<const mav::Connection*, int, int, int>;
+
+        static constexpr int MAV_RESULT_IN_PROGRESS = 5;
+
+        struct MessageFields {
+            FieldHandle command, target_system, target_component;
+            std::optional<FieldHandle> confirmation;
+        };
+
+        struct Pending {
+            std::shared_ptr<mav::Connection> connection;
+            // never finalized, every attempt sends a copy of it
+            std::optional<mav::Message> message;
+            bool is_command_long = true;
+            int attempts = 0;
+            Clock::time_point deadline;
+            Callback callback;
+        };
+
+        struct Registration {
+            std::weak_ptr<mav::Connection> connection;
+            mav::CallbackHandle handle;
+        };
+
+        const mav::MessageSet &_message_set;
+        CommandClientConfig _config;
+        MessageFields _long_fields, _int_fields;
+        FieldHandle _ack_command, _ack_result, _ack_progress, _ack_result_param2;
+        int _command_long_id, _command_int_id, _command_ack_id;
+
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        std::map<Key, std::deque<std::unique_ptr<Pending>>> _pending;
+        std::map<const mav::Connection*, Registration> _registrations;
+        bool _should_terminate = false;
+        std::thread _worker;
+
+        void _register(const std::shared_ptr<mav::Connection> &connection) {
+            if (_registrations.find(connection.get()) != _registrations.end()) {
+                return;
+            }
+            const mav::Connection *key = connection.get();
+            auto handle = connection->addMessageCallback([this, key](const mav::Message &message) {
+                if (message.id() == _command_ack_id) {
+                    _onAck(key, message);
+                }
+            });
+            _registrations[key] = Registration{connection, handle};
+        }
+
+        /*
+         * The command waiting for an ack from the given sender. Commands to the broadcast system or
+         * component id 0 are answered by whoever handles them, so they match any sender.
+         */
+        decltype(_pending)::iterator _findPending(const mav::Connection *connection, int command,
+                                                  int system_id, int component_id) {
+            for (auto [target_system, target_component] : {std::pair{system_id, component_id},
+                                                           std::pair{system_id, 0}, std::pair{0, 0}}) {
+                auto it = _pending.find(Key{connection, command, target_system, target_component});
+                if (it != _pending.end() && !it->second.empty() && it->second.front()->attempts > 0) {
+                    return it;
+                }
+            }
+            return _pending.end();
+        }
+
+        void _onAck(const mav::Connection *connection, const mav::Message &ack) {
+            // COMMAND_ACK is usually received truncated down to command and result, the reads below
+            // zero-extend past the received payload
+            FrameHeader header{ack.data()};
+            CommandResult result;
+            result.result = example::get<int>(ack, _ack_result);
+            result.progress = example::get<int>(ack, _ack_progress);
+            result.result_param2 = example::get<int32_t>(ack, _ack_result_param2);
+
+            Callback callback;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _findPending(connection, example::get<int>(ack, _ack_command),
+                                       header.systemId(), header.componentId());
+                if (it == _pending.end()) {
+                    return;
+                }
+                auto &pending = *it->second.front();
+                if (result.result == MAV_RESULT_IN_PROGRESS) {
+                    pending.deadline = Clock::now() + std::chrono::milliseconds(_config.timeout_ms);
+                    return;
+                }
+                result.attempts = pending.attempts;
+                callback = std::move(pending.callback);
+                it->second.pop_front();
+                if (it->second.empty()) {
+                    _pending.erase(it);
+                }
+            }
+            // the next command for this target, if any, is sent by the worker
+            _wakeup.notify_one();
+            if (callback) {
+                callback(result);
+            }
+        }
+
+        void _workerLoop() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (!_should_terminate) {
+                auto now = Clock::now();
+                auto next_deadline = Clock::time_point::max();
+                std::vector<std::pair<std::shared_ptr<mav::Connection>, mav::Message>> to_send;
+                std::vector<std::pair<Callback, CommandResult>> timed_out;
+
+                for (auto it = _pending.begin(); it != _pending.end();) {
+                    auto &pending = *it->second.front();
+                    if (pending.attempts > 0 && pending.deadline > now) {
+                        next_deadline = std::min(next_deadline, pending.deadline);
+                        ++it;
+                        continue;
+                    }
+                    if (pending.attempts >= _config.attempts) {
+                        CommandResult result;
+                        result.attempts = pending.attempts;
+                        result.timed_out = true;
+                        timed_out.emplace_back(std::move(pending.callback), result);
+                        it->second.pop_front();
+                        if (it->second.empty()) {
+                            it = _pending.erase(it);
+                        }
+                        // otherwise, the next command for this target is picked up right away
+                        continue;
+                    }
+                    if (pending.attempts > 0 && pending.is_command_long) {
+                        set(*pending.message, *_long_fields.confirmation, pending.attempts);
+                    }
+                    pending.attempts++;
+                    pending.deadline = now + std::chrono::milliseconds(_config.timeout_ms);
+                    next_deadline = std::min(next_deadline, pending.deadline);
+                    to_send.emplace_back(pending.connection, *pending.message);
+                    ++it;
+                }
+
+                if (!to_send.empty() || !timed_out.empty()) {
+                    lock.unlock();
+                    for (auto &[connection, message] : to_send) {
+                        try {
+                            connection->send(message);
+                        } catch (const std::exception&) {
+                            // treated like a lost message, the retransmission timer covers it
+                        }
+                    }
+                    for (auto &[callback, result] : timed_out) {
+                        if (callback) {
+                            callback(result);
+                        }
+                    }
+                    lock.lock();
+                    continue;
+                }
+                if (next_deadline == Clock::time_point::max()) {
+                    _wakeup.wait(lock);
+                } else {
+                    _wakeup.wait_until(lock, next_deadline);
+                }
+            }
+        }
+
+        /*
+         * A copy of the command that can still be written to. The caller's message may be finalized, with
+         * its payload truncated, and fields set on it past the truncation would be lost.
+         */
+        mav::Message _unfinalizedCopy(const mav::Message &command) const {
+            auto copy = _message_set.create(command.id());
+            detail::readPayload(command, detail::payload(copy), 0, copy.type().maxPayloadSize());
+            return copy;
+        }
+
+        MessageFields _resolve(const std::string &message_name, bool has_confirmation) const {
+            MessageFields fields{field(_message_set, message_name, "command"),
+                                 field(_message_set, message_name, "target_system"),
+                                 field(_message_set, message_name, "target_component"),
+                                 std::nullopt};
+            if (has_confirmation) {
+                fields.confirmation = field(_message_set, message_name, "confirmation");
+            }
+            return fields;
+        }
+
+    public:
+        explicit CommandClient(const mav::MessageSet &message_set, const CommandClientConfig &config = {}) :
+                _message_set(message_set), _config(config),
+                _long_fields(_resolve("COMMAND_LONG", true)),
+                _int_fields(_resolve("COMMAND_INT", false)),
+                _ack_command(field(message_set, "COMMAND_ACK", "command")),
+                _ack_result(field(message_set, "COMMAND_ACK", "result")),
+                _ack_progress(field(message_set, "COMMAND_ACK", "progress")),
+                _ack_result_param2(field(message_set, "COMMAND_ACK", "result_param2")),
+                _command_long_id(message_set.idForMessage("COMMAND_LONG")),
+                _command_int_id(message_set.idForMessage("COMMAND_INT")),
+                _command_ack_id(message_set.idForMessage("COMMAND_ACK")) {
+            _worker = std::thread{&CommandClient::_workerLoop, this};
+        }
+
+        CommandClient(const CommandClient&) = delete;
+        CommandClient& operator=(const CommandClient&) = delete;
+
+        /*
+         * Stops the worker. Commands still pending are dropped without calling their callbacks.
+         */
+        ~CommandClient() {
+            // no acks may come in while the members they touch go away, so the callbacks go first
+            std::map<const mav::Connection*, Registration> registrations;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                registrations.swap(_registrations);
+            }
+            for (auto &[key, registration] : registrations) {
+                if (auto connection = registration.connection.lock()) {
+                    connection->removeMessageCallback(registration.handle);
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _should_terminate = true;
+            }
+            _wakeup.notify_one();
+            _worker.join();
+        }
+
+        /*
+         * Queues a COMMAND_LONG or COMMAND_INT message for sending on the connection. The callback runs once,
+         * on the connection's receive thread for an ack or on the worker thread for a timeout.
+         */
+        void submit(const std::shared_ptr<mav::Connection> &connection, const mav::Message &command,
+                    Callback callback) {
+            bool is_command_long = command.id() == _command_long_id;
+            if (!is_command_long && command.id() != _command_int_id) {
+                throw std::invalid_argument("CommandClient only sends COMMAND_LONG and COMMAND_INT");
+            }
+            const auto &fields = is_command_long ? _long_fields : _int_fields;
+            auto pending = std::make_unique<Pending>();
+            pending->connection = connection;
+            pending->message.emplace(_unfinalizedCopy(command));
+            pending->is_command_long = is_command_long;
+            pending->callback = std::move(callback);
+            if (is_command_long) {
+                set(*pending->message, *fields.confirmation, 0);
+            }
+            Key key{connection.get(), example::get<int>(command, fields.command),
+                    example::get<int>(command, fields.target_system), example::get<int>(command, fields.target_component)};
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _register(connection);
+                _pending[key].push_back(std::move(pending));
+            }
+            _wakeup.notify_one();
+        }
+
+        std::future<CommandResult> submit(const std::shared_ptr<mav::Connection> &connection,
+                                          const mav::Message &command) {
+            auto promise = std::make_shared<std::promise<CommandResult>>();
+            auto future = promise->get_future();
+            submit(connection, command, [promise](const CommandResult &result) {
+                promise->set_value(result);
+            });
+            return future;
+        }
+
+        /*
+         * Number of commands queued or waiting for their ack, over all connections.
+         */
+        size_t pendingCount() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            size_t count = 0;
+            for (const auto &[key, queue] : _pending) {
+                count += queue.size();
+            }
+            return count;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_COMMANDCLIENT_H
@@ -0,0 +1,458 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_COROUTINES_H
+#define LIBMAV_EXAMPLE_COROUTINES_H
+
+#if !defined(__cpp_impl_coroutine) || !__has_include(<coroutine>)
+#error "example/Coroutines.h requires C++20 coroutines, configure with -DLIBMAV_EXAMPLE_COROUTINES=ON"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/Expectations.h>
+
+namespace example {
+
+    template <typename T = void>
+    class Task;
+
+    namespace detail {
+
+        struct TaskPromiseBase {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+
+                template <typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+                    auto continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+
+                void await_resume() noexcept {}
+            };
+
+            FinalAwaiter final_suspend() noexcept { return {}; }
+
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        template <typename T>
+        struct TaskPromise : TaskPromiseBase {
+            std::optional<T> value;
+
+            Task<T> get_return_object();
+            void return_value(T v) { value.emplace(std::move(v)); }
+
+            T result() {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct TaskPromise<void> : TaskPromiseBase {
+            Task<void> get_return_object();
+            void return_void() {}
+
+            void result() {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            }
+        };
+
+        /*
+         * Timer thread for the await timeouts, shared by all AsyncConnections. A timer that is cancelled drops
+         * its callback right away; only its deadline and id stay queued until they come up.
+         */
+        class TimeoutThread {
+        private:
+            using Clock = std::chrono::steady_clock;
+            using Deadline = std::pair<Clock::time_point, uint64_t>;
+
+            std::mutex _mutex;
+            std::condition_variable _wakeup;
+            std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>> _deadlines;
+            std::unordered_map<uint64_t, std::function<void()>> _callbacks;
+            uint64_t _next_id = 1;
+            bool _should_terminate = false;
+            std::thread _thread;
+
+            void _loop() {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!_should_terminate) {
+                    if (_deadlines.empty()) {
+                        _wakeup.wait(lock);
+                        continue;
+                    }
+                    // a copy, the queue may grow while waiting
+                    auto deadline = _deadlines.top().first;
+                    if (Clock::now() < deadline) {
+                        _wakeup.wait_until(lock, deadline);
+                        continue;
+                    }
+                    auto it = _callbacks.find(_deadlines.top().second);
+                    _deadlines.pop();
+                    if (it == _callbacks.end()) {
+                        continue;
+                    }
+                    auto callback = std::move(it->second);
+                    _callbacks.erase(it);
+                    lock.unlock();
+                    callback();
+                    lock.lock();
+                }
+            }
+
+        public:
+            TimeoutThread() : _thread(&TimeoutThread::_loop, this) {}
+
+            ~TimeoutThread() {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _should_terminate = true;
+                }
+                _wakeup.notify_one();
+                _thread.join();
+            }
+
+            static TimeoutThread& shared() {
+                static TimeoutThread instance;
+                return instance;
+            }
+
+            /*
+             * Returns an id for cancel(), never 0.
+             */
+            uint64_t schedule(std::chrono::milliseconds delay, std::function<void()> callback) {
+                uint64_t id;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    id = _next_id++;
+                    _deadlines.emplace(Clock::now() + delay, id);
+                    _callbacks.emplace(id, std::move(callback));
+                }
+                _wakeup.notify_one();
+                return id;
+            }
+
+            void cancel(uint64_t id) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _callbacks.erase(id);
+            }
+        };
+    }
+
+    /*
+     * Lazily started coroutine returning T. A Task runs when it is co_awaited, and resumes its awaiter when it
+     * finishes. Top-level tasks are started with spawn() or syncWait().
+     */
+    template <typename T>
+    class [[nodiscard]] Task {
+    public:
+        using promise_type = detail::TaskPromise<T>;
+
+    private:
+        std::coroutine_handle<promise_type> _handle;
+
+    public:
+        explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+        Task(Task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task() {
+            if (_handle) {
+                _handle.destroy();
+            }
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            _handle.promise().continuation = awaiter;
+            return _handle;
+        }
+
+        T await_resume() {
+            return _handle.promise().result();
+        }
+    };
+
+    namespace detail {
+        template <typename T>
+        inline Task<T> TaskPromise<T>::get_return_object() {
+            return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+        }
+
+        inline Task<void> TaskPromise<void>::get_return_object() {
+            return Task<void>{std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+        }
+
+        struct Detached {
+            struct promise_type {
+                Detached get_return_object() { return {}; }
+                std::suspend_never initial_suspend() noexcept { return {}; }
+                std::suspend_never final_suspend() noexcept { return {}; }
+                void return_void() {}
+                void unhandled_exception() { std::terminate(); }
+            };
+        };
+
+        inline Detached runDetached(Task<void> task) {
+            co_await task;
+        }
+
+        template <typename T>
+        inline Detached runAndSignal(Task<T> task, std::promise<T> &result) {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await task;
+                    result.set_value();
+                } else {
+                    result.set_value(co_await task);
+                }
+            } catch (...) {
+                result.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    /*
+     * Starts a task without waiting for it. The task must handle its own exceptions.
+     */
+    inline void spawn(Task<void> task) {
+        detail::runDetached(std::move(task));
+    }
+
+    /*
+     * Runs a task and blocks the calling thread until it finishes, for use from non-coroutine code.
+     */
+    template <typename T>
+    inline T syncWait(Task<T> task) {
+        std::promise<T> result;
+        auto future = result.get_future();
+        detail::runAndSignal(std::move(task), result);
+        return future.get();
+    }
+
+    /*
+     * Awaitable for a message that has already been armed in an ExpectationTable. Awaiting it suspends the
+     * coroutine until the message arrives, or throws mav::TimeoutException when the timeout expires first.
+     * A pending wait is a table slot plus this small shared state, no thread is blocked. Timeouts run on a
+     * timer thread shared by all connections, and are cancelled when the wait completes.
+     * The coroutine resumes on the connection's receive thread (or the timeout thread), so it must not block.
+     */
+    class AwaitableMessage {
+        friend class AsyncConnection;
+    private:
+        struct State {
+            enum Phase : int { WAITING, SUSPENDED, COMPLETED };
+            std::atomic<int> phase{WAITING};
+            std::atomic_bool finished{false};
+            std::coroutine_handle<> handle;
+            std::optional<mav::Message> message;
+            ExpectationTable::Ticket ticket;
+            // TimeoutThread id of the timeout, 0 if there is none (yet)
+            std::atomic<uint64_t> timer{0};
+
+            void complete() {
+                if (phase.exchange(COMPLETED, std::memory_order_acq_rel) == SUSPENDED) {
+                    handle.resume();
+                }
+            }
+        };
+
+        std::shared_ptr<State> _state;
+
+        explicit AwaitableMessage(std::shared_ptr<State> state) : _state(std::move(state)) {}
+
+    public:
+        bool await_ready() const noexcept {
+            return _state->phase.load(std::memory_order_acquire) == State::COMPLETED;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept {
+            _state->handle = handle;
+            int expected = State::WAITING;
+            // false resumes right away, if the message arrived in the meantime
+            return _state->phase.compare_exchange_strong(expected, State::SUSPENDED, std::memory_order_acq_rel);
+        }
+
+        mav::Message await_resume() {
+            if (!_state->message) {
+                throw mav::TimeoutException("Expected message timed out");
+            }
+            return std::move(*_state->message);
+        }
+    };
+
+    /*
+     * Coroutine interface to a Connection. Like connection->expect(...), expect() arms the wait immediately,
+     * so sending the request after it can not miss the answer; the result can be co_awaited later.
+     *
+     *     Task<void> readVersion(AsyncConnection &connection, mav::Message request) {
+     *         auto response = co_await connection.sendAndReceive(request, "AUTOPILOT_VERSION", 1000);
+     *         ...
+     *     }
+     */
+    class AsyncConnection {
+    private:
+        /*
+         * Timeouts of waits may still be queued when the connection goes away. They reach its table through
+         * this, which the destructor clears.
+         */
+        struct TableScope {
+            std::mutex mutex;
+            ExpectationTable *table;
+        };
+
+        const mav::MessageSet &_message_set;
+        std::shared_ptr<mav::Connection> _connection;
+        ExpectationDispatcher _dispatcher;
+        detail::TimeoutThread &_timeouts = detail::TimeoutThread::shared();
+        std::shared_ptr<TableScope> _scope;
+
+    public:
+        AsyncConnection(const mav::MessageSet &message_set, std::shared_ptr<mav::Connection> connection) :
+            _message_set(message_set), _connection(connection), _dispatcher(message_set, std::move(connection)),
+            _scope(std::make_shared<TableScope>()) {
+            _scope->table = &_dispatcher.table();
+        }
+
+        AsyncConnection(const AsyncConnection&) = delete;
+        AsyncConnection& operator=(const AsyncConnection&) = delete;
+
+        ~AsyncConnection() {
+            std::lock_guard<std::mutex> lock(_scope->mutex);
+            _scope->table = nullptr;
+        }
+
+        AwaitableMessage expect(int message_id, int timeout_ms = -1, int source_id = -1, int component_id = -1) {
+            auto state = std::make_shared<AwaitableMessage::State>();
+            auto *timeouts = &_timeouts;
+            state->ticket = _dispatcher.table().arm(static_cast<uint32_t>(message_id), source_id, component_id, {},
+                                                    [state, timeouts](const mav::Message &message) {
+                if (!state->finished.exchange(true)) {
+                    if (auto timer = state->timer.load()) {
+                        timeouts->cancel(timer);
+                    }
+                    state->message.emplace(message);
+                    state->complete();
+                }
+            });
+            if (timeout_ms >= 0) {
+                std::weak_ptr<AwaitableMessage::State> weak_state = state;
+                std::weak_ptr<TableScope> weak_scope = _scope;
+                state->timer = _timeouts.schedule(std::chrono::milliseconds(timeout_ms), [weak_state, weak_scope] {
+                    auto state = weak_state.lock();
+                    auto scope = weak_scope.lock();
+                    if (!state || !scope) {
+                        return;
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(scope->mutex);
+                        if (!scope->table || !scope->table->cancel(state->ticket)) {
+                            return;
+                        }
+                    }
+                    if (!state->finished.exchange(true)) {
+                        state->complete();
+                    }
+                });
+                // the message may have arrived before the timer id was stored
+                if (state->finished) {
+                    _timeouts.cancel(state->timer);
+                }
+            }
+            return AwaitableMessage{state};
+        }
+
+        AwaitableMessage expect(const std::string &message_name, int timeout_ms = -1, int source_id = -1,
+                                int component_id = -1) {
+            return expect(_message_set.idForMessage(message_name), timeout_ms, source_id, component_id);
+        }
+
+        /*
+         * Equivalent of connection->receive(name, timeout): waits for the next message of that type.
+         */
+        AwaitableMessage receive(const std::string &message_name, int timeout_ms = -1) {
+            return expect(message_name, timeout_ms);
+        }
+
+        /*
+         * Arms the expectation for the response, sends the request and returns the awaitable for the response.
+         */
+        AwaitableMessage sendAndReceive(mav::Message &request, const std::string &response_name, int timeout_ms = -1,
+                                        int source_id = -1, int component_id = -1) {
+            auto response = expect(response_name, timeout_ms, source_id, component_id);
+            _connection->send(request);
+            return response;
+        }
+
+        void send(mav::Message &message) {
+            _connection->send(message);
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_COROUTINES_H
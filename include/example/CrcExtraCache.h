@@ -0,0 +1,78 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_CRCEXTRACACHE_H
+#define LIBMAV_EXAMPLE_CRCEXTRACACHE_H
+
+#include <cstdint>
+#include <unordered_map>
+
+#include <mav/MessageSet.h>
+
+namespace example {
+
+    /*
+     * CRC_EXTRA per message id, resolved lazily from the message set on first sight of an id.
+     * Only known ids are cached, so noise with random ids cannot grow the cache past the message set.
+     * Not thread-safe, every reader thread keeps its own cache.
+     */
+    class CrcExtraCache {
+    private:
+        const mav::MessageSet &_message_set;
+        std::unordered_map<uint32_t, int> _crc_extra;
+
+    public:
+        explicit CrcExtraCache(const mav::MessageSet &message_set) : _message_set(message_set) {}
+
+        /*
+         * Returns the CRC_EXTRA of the message, or -1 if the message set does not know it.
+         */
+        int get(uint32_t message_id) {
+            auto it = _crc_extra.find(message_id);
+            if (it != _crc_extra.end()) {
+                return it->second;
+            }
+            auto definition = _message_set.getMessageDefinition(static_cast<int>(message_id));
+            if (!definition.has_value()) {
+                return -1;
+            }
+            int crc_extra = definition.get().crcExtra();
+            _crc_extra.emplace(message_id, crc_extra);
+            return crc_extra;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_CRCEXTRACACHE_H
@@ -0,0 +1,520 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_EPOLLTCPSERVER_H
+#define LIBMAV_EXAMPLE_EPOLLTCPSERVER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+#include <example/FrameAssembler.h>
+#include <example/PeerTable.h>
+
+namespace example {
+
+    struct TCPServerConfig {
+        int backlog = 128;
+        // Further connections are accepted and closed right away
+        size_t max_clients = 1024;
+        // Bytes queued for a client that does not keep up. Frames that do not fit are dropped for that
+        // client only, so one slow viewer can not hold up the others or grow without bounds.
+        size_t max_output_bytes = 256 * 1024;
+    };
+
+    struct TCPServerStats {
+        uint64_t accepted = 0;
+        uint64_t rejected = 0;
+        uint64_t disconnected = 0;
+        uint64_t frames_received = 0;
+        uint64_t frames_dropped = 0;
+        uint64_t broadcasts = 0;
+    };
+
+    /*
+     * Drop-in replacement for mav::TCPServer that serves hundreds of clients from the receiving thread,
+     * with one edge-triggered epoll instance for the listening socket and all clients. Input is framed per
+     * client, so the runtime is only ever served whole frames.
+     *
+     * Writes never block: what the socket does not take right away is queued per client and written when
+     * the socket drains. broadcast() writes the same serialized frame to every client, e.g. to fan out a
+     * telemetry stream to many ground stations, instead of finalizing it once per connection.
+     */
+    class EpollTCPServer : public mav::NetworkInterface {
+    private:
+        // Upper bound of reads per client and wakeup, clients with more input are served again before sleeping
+        static constexpr int MAX_READS_PER_WAKEUP = 4;
+        static constexpr int MAX_EVENTS = 64;
+
+        struct Client {
+            int fd;
+            mav::ConnectionPartner partner;
+            // receive side state
+            FrameAssembler assembler;
+            bool ready = false;
+            bool connected = true;
+
+            std::mutex output_mutex;
+            std::vector<uint8_t> output;
+            size_t output_offset = 0;
+
+            Client(int fd_, const mav::ConnectionPartner &partner_) : fd(fd_), partner(partner_) {}
+
+            ~Client() {
+                ::close(fd);
+            }
+        };
+
+        // Immutable snapshot, replaced on connect and disconnect so sends and broadcasts do not lock out accepts
+        struct ClientSet {
+            std::unordered_map<uint64_t, std::shared_ptr<Client>> by_partner;
+            std::vector<std::shared_ptr<Client>> all;
+        };
+
+        struct PendingFrame {
+            mav::ConnectionPartner partner;
+            int length;
+            std::array<uint8_t, MAX_FRAME_SIZE> data;
+        };
+
+        TCPServerConfig _config;
+        int _listen_fd = -1;
+        int _epoll_fd = -1;
+        int _wake_fd = -1;
+        mutable std::atomic_bool _should_terminate{false};
+        CrcExtraCache _crc_extra;
+
+        mutable std::mutex _clients_mutex;
+        std::shared_ptr<const ClientSet> _clients = std::make_shared<ClientSet>();
+
+        // receive side, only touched by the receiving thread
+        std::vector<std::shared_ptr<Client>> _ready;
+        std::array<uint8_t, 16384> _buffer{};
+        std::vector<PendingFrame> _frames;
+        size_t _frame_index = 0;
+        int _frame_offset = 0;
+
+        std::atomic<uint64_t> _accepted{0};
+        std::atomic<uint64_t> _rejected{0};
+        std::atomic<uint64_t> _disconnected{0};
+        std::atomic<uint64_t> _frames_received{0};
+        std::atomic<uint64_t> _frames_dropped{0};
+        std::atomic<uint64_t> _broadcasts{0};
+
+        [[nodiscard]] std::shared_ptr<const ClientSet> _snapshot() const {
+            std::lock_guard<std::mutex> lock(_clients_mutex);
+            return _clients;
+        }
+
+        template <typename Change>
+        void _changeClients(Change change) {
+            std::lock_guard<std::mutex> lock(_clients_mutex);
+            auto next = std::make_shared<ClientSet>(*_clients);
+            change(*next);
+            _clients = std::move(next);
+        }
+
+        void _accept() {
+            while (true) {
+                sockaddr_in address{};
+                socklen_t address_length = sizeof(address);
+                int fd = ::accept4(_listen_fd, reinterpret_cast<sockaddr*>(&address), &address_length,
+                                   SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) {
+                        continue;
+                    }
+                    // EAGAIN ends the burst, anything else (e.g. EMFILE) is retried on the next edge
+                    return;
+                }
+                if (_snapshot()->all.size() >= _config.max_clients) {
+                    ::close(fd);
+                    _rejected.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                auto client = std::make_shared<Client>(
+                        fd, mav::ConnectionPartner{ntohl(address.sin_addr.s_addr), ntohs(address.sin_port), false});
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                event.data.ptr = client.get();
+                _changeClients([&client](ClientSet &clients) {
+                    clients.by_partner[peerKey(client->partner)] = client;
+                    clients.all.push_back(client);
+                });
+                if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                    _disconnect(client.get());
+                    continue;
+                }
+                _accepted.fetch_add(1, std::memory_order_relaxed);
+                // a client may have sent before we registered it
+                client->ready = true;
+                _ready.push_back(client);
+            }
+        }
+
+        void _disconnect(Client *client) {
+            if (!client->connected) {
+                return;
+            }
+            client->connected = false;
+            client->ready = false;
+            ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
+            // the descriptor is closed once the last sender let go of the client
+            ::shutdown(client->fd, SHUT_RDWR);
+            _changeClients([client](ClientSet &clients) {
+                clients.by_partner.erase(peerKey(client->partner));
+                clients.all.erase(std::remove_if(clients.all.begin(), clients.all.end(),
+                    [client](const std::shared_ptr<Client> &candidate) { return candidate.get() == client; }),
+                    clients.all.end());
+            });
+            _disconnected.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Returns false if the client went away. Leaves the client on the ready list if it has more input.
+        bool _read(Client &client) {
+            for (int i = 0; i < MAX_READS_PER_WAKEUP; i++) {
+                auto length = ::recv(client.fd, _buffer.data(), _buffer.size(), 0);
+                if (length == 0) {
+                    return false;
+                }
+                if (length < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    client.ready = false;
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                client.assembler.push(_buffer.data(), static_cast<size_t>(length), &_crc_extra,
+                                      [this, &client](const uint8_t *frame, int frame_length) {
+                    if (_frame_index >= _frames.size()) {
+                        _frames.emplace_back();
+                    }
+                    auto &pending = _frames[_frame_index++];
+                    pending.partner = client.partner;
+                    pending.length = frame_length;
+                    std::memcpy(pending.data.data(), frame, frame_length);
+                });
+            }
+            client.ready = true;
+            return true;
+        }
+
+        // Writes queued output, with the client's output mutex held. Returns false on a broken connection.
+        static bool _flushLocked(Client &client) {
+            while (client.output_offset < client.output.size()) {
+                auto result = ::send(client.fd, client.output.data() + client.output_offset,
+                                     client.output.size() - client.output_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                client.output_offset += static_cast<size_t>(result);
+            }
+            client.output.clear();
+            client.output_offset = 0;
+            return true;
+        }
+
+        // Returns false if the frame was dropped because the client is too far behind.
+        bool _write(Client &client, const uint8_t *data, uint32_t size) {
+            std::lock_guard<std::mutex> lock(client.output_mutex);
+            uint32_t written = 0;
+            if (client.output.empty()) {
+                while (written < size) {
+                    auto result = ::send(client.fd, data + written, size - written, MSG_NOSIGNAL | MSG_DONTWAIT);
+                    if (result < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                            break;
+                        }
+                        // a broken connection is noticed and cleaned up by the receiving thread
+                        return true;
+                    }
+                    written += static_cast<uint32_t>(result);
+                }
+                if (written == size) {
+                    return true;
+                }
+            }
+            // a partly written frame is always queued in full, otherwise the stream would lose framing
+            if (written == 0 && client.output.size() - client.output_offset + size > _config.max_output_bytes) {
+                _frames_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (client.output_offset > client.output.size() / 2) {
+                client.output.erase(client.output.begin(),
+                                    client.output.begin() + static_cast<std::ptrdiff_t>(client.output_offset));
+                client.output_offset = 0;
+            }
+            client.output.insert(client.output.end(), data + written, data + size);
+            return true;
+        }
+
+        // Blocks until at least one frame is pending. Frames are collected at the front of _frames.
+        void _poll() {
+            epoll_event events[MAX_EVENTS];
+            _frame_index = 0;
+            while (_frame_index == 0) {
+                if (_should_terminate) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+                // clients that still have input keep the loop from sleeping
+                int ready = ::epoll_wait(_epoll_fd, events, MAX_EVENTS, _ready.empty() ? -1 : 0);
+                if (ready < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw mav::NetworkError("epoll_wait failed", errno);
+                }
+                auto snapshot = _snapshot();
+                for (int i = 0; i < ready; i++) {
+                    if (events[i].data.ptr == nullptr) {
+                        continue;
+                    }
+                    if (events[i].data.ptr == this) {
+                        _accept();
+                        continue;
+                    }
+                    auto client = static_cast<Client*>(events[i].data.ptr);
+                    auto it = snapshot->by_partner.find(peerKey(client->partner));
+                    if (it == snapshot->by_partner.end() || it->second.get() != client || !client->connected) {
+                        continue;
+                    }
+                    if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                        _disconnect(client);
+                        continue;
+                    }
+                    if (events[i].events & EPOLLOUT) {
+                        std::lock_guard<std::mutex> lock(client->output_mutex);
+                        if (!_flushLocked(*client)) {
+                            _disconnect(client);
+                            continue;
+                        }
+                    }
+                    if ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && !client->ready) {
+                        client->ready = true;
+                        _ready.push_back(it->second);
+                    }
+                }
+                // serve each ready client once per round, in turn
+                size_t kept = 0;
+                for (size_t i = 0; i < _ready.size(); i++) {
+                    auto &client = _ready[i];
+                    if (client->connected && !_read(*client)) {
+                        _disconnect(client.get());
+                    }
+                    if (client->ready) {
+                        _ready[kept++] = client;
+                    }
+                }
+                _ready.resize(kept);
+            }
+            _frames_received.fetch_add(_frame_index, std::memory_order_relaxed);
+            _frames.resize(_frame_index);
+            _frame_index = 0;
+            _frame_offset = 0;
+        }
+
+    public:
+        EpollTCPServer(const mav::MessageSet &message_set, int local_port, const std::string &local_address = "0.0.0.0",
+                       const TCPServerConfig &config = {}) : _config(config), _crc_extra(message_set) {
+            _listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (_listen_fd < 0) {
+                throw mav::NetworkError("Could not create socket", errno);
+            }
+            int one = 1;
+            ::setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(local_port));
+            if (::inet_pton(AF_INET, local_address.c_str(), &address.sin_addr) != 1) {
+                ::close(_listen_fd);
+                throw mav::NetworkError("Invalid address " + local_address, EINVAL);
+            }
+            if (::bind(_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+                    ::listen(_listen_fd, config.backlog) < 0) {
+                int error = errno;
+                ::close(_listen_fd);
+                throw mav::NetworkError("Could not listen on socket", error);
+            }
+            _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+            _wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (_epoll_fd < 0 || _wake_fd < 0) {
+                int error = errno;
+                ::close(_listen_fd);
+                ::close(_epoll_fd);
+                ::close(_wake_fd);
+                throw mav::NetworkError("Could not create epoll instance", error);
+            }
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLET;
+            event.data.ptr = this;
+            ::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _listen_fd, &event);
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;
+            ::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &event);
+        }
+
+        EpollTCPServer(const EpollTCPServer&) = delete;
+        EpollTCPServer& operator=(const EpollTCPServer&) = delete;
+
+        ~EpollTCPServer() override {
+            close();
+            _ready.clear();
+            {
+                std::lock_guard<std::mutex> lock(_clients_mutex);
+                _clients.reset();
+            }
+            ::close(_wake_fd);
+            ::close(_epoll_fd);
+        }
+
+        void close() const override {
+            if (_should_terminate.exchange(true)) {
+                return;
+            }
+            ::shutdown(_listen_fd, SHUT_RDWR);
+            ::close(_listen_fd);
+            uint64_t one = 1;
+            (void)::write(_wake_fd, &one, sizeof(one));
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return !_should_terminate;
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            auto snapshot = _snapshot();
+            auto it = snapshot->by_partner.find(peerKey(partner));
+            if (it == snapshot->by_partner.end()) {
+                throw mav::NetworkError("Client is not connected", ENOTCONN);
+            }
+            _write(*it->second, data, size);
+        }
+
+        /*
+         * Writes an already serialized frame to every connected client, optionally except one (e.g. the one
+         * it came from). Returns the number of clients it was written or queued for.
+         */
+        size_t broadcast(const uint8_t *data, uint32_t size, const mav::ConnectionPartner *except = nullptr) {
+            auto snapshot = _snapshot();
+            size_t delivered = 0;
+            for (const auto &client : snapshot->all) {
+                if (except && client->partner == *except) {
+                    continue;
+                }
+                delivered += _write(*client, data, size) ? 1 : 0;
+            }
+            _broadcasts.fetch_add(1, std::memory_order_relaxed);
+            return delivered;
+        }
+
+        /*
+         * Finalizes the message once, with the given sequence number and sender, and broadcasts it.
+         */
+        size_t broadcast(mav::Message &message, uint8_t sequence, const mav::Identifier &sender) {
+            auto length = message.finalize(sequence, sender);
+            return broadcast(message.data(), length);
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            mav::ConnectionPartner partner;
+            while (copied < size) {
+                while (_frame_index >= _frames.size() || _frame_offset >= _frames[_frame_index].length) {
+                    if (_frame_index + 1 < _frames.size()) {
+                        _frame_index++;
+                        _frame_offset = 0;
+                    } else {
+                        _poll();
+                    }
+                }
+                const auto &frame = _frames[_frame_index];
+                auto chunk = std::min<uint32_t>(size - copied, static_cast<uint32_t>(frame.length - _frame_offset));
+                std::memcpy(destination + copied, frame.data.data() + _frame_offset, chunk);
+                _frame_offset += static_cast<int>(chunk);
+                copied += chunk;
+                partner = frame.partner;
+            }
+            return partner;
+        }
+
+        void markMessageBoundary() override {
+            if (_frame_index < _frames.size()) {
+                _frame_offset = _frames[_frame_index].length;
+            }
+        }
+
+        [[nodiscard]] size_t clientCount() const {
+            return _snapshot()->all.size();
+        }
+
+        [[nodiscard]] TCPServerStats stats() const {
+            return {_accepted.load(std::memory_order_relaxed), _rejected.load(std::memory_order_relaxed),
+                    _disconnected.load(std::memory_order_relaxed), _frames_received.load(std::memory_order_relaxed),
+                    _frames_dropped.load(std::memory_order_relaxed), _broadcasts.load(std::memory_order_relaxed)};
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_EPOLLTCPSERVER_H
@@ -0,0 +1,374 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_EXPECTATIONS_H
+#define LIBMAV_EXAMPLE_EXPECTATIONS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/Frame.h>
+
+namespace example {
+
+    /*
+     * Pending expectations, indexed by message id. Arming, cancelling and dispatching are lock-free:
+     * every message id owns a chain of 64-slot blocks with an occupancy bitmask, so dispatching a message
+     * only looks at the expectations armed for its id, and a user thread arming or cancelling never holds
+     * anything the receive thread has to wait for.
+     * Blocks are only freed with the table, so the memory use follows the peak number of concurrent
+     * expectations per message id.
+     */
+    class ExpectationTable {
+    public:
+        using Predicate = std::function<bool(const mav::Message &message)>;
+        using Completion = std::function<void(const mav::Message &message)>;
+
+    private:
+        /*
+         * The slot state word holds the state in its lower two bits and a generation counter above. The
+         * generation changes on every reuse of a slot, so a stale ticket can never cancel a newer expectation.
+         */
+        enum State : uint32_t {
+            FREE = 0,
+            ARMED = 1,
+            CHECKING = 2,
+        };
+        static constexpr uint32_t STATE_MASK = 3;
+
+        struct Slot {
+            std::atomic<uint32_t> state{FREE};
+            int system_id = -1;
+            int component_id = -1;
+            Predicate predicate;
+            Completion completion;
+        };
+
+        struct Block {
+            std::atomic<uint64_t> occupied{0};
+            std::array<Slot, 64> slots;
+            std::atomic<Block*> next{nullptr};
+        };
+
+        struct Entry {
+            // message id + 1, 0 marks an unused entry
+            std::atomic<uint32_t> key{0};
+            std::atomic<Block*> first{nullptr};
+        };
+
+        std::unique_ptr<Entry[]> _entries;
+        size_t _mask;
+
+        Entry* _find(uint32_t message_id, bool insert) {
+            uint32_t key = message_id + 1;
+            size_t index = (message_id * 0x9E3779B1u) & _mask;
+            for (size_t probe = 0; probe <= _mask; probe++, index = (index + 1) & _mask) {
+                auto &entry = _entries[index];
+                uint32_t current = entry.key.load(std::memory_order_acquire);
+                if (current == key) {
+                    return &entry;
+                }
+                if (current == 0) {
+                    if (!insert) {
+                        return nullptr;
+                    }
+                    if (entry.key.compare_exchange_strong(current, key, std::memory_order_acq_rel) ||
+                        current == key) {
+                        return &entry;
+                    }
+                }
+            }
+            if (insert) {
+                throw std::length_error("ExpectationTable: too many distinct message ids");
+            }
+            return nullptr;
+        }
+
+        static void _release(Block *block, int index, uint32_t generation) {
+            auto &slot = block->slots[index];
+            slot.predicate = nullptr;
+            slot.completion = nullptr;
+            slot.state.store(generation | FREE, std::memory_order_relaxed);
+            block->occupied.fetch_and(~(uint64_t{1} << index), std::memory_order_release);
+        }
+
+    public:
+        /*
+         * Identifies an armed expectation, for cancelling it.
+         */
+        struct Ticket {
+            void *block = nullptr;
+            int index = -1;
+            uint32_t generation = 0;
+        };
+
+        /*
+         * max_message_ids bounds the number of distinct message ids that can be expected over the lifetime
+         * of the table.
+         */
+        explicit ExpectationTable(size_t max_message_ids = 256) {
+            size_t size = 1;
+            while (size < max_message_ids * 2) {
+                size <<= 1;
+            }
+            _entries.reset(new Entry[size]);
+            _mask = size - 1;
+        }
+
+        ExpectationTable(const ExpectationTable&) = delete;
+        ExpectationTable& operator=(const ExpectationTable&) = delete;
+
+        ~ExpectationTable() {
+            for (size_t i = 0; i <= _mask; i++) {
+                Block *block = _entries[i].first.load();
+                while (block) {
+                    Block *next = block->next.load();
+                    delete block;
+                    block = next;
+                }
+            }
+        }
+
+        /*
+         * Arms an expectation. The completion runs on the dispatching thread for the first matching message,
+         * and only once. system_id / component_id of -1 match any sender. The predicate is optional.
+         */
+        Ticket arm(uint32_t message_id, int system_id, int component_id, Predicate predicate, Completion completion) {
+            auto &entry = *_find(message_id, true);
+            std::atomic<Block*> *link = &entry.first;
+            while (true) {
+                Block *block = link->load(std::memory_order_acquire);
+                if (!block) {
+                    auto fresh = std::make_unique<Block>();
+                    if (link->compare_exchange_strong(block, fresh.get(), std::memory_order_acq_rel)) {
+                        block = fresh.release();
+                    }
+                }
+                uint64_t occupied = block->occupied.load(std::memory_order_relaxed);
+                while (~occupied != 0) {
+                    int index = __builtin_ctzll(~occupied);
+                    if (block->occupied.compare_exchange_weak(occupied, occupied | (uint64_t{1} << index),
+                                                              std::memory_order_acquire)) {
+                        auto &slot = block->slots[index];
+                        uint32_t generation = (slot.state.load(std::memory_order_relaxed) & ~STATE_MASK) +
+                            (STATE_MASK + 1);
+                        slot.system_id = system_id;
+                        slot.component_id = component_id;
+                        slot.predicate = std::move(predicate);
+                        slot.completion = std::move(completion);
+                        slot.state.store(generation | ARMED, std::memory_order_release);
+                        return {block, index, generation};
+                    }
+                }
+                link = &block->next;
+            }
+        }
+
+        /*
+         * Cancels an expectation. Returns false if it already fired (or is firing right now), in which case
+         * the completion runs or has run.
+         */
+        bool cancel(const Ticket &ticket) {
+            auto block = static_cast<Block*>(ticket.block);
+            auto &slot = block->slots[ticket.index];
+            while (true) {
+                uint32_t expected = ticket.generation | ARMED;
+                if (slot.state.compare_exchange_strong(expected, ticket.generation | FREE, std::memory_order_acquire)) {
+                    _release(block, ticket.index, ticket.generation);
+                    return true;
+                }
+                if (expected != (ticket.generation | CHECKING)) {
+                    return false;
+                }
+                // the receive thread is evaluating the predicate, this takes only a moment
+                std::this_thread::yield();
+            }
+        }
+
+        /*
+         * Fires all armed expectations matching the message. Called from the receive thread. All matches are
+         * claimed before the first completion runs, so an expectation armed from a completion (or from a
+         * coroutine resumed by one) is not fired by the message that is being dispatched.
+         */
+        void dispatch(const mav::Message &message) {
+            auto entry = _find(static_cast<uint32_t>(message.id()), false);
+            if (!entry) {
+                return;
+            }
+            FrameHeader header{message.data()};
+            int system_id = header.systemId();
+            int component_id = header.componentId();
+            // usually there is a single match, which needs no allocation
+            Completion first;
+            std::vector<Completion> more;
+            bool matched = false;
+            for (Block *block = entry->first.load(std::memory_order_acquire); block;
+                    block = block->next.load(std::memory_order_acquire)) {
+                uint64_t occupied = block->occupied.load(std::memory_order_acquire);
+                while (occupied != 0) {
+                    int index = __builtin_ctzll(occupied);
+                    occupied &= occupied - 1;
+                    auto &slot = block->slots[index];
+                    uint32_t state = slot.state.load(std::memory_order_relaxed);
+                    uint32_t generation = state & ~STATE_MASK;
+                    if ((state & STATE_MASK) != ARMED ||
+                        !slot.state.compare_exchange_strong(state, generation | CHECKING, std::memory_order_acquire)) {
+                        continue;
+                    }
+                    bool matches = (slot.system_id < 0 || slot.system_id == system_id) &&
+                        (slot.component_id < 0 || slot.component_id == component_id) &&
+                        (!slot.predicate || slot.predicate(message));
+                    if (!matches) {
+                        slot.state.store(generation | ARMED, std::memory_order_release);
+                        continue;
+                    }
+                    auto completion = std::move(slot.completion);
+                    _release(block, index, generation);
+                    if (!matched) {
+                        first = std::move(completion);
+                        matched = true;
+                    } else {
+                        more.push_back(std::move(completion));
+                    }
+                }
+            }
+            if (matched) {
+                first(message);
+                for (auto &completion : more) {
+                    completion(message);
+                }
+            }
+        }
+    };
+
+    /*
+     * Counterpart to mav::Expectation, for expectations armed through an ExpectationDispatcher.
+     */
+    class PendingMessage {
+        friend class ExpectationDispatcher;
+    private:
+        ExpectationTable::Ticket _ticket;
+        std::future<mav::Message> _future;
+
+    public:
+        PendingMessage(ExpectationTable::Ticket ticket, std::future<mav::Message> future) :
+            _ticket(ticket), _future(std::move(future)) {}
+    };
+
+    /*
+     * Drop-in for the connection->expect(...) / connection->receive(expectation, timeout) pattern that
+     * scales to many concurrent transactions. A single callback on the connection feeds every received
+     * message into an ExpectationTable, instead of checking each one against every pending expectation.
+     */
+    class ExpectationDispatcher {
+    private:
+        const mav::MessageSet &_message_set;
+        std::shared_ptr<mav::Connection> _connection;
+        ExpectationTable _table;
+        mav::CallbackHandle _callback_handle;
+
+    public:
+        ExpectationDispatcher(const mav::MessageSet &message_set, std::shared_ptr<mav::Connection> connection,
+                              size_t max_message_ids = 256) :
+                _message_set(message_set), _connection(std::move(connection)), _table(max_message_ids) {
+            _callback_handle = _connection->addMessageCallback([this](const mav::Message &message) {
+                _table.dispatch(message);
+            });
+        }
+
+        ExpectationDispatcher(const ExpectationDispatcher&) = delete;
+        ExpectationDispatcher& operator=(const ExpectationDispatcher&) = delete;
+
+        ~ExpectationDispatcher() {
+            _connection->removeMessageCallback(_callback_handle);
+        }
+
+        PendingMessage expect(int message_id, int source_id = -1, int component_id = -1,
+                              ExpectationTable::Predicate predicate = {}) {
+            auto promise = std::make_shared<std::promise<mav::Message>>();
+            auto future = promise->get_future();
+            auto ticket = _table.arm(static_cast<uint32_t>(message_id), source_id, component_id, std::move(predicate),
+                                     [promise](const mav::Message &message) {
+                promise->set_value(message);
+            });
+            return {ticket, std::move(future)};
+        }
+
+        PendingMessage expect(const std::string &message_name, int source_id = -1, int component_id = -1,
+                              ExpectationTable::Predicate predicate = {}) {
+            return expect(_message_set.idForMessage(message_name), source_id, component_id, std::move(predicate));
+        }
+
+        /*
+         * Waits for the expected message. A negative timeout waits forever. On timeout, the expectation is
+         * cancelled and mav::TimeoutException is thrown.
+         */
+        mav::Message receive(PendingMessage &pending, int timeout_ms = -1) {
+            if (timeout_ms >= 0 &&
+                pending._future.wait_for(std::chrono::milliseconds(timeout_ms)) != std::future_status::ready &&
+                _table.cancel(pending._ticket)) {
+                throw mav::TimeoutException("Expected message timed out");
+            }
+            return pending._future.get();
+        }
+
+        /*
+         * Drops an expectation that is no longer needed, without waiting for it.
+         */
+        void cancel(PendingMessage &pending) {
+            _table.cancel(pending._ticket);
+        }
+
+        ExpectationTable& table() {
+            return _table;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_EXPECTATIONS_H
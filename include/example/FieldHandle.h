@@ -0,0 +1,270 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_FIELDHANDLE_H
+#define LIBMAV_EXAMPLE_FIELDHANDLE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+
+#include <example/Fields.h>
+
+namespace example {
+
+    /*
+     * A field of a message definition, resolved once. Accessing a message through a handle skips the
+     * name lookup that Message::operator[] and Message::set(name, ...) perform on every call, while the
+     * type conversion rules stay the same as for the name based API.
+     * Handles stay valid as long as the message set they were resolved from is not modified.
+     */
+    struct FieldHandle {
+        int message_id = -1;
+        int offset = 0;
+        mav::FieldType::BaseType type = mav::FieldType::BaseType::UINT8;
+        int array_length = 1;
+    };
+
+    inline FieldHandle field(const mav::MessageDefinition &definition, const std::string &field_name) {
+        if (!definition.containsField(field_name)) {
+            throw std::out_of_range("Field " + field_name + " does not exist in message " + definition.name());
+        }
+        auto resolved = definition.fieldForName(field_name);
+        return {definition.id(), resolved.offset, resolved.type.base_type, resolved.type.size};
+    }
+
+    inline FieldHandle field(const mav::MessageSet &message_set, const std::string &message_name,
+                             const std::string &field_name) {
+        auto definition = message_set.getMessageDefinition(message_name);
+        if (!definition.has_value()) {
+            throw std::out_of_range("Message " + message_name + " does not exist in message set");
+        }
+        return field(definition.get(), field_name);
+    }
+
+    namespace detail {
+        inline int baseSize(mav::FieldType::BaseType type) {
+            using B = mav::FieldType::BaseType;
+            switch (type) {
+                case B::CHAR: case B::UINT8: case B::INT8: return 1;
+                case B::UINT16: case B::INT16: return 2;
+                case B::UINT32: case B::INT32: case B::FLOAT: return 4;
+                case B::UINT64: case B::INT64: case B::DOUBLE: return 8;
+            }
+            return 1;
+        }
+
+        template <typename S>
+        inline S load(const uint8_t *source) {
+            S value;
+            std::memcpy(&value, source, sizeof(S));
+            return value;
+        }
+
+        template <typename S>
+        inline void store(uint8_t *destination, S value) {
+            std::memcpy(destination, &value, sizeof(S));
+        }
+
+        template <typename T>
+        inline T readAs(const uint8_t *source, mav::FieldType::BaseType type) {
+            using B = mav::FieldType::BaseType;
+            switch (type) {
+                case B::CHAR: return static_cast<T>(load<char>(source));
+                case B::UINT8: return static_cast<T>(load<uint8_t>(source));
+                case B::INT8: return static_cast<T>(load<int8_t>(source));
+                case B::UINT16: return static_cast<T>(load<uint16_t>(source));
+                case B::INT16: return static_cast<T>(load<int16_t>(source));
+                case B::UINT32: return static_cast<T>(load<uint32_t>(source));
+                case B::INT32: return static_cast<T>(load<int32_t>(source));
+                case B::UINT64: return static_cast<T>(load<uint64_t>(source));
+                case B::INT64: return static_cast<T>(load<int64_t>(source));
+                case B::FLOAT: return static_cast<T>(load<float>(source));
+                case B::DOUBLE: return static_cast<T>(load<double>(source));
+            }
+            return T{};
+        }
+
+        template <typename V>
+        inline void writeAs(uint8_t *destination, mav::FieldType::BaseType type, V value) {
+            using B = mav::FieldType::BaseType;
+            switch (type) {
+                case B::CHAR: store(destination, static_cast<char>(value)); return;
+                case B::UINT8: store(destination, static_cast<uint8_t>(value)); return;
+                case B::INT8: store(destination, static_cast<int8_t>(value)); return;
+                case B::UINT16: store(destination, static_cast<uint16_t>(value)); return;
+                case B::INT16: store(destination, static_cast<int16_t>(value)); return;
+                case B::UINT32: store(destination, static_cast<uint32_t>(value)); return;
+                case B::INT32: store(destination, static_cast<int32_t>(value)); return;
+                case B::UINT64: store(destination, static_cast<uint64_t>(value)); return;
+                case B::INT64: store(destination, static_cast<int64_t>(value)); return;
+                case B::FLOAT: store(destination, static_cast<float>(value)); return;
+                case B::DOUBLE: store(destination, static_cast<double>(value)); return;
+            }
+        }
+    }
+
+    template <typename T>
+    inline T get(const mav::Message &message, const FieldHandle &handle, int array_index = 0) {
+        static_assert(std::is_arithmetic_v<T>, "Use getString() for char array fields");
+        assert(message.id() == handle.message_id);
+        assert(array_index >= 0 && array_index < handle.array_length);
+        uint8_t raw[8];
+        int size = detail::baseSize(handle.type);
+        detail::readPayload(message, raw, handle.offset + array_index * size, size);
+        return detail::readAs<T>(raw, handle.type);
+    }
+
+    inline std::string_view getString(const mav::Message &message, const FieldHandle &handle) {
+        assert(message.id() == handle.message_id);
+        assert(handle.type == mav::FieldType::BaseType::CHAR);
+        return detail::stringAt(message, handle.offset, handle.array_length);
+    }
+
+    /*
+     * Like the descriptor based setters in Fields.h, these are meant for messages that are not finalized yet.
+     */
+    template <typename V>
+    inline mav::Message& set(mav::Message &message, const FieldHandle &handle, V value, int array_index = 0) {
+        static_assert(std::is_arithmetic_v<V>, "Use setString() for char array fields");
+        assert(message.id() == handle.message_id);
+        assert(array_index >= 0 && array_index < handle.array_length);
+        int size = detail::baseSize(handle.type);
+        detail::writeAs(detail::writableAt(message, handle.offset + array_index * size, size), handle.type, value);
+        return message;
+    }
+
+    inline mav::Message& setString(mav::Message &message, const FieldHandle &handle, std::string_view value) {
+        assert(message.id() == handle.message_id);
+        assert(handle.type == mav::FieldType::BaseType::CHAR);
+        auto destination = detail::writableAt(message, handle.offset, handle.array_length);
+        auto length = std::min(value.size(), static_cast<size_t>(handle.array_length));
+        std::memcpy(destination, value.data(), length);
+        std::memset(destination + length, 0, handle.array_length - length);
+        return message;
+    }
+
+    /*
+     * Value for the initializer list set() below. Integers keep their signedness so 64 bit values
+     * are written without a round trip through double.
+     */
+    class FieldValue {
+    private:
+        std::variant<int64_t, uint64_t, double, std::string_view> _value;
+
+    public:
+        template <typename T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+        FieldValue(T value) {   // NOLINT(google-explicit-constructor)
+            if constexpr (std::is_floating_point_v<T>) {
+                _value = static_cast<double>(value);
+            } else if constexpr (std::is_signed_v<T>) {
+                _value = static_cast<int64_t>(value);
+            } else {
+                _value = static_cast<uint64_t>(value);
+            }
+        }
+
+        FieldValue(const char *value) : _value(std::string_view{value}) {}     // NOLINT(google-explicit-constructor)
+        FieldValue(std::string_view value) : _value(value) {}                  // NOLINT(google-explicit-constructor)
+
+        void writeTo(mav::Message &message, const FieldHandle &handle) const {
+            std::visit([&](auto value) {
+                if constexpr (std::is_same_v<decltype(value), std::string_view>) {
+                    setString(message, handle, value);
+                } else {
+                    set(message, handle, value);
+                }
+            }, _value);
+        }
+    };
+
+    /*
+     * Handle based counterpart to Message::set({{"name", value}, ...}).
+     */
+    inline mav::Message& set(mav::Message &message, std::initializer_list<std::pair<FieldHandle, FieldValue>> values) {
+        for (const auto &[handle, value] : values) {
+            value.writeTo(message, handle);
+        }
+        return message;
+    }
+
+    /*
+     * Proxy returned by at(), mirroring what Message::operator[] returns for the name based API.
+     */
+    class FieldAccessor {
+    private:
+        mav::Message &_message;
+        FieldHandle _handle;
+
+    public:
+        FieldAccessor(mav::Message &message, const FieldHandle &handle) : _message(message), _handle(handle) {}
+
+        template <typename T, std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+        operator T() const {    // NOLINT(google-explicit-constructor)
+            return get<T>(_message, _handle);
+        }
+
+        operator std::string() const {   // NOLINT(google-explicit-constructor)
+            return std::string{getString(_message, _handle)};
+        }
+
+        template <typename T>
+        T as() const {
+            return get<T>(_message, _handle);
+        }
+
+        FieldAccessor& operator=(const FieldValue &value) {
+            value.writeTo(_message, _handle);
+            return *this;
+        }
+    };
+
+    inline FieldAccessor at(mav::Message &message, const FieldHandle &handle) {
+        return {message, handle};
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_FIELDHANDLE_H
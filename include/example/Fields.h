@@ -0,0 +1,303 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+#ifndef LIBMAV_EXAMPLE_FIELDS_H
+#define LIBMAV_EXAMPLE_FIELDS_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+
+namespace example {
+
+    /*
+     * libmav keeps the 10 byte MAVLink v2 header in front of the payload in a message's backing memory,
+     * so payload offset 0 is at Message::data() + PAYLOAD_OFFSET.
+     */
+    constexpr int PAYLOAD_OFFSET = 10;
+
+    constexpr uint8_t MAGIC_V1 = 0xFE;
+    constexpr uint8_t MAGIC_V2 = 0xFD;
+    constexpr int HEADER_SIZE_V1 = 6;
+    constexpr int HEADER_SIZE_V2 = 10;
+    constexpr int CHECKSUM_SIZE = 2;
+    constexpr int SIGNATURE_SIZE = 13;
+    constexpr int MAX_PAYLOAD_SIZE = 255;
+    constexpr int MAX_FRAME_SIZE = HEADER_SIZE_V2 + MAX_PAYLOAD_SIZE + CHECKSUM_SIZE + SIGNATURE_SIZE;
+    constexpr uint8_t INCOMPAT_FLAG_SIGNED = 0x01;
+
+    /*
+     * Compile time descriptor of a scalar field. Instances are generated from the message definition XML
+     * by tools/generate_fields.py, see <example/MessageFields.h>. The offset is relative to the payload
+     * start and already in MAVLink wire order.
+     */
+    template <typename T>
+    struct Field {
+        uint32_t message_id;
+        int offset;
+        const char* name;
+    };
+
+    /*
+     * Compile time descriptor of an array field (including char[N] string fields).
+     */
+    template <typename T, int N>
+    struct ArrayField {
+        uint32_t message_id;
+        int offset;
+        const char* name;
+    };
+
+    /*
+     * Summary of a generated message, used to check the generated descriptors against a loaded MessageSet.
+     */
+    struct MessageInfo {
+        uint32_t id;
+        uint8_t crc_extra;
+        int max_payload_size;
+        const char* name;
+    };
+
+    /*
+     * Non-owning view on an array field in wire order. Elements are not necessarily aligned, so they are
+     * read by value rather than handed out by reference. Elements past the available bytes read as zero,
+     * which makes the same view work on truncated MAVLink v2 payloads, of messages and raw frames alike.
+     * The view is only valid as long as the message or frame it points into is.
+     */
+    template <typename T>
+    class ArrayView {
+    private:
+        const uint8_t *_data = nullptr;
+        int _size = 0;
+        int _available = 0;
+
+    public:
+        ArrayView() = default;
+        ArrayView(const uint8_t *data, int size, int available_bytes) :
+            _data(data), _size(size), _available(available_bytes) {}
+
+        [[nodiscard]] int size() const {
+            return _size;
+        }
+
+        T operator[](int index) const {
+            assert(index >= 0 && index < _size);
+            T value{};
+            int offset = index * static_cast<int>(sizeof(T));
+            if (offset + static_cast<int>(sizeof(T)) <= _available) {
+                std::memcpy(&value, _data + offset, sizeof(T));
+            } else if (offset < _available) {
+                std::memcpy(&value, _data + offset, _available - offset);
+            }
+            return value;
+        }
+
+        /*
+         * Copies the elements into destination, which must hold size() elements.
+         */
+        void copyTo(T *destination) const {
+            int bytes = _size * static_cast<int>(sizeof(T));
+            int available = std::min(_available, bytes);
+            std::memcpy(destination, _data, available);
+            std::memset(reinterpret_cast<uint8_t*>(destination) + available, 0, bytes - available);
+        }
+    };
+
+    namespace detail {
+        inline const uint8_t* payload(const mav::Message &message) {
+            return message.data() + PAYLOAD_OFFSET;
+        }
+
+        inline uint8_t* payload(mav::Message &message) {
+            // libmav only exposes its backing memory as const. The message itself is not const here,
+            // so writing through the pointer is well-defined.
+            return const_cast<uint8_t*>(message.data()) + PAYLOAD_OFFSET;
+        }
+
+        /*
+         * Received and finalized messages carry their MAVLink v2 header in front of the payload. The payload
+         * is truncated to its last non-zero byte there, and what follows it in memory is checksum and signature,
+         * not zeros. Messages that were only created have their full payload in memory. The header alone can
+         * not tell the two apart: a finalized message changed through libmav keeps its old header, while libmav
+         * has already dropped the checksum and restored the full payload. So libmav's own state decides.
+         */
+        inline int payloadLength(const mav::Message &message) {
+            auto header = message.data();
+            return message.isFinalized() && header[0] == MAGIC_V2 ? header[1] : MAX_PAYLOAD_SIZE;
+        }
+
+        // Bytes of a field of size bytes at payload offset that are actually part of the payload
+        inline int availableAt(const mav::Message &message, int offset, int size) {
+            int available = payloadLength(message) - offset;
+            return available < 0 ? 0 : (available > size ? size : available);
+        }
+
+        /*
+         * All reads from a message go through here. Copies size bytes starting at payload offset into
+         * destination, zero-extending past the payload length, like FrameView::readPayload().
+         */
+        inline void readPayload(const mav::Message &message, void *destination, int offset, int size) {
+            int available = availableAt(message, offset, size);
+            std::memcpy(destination, payload(message) + offset, available);
+            std::memset(static_cast<uint8_t*>(destination) + available, 0, size - available);
+        }
+
+        /*
+         * A char array field up to its first null, or up to where the payload was truncated, as the truncated
+         * bytes are all zero. The view points into the message.
+         */
+        inline std::string_view stringAt(const mav::Message &message, int offset, int size) {
+            auto available = static_cast<size_t>(availableAt(message, offset, size));
+            if (available == 0) {
+                return {};
+            }
+            auto begin = reinterpret_cast<const char*>(payload(message) + offset);
+            auto end = static_cast<const char*>(std::memchr(begin, '\0', available));
+            return {begin, end ? static_cast<size_t>(end - begin) : available};
+        }
+
+        /*
+         * Writes into a finalized message would either land in its checksum and signature bytes, which libmav
+         * zeroes on its next write, or change the payload without libmav knowing the checksum is stale.
+         */
+        inline uint8_t* writableAt(mav::Message &message, int offset, int size) {
+            if (message.isFinalized()) {
+                throw std::logic_error("Typed setters need a message that is not finalized");
+            }
+            assert(offset + size <= MAX_PAYLOAD_SIZE);
+            (void)size;
+            return payload(message) + offset;
+        }
+    }
+
+    template <typename T>
+    inline T get(const mav::Message &message, const Field<T> &field) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        T value;
+        detail::readPayload(message, &value, field.offset, sizeof(T));
+        return value;
+    }
+
+    template <typename T, int N>
+    inline std::array<T, N> get(const mav::Message &message, const ArrayField<T, N> &field) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        std::array<T, N> value;
+        detail::readPayload(message, value.data(), field.offset, sizeof(T) * N);
+        return value;
+    }
+
+    template <typename T, int N>
+    inline T get(const mav::Message &message, const ArrayField<T, N> &field, int index) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        assert(index >= 0 && index < N);
+        T value;
+        detail::readPayload(message, &value, field.offset + index * static_cast<int>(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    /*
+     * Char array fields are not necessarily null-terminated when they use up the full length, and end early
+     * where a received payload was truncated.
+     * The returned view points into the message and is only valid as long as the message is.
+     */
+    template <int N>
+    inline std::string_view getString(const mav::Message &message, const ArrayField<char, N> &field) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        return detail::stringAt(message, field.offset, N);
+    }
+
+    template <typename T, int N>
+    inline ArrayView<T> view(const mav::Message &message, const ArrayField<T, N> &field) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        return {detail::payload(message) + field.offset, N,
+                detail::availableAt(message, field.offset, N * static_cast<int>(sizeof(T)))};
+    }
+
+    /*
+     * The setters write straight into the payload and only work on messages that were created but not yet
+     * finalized. They throw std::logic_error on finalized or received messages, in every build; use the name
+     * based Message::set() there, which unfinalizes the message first.
+     */
+    template <typename T, typename V>
+    inline mav::Message& set(mav::Message &message, const Field<T> &field, V value) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        auto converted = static_cast<T>(value);
+        std::memcpy(detail::writableAt(message, field.offset, sizeof(T)), &converted, sizeof(T));
+        return message;
+    }
+
+    template <typename T, int N, typename V>
+    inline mav::Message& set(mav::Message &message, const ArrayField<T, N> &field, int index, V value) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        assert(index >= 0 && index < N);
+        auto converted = static_cast<T>(value);
+        int offset = field.offset + index * static_cast<int>(sizeof(T));
+        std::memcpy(detail::writableAt(message, offset, sizeof(T)), &converted, sizeof(T));
+        return message;
+    }
+
+    template <int N>
+    inline mav::Message& setString(mav::Message &message, const ArrayField<char, N> &field, std::string_view value) {
+        assert(message.id() == static_cast<int>(field.message_id));
+        auto destination = detail::writableAt(message, field.offset, N);
+        auto length = std::min(value.size(), static_cast<size_t>(N));
+        std::memcpy(destination, value.data(), length);
+        std::memset(destination + length, 0, N - length);
+        return message;
+    }
+
+    /*
+     * Checks that the descriptors were generated from the same definitions the message set was loaded from.
+     * A mismatch in CRC_EXTRA means the field layout differs, and the fixed offsets must not be used.
+     */
+    template <size_t N>
+    inline bool matches(const mav::MessageSet &message_set, const MessageInfo (&messages)[N]) {
+        for (const auto &info : messages) {
+            auto definition = message_set.getMessageDefinition(static_cast<int>(info.id));
+            if (!definition.has_value() || definition.get().crcExtra() != info.crc_extra) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_FIELDS_H
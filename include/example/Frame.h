@@ -0,0 +1,243 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_FRAME_H
+#define LIBMAV_EXAMPLE_FRAME_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <mav/Message.h>
+
+#include <example/Crc.h>
+#include <example/FieldHandle.h>
+#include <example/Fields.h>
+
+namespace example {
+
+    /*
+     * Accessors for the header of a raw MAVLink v1 or v2 frame. The data must start with the magic byte
+     * and contain at least the full header.
+     */
+    class FrameHeader {
+    private:
+        const uint8_t *_data;
+
+    public:
+        explicit FrameHeader(const uint8_t *data) : _data(data) {}
+
+        static bool isMagic(uint8_t byte) {
+            return byte == MAGIC_V2 || byte == MAGIC_V1;
+        }
+
+        static int headerSize(uint8_t magic) {
+            return magic == MAGIC_V2 ? HEADER_SIZE_V2 : HEADER_SIZE_V1;
+        }
+
+        [[nodiscard]] bool isV2() const { return _data[0] == MAGIC_V2; }
+        [[nodiscard]] int headerSize() const { return headerSize(_data[0]); }
+        [[nodiscard]] int payloadLength() const { return _data[1]; }
+        [[nodiscard]] uint8_t incompatFlags() const { return isV2() ? _data[2] : 0; }
+        [[nodiscard]] uint8_t compatFlags() const { return isV2() ? _data[3] : 0; }
+        [[nodiscard]] bool isSigned() const { return (incompatFlags() & INCOMPAT_FLAG_SIGNED) != 0; }
+        [[nodiscard]] uint8_t sequence() const { return isV2() ? _data[4] : _data[2]; }
+        [[nodiscard]] uint8_t systemId() const { return isV2() ? _data[5] : _data[3]; }
+        [[nodiscard]] uint8_t componentId() const { return isV2() ? _data[6] : _data[4]; }
+
+        [[nodiscard]] uint32_t messageId() const {
+            if (!isV2()) {
+                return _data[5];
+            }
+            return static_cast<uint32_t>(_data[7]) | (static_cast<uint32_t>(_data[8]) << 8) |
+                (static_cast<uint32_t>(_data[9]) << 16);
+        }
+
+        // Length of the part covered by the checksum, excluding the magic byte
+        [[nodiscard]] int checksummedLength() const {
+            return headerSize() - 1 + payloadLength();
+        }
+
+        [[nodiscard]] int frameLength() const {
+            return headerSize() + payloadLength() + CHECKSUM_SIZE + (isSigned() ? SIGNATURE_SIZE : 0);
+        }
+    };
+
+    /*
+     * Returns the offset of the first magic byte in data, or length if there is none. Both scans go through
+     * memchr(), which the C library vectorizes, so noise between frames is skipped many bytes at a time.
+     */
+    inline size_t findMagic(const uint8_t *data, size_t length) {
+        if (length == 0) {
+            return 0;
+        }
+        auto v2 = static_cast<const uint8_t*>(std::memchr(data, MAGIC_V2, length));
+        size_t v2_offset = v2 ? static_cast<size_t>(v2 - data) : length;
+        // a v1 frame only matters if it comes first
+        auto v1 = static_cast<const uint8_t*>(std::memchr(data, MAGIC_V1, v2_offset));
+        return v1 ? static_cast<size_t>(v1 - data) : v2_offset;
+    }
+
+    /*
+     * Computes the checksum of a complete frame, given the CRC_EXTRA of its message.
+     */
+    inline uint16_t frameChecksum(const uint8_t *frame, uint8_t crc_extra) {
+        FrameHeader header{frame};
+        Crc crc;
+        crc.accumulate(frame + 1, header.checksummedLength());
+        crc.accumulate(crc_extra);
+        return crc.value();
+    }
+
+    inline bool checkFrame(const uint8_t *frame, uint8_t crc_extra) {
+        FrameHeader header{frame};
+        const uint8_t *checksum = frame + header.headerSize() + header.payloadLength();
+        uint16_t expected = static_cast<uint16_t>(checksum[0] | (checksum[1] << 8));
+        return frameChecksum(frame, crc_extra) == expected;
+    }
+
+    /*
+     * Non-owning, read-only view on a raw frame. Field reads decode directly from the wire bytes.
+     * MAVLink v2 truncates trailing zero bytes of the payload, so reads past the received payload
+     * length are zero-extended. Nothing is decoded or copied up front: a frame that is only checked
+     * for its message id costs nothing more, and string and array fields are viewed in place.
+     */
+    class FrameView {
+    private:
+        const uint8_t *_data = nullptr;
+        int _length = 0;
+
+        // Received bytes of a field of size bytes at payload offset
+        [[nodiscard]] int _availableAt(int offset, int size) const {
+            int available = payloadLength() - offset;
+            return available < 0 ? 0 : (available > size ? size : available);
+        }
+
+        [[nodiscard]] std::string_view _stringAt(int offset, int size) const {
+            auto available = static_cast<size_t>(_availableAt(offset, size));
+            if (available == 0) {
+                return {};
+            }
+            auto begin = reinterpret_cast<const char*>(payload() + offset);
+            auto end = static_cast<const char*>(std::memchr(begin, '\0', available));
+            return {begin, end ? static_cast<size_t>(end - begin) : available};
+        }
+
+    public:
+        FrameView() = default;
+        FrameView(const uint8_t *data, int length) : _data(data), _length(length) {}
+
+        [[nodiscard]] const uint8_t* data() const { return _data; }
+        [[nodiscard]] int length() const { return _length; }
+        [[nodiscard]] FrameHeader header() const { return FrameHeader{_data}; }
+        [[nodiscard]] uint32_t messageId() const { return header().messageId(); }
+        [[nodiscard]] const uint8_t* payload() const { return _data + header().headerSize(); }
+        [[nodiscard]] int payloadLength() const { return header().payloadLength(); }
+
+        /*
+         * Copies size bytes starting at payload offset into destination, zero-extending past the
+         * received payload.
+         */
+        void readPayload(void *destination, int offset, int size) const {
+            int available = _availableAt(offset, size);
+            std::memcpy(destination, payload() + offset, available);
+            std::memset(static_cast<uint8_t*>(destination) + available, 0, size - available);
+        }
+
+        template <typename T>
+        T get(const Field<T> &field) const {
+            assert(messageId() == field.message_id);
+            T value;
+            readPayload(&value, field.offset, sizeof(T));
+            return value;
+        }
+
+        template <typename T, int N>
+        T get(const ArrayField<T, N> &field, int index) const {
+            assert(messageId() == field.message_id);
+            assert(index >= 0 && index < N);
+            T value;
+            readPayload(&value, field.offset + index * static_cast<int>(sizeof(T)), sizeof(T));
+            return value;
+        }
+
+        /*
+         * The string ends at the first null, or where the payload was truncated, as the truncated bytes are
+         * all zero. The view points into the frame.
+         */
+        template <int N>
+        std::string_view getString(const ArrayField<char, N> &field) const {
+            assert(messageId() == field.message_id);
+            return _stringAt(field.offset, N);
+        }
+
+        std::string_view getString(const FieldHandle &handle) const {
+            assert(static_cast<int>(messageId()) == handle.message_id);
+            assert(handle.type == mav::FieldType::BaseType::CHAR);
+            return _stringAt(handle.offset, handle.array_length);
+        }
+
+        template <typename T, int N>
+        ArrayView<T> view(const ArrayField<T, N> &field) const {
+            assert(messageId() == field.message_id);
+            return {payload() + field.offset, N, _availableAt(field.offset, N * static_cast<int>(sizeof(T)))};
+        }
+
+        template <typename T>
+        T get(const FieldHandle &handle, int array_index = 0) const {
+            static_assert(std::is_arithmetic_v<T>, "Use getString() for char array fields");
+            assert(static_cast<int>(messageId()) == handle.message_id);
+            assert(array_index >= 0 && array_index < handle.array_length);
+            uint8_t raw[8];
+            int size = detail::baseSize(handle.type);
+            readPayload(raw, handle.offset + array_index * size, size);
+            return detail::readAs<T>(raw, handle.type);
+        }
+    };
+
+    /*
+     * Copies a frame into a libmav message, for handing it to code that works with the dynamic API.
+     */
+    inline mav::Message toMessage(const mav::MessageSet &message_set, const FrameView &frame) {
+        auto message = message_set.create(static_cast<int>(frame.messageId()));
+        auto max_payload_size = message.type().maxPayloadSize();
+        frame.readPayload(detail::payload(message), 0, max_payload_size);
+        return message;
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_FRAME_H
@@ -0,0 +1,199 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_FRAMEASSEMBLER_H
+#define LIBMAV_EXAMPLE_FRAMEASSEMBLER_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+#include <example/FrameReader.h>
+
+namespace example {
+
+    /*
+     * Incremental framer for byte streams that arrive in arbitrary chunks, e.g. from non-blocking reads.
+     * Bytes are pushed in as they come, complete frames are handed to a callback. With a CrcExtraCache,
+     * frames are checksum-verified, and after a bad frame the assembler resynchronizes on the next magic
+     * byte after the false start rather than skipping the whole presumed frame. Frames of messages the
+     * cache does not know are treated as bad, unless kept with setKeepUnknown().
+     */
+    class FrameAssembler {
+    public:
+        struct Stats {
+            uint64_t frames = 0;
+            uint64_t skipped_bytes = 0;
+            uint64_t bad_frames = 0;
+            uint64_t unknown_frames = 0;
+        };
+
+    private:
+        std::array<uint8_t, MAX_FRAME_SIZE> _buffer{};
+        int _size = 0;
+        bool _keep_unknown = false;
+        Stats _stats;
+
+        template <typename F>
+        void _process(const uint8_t *data, size_t length, CrcExtraCache *crc_extra, F &on_frame) {
+            // after a bad frame, its bytes after the magic are scanned again before the rest of data
+            std::array<uint8_t, MAX_FRAME_SIZE> replay;
+            size_t replay_offset = 0;
+            size_t replay_size = 0;
+
+            while (true) {
+                bool replaying = replay_offset < replay_size;
+                const uint8_t *input = replaying ? replay.data() + replay_offset : data;
+                size_t available = replaying ? replay_size - replay_offset : length;
+                if (available == 0) {
+                    return;
+                }
+                size_t consumed = 0;
+                if (_size == 0) {
+                    consumed = findMagic(input, available);
+                    _stats.skipped_bytes += consumed;
+                }
+                if (consumed < available) {
+                    int header_size = FrameHeader::headerSize(_size == 0 ? input[consumed] : _buffer[0]);
+                    int target = _size < header_size ? header_size : FrameHeader{_buffer.data()}.frameLength();
+                    auto chunk = std::min(static_cast<size_t>(target - _size), available - consumed);
+                    std::memcpy(_buffer.data() + _size, input + consumed, chunk);
+                    _size += static_cast<int>(chunk);
+                    consumed += chunk;
+                }
+                if (replaying) {
+                    replay_offset += consumed;
+                } else {
+                    data += consumed;
+                    length -= consumed;
+                }
+                if (_size == 0) {
+                    continue;
+                }
+
+                int header_size = FrameHeader::headerSize(_buffer[0]);
+                if (_size == header_size &&
+                    (FrameHeader{_buffer.data()}.incompatFlags() & ~INCOMPAT_FLAG_SIGNED) != 0) {
+                    _resync(replay, replay_offset, replay_size);
+                    continue;
+                }
+                if (_size < header_size || _size < FrameHeader{_buffer.data()}.frameLength()) {
+                    continue;
+                }
+                if (crc_extra) {
+                    auto result = verifyFrame(_buffer.data(), *crc_extra);
+                    // an unverifiable frame is only believed if the next frame starts right after it
+                    bool aligned = replay_offset < replay_size ? FrameHeader::isMagic(replay[replay_offset]) :
+                        length == 0 || FrameHeader::isMagic(data[0]);
+                    if (result == Verification::BAD_CHECKSUM ||
+                        (result == Verification::UNKNOWN_MESSAGE && (!_keep_unknown || !aligned))) {
+                        _resync(replay, replay_offset, replay_size);
+                        continue;
+                    }
+                    if (result == Verification::UNKNOWN_MESSAGE) {
+                        _stats.unknown_frames++;
+                    }
+                }
+                _stats.frames++;
+                on_frame(_buffer.data(), _size);
+                _size = 0;
+            }
+        }
+
+        /*
+         * Drops the magic byte of the buffered false start and queues the bytes after it for scanning,
+         * ahead of what is still left to replay.
+         */
+        void _resync(std::array<uint8_t, MAX_FRAME_SIZE> &replay, size_t &replay_offset, size_t &replay_size) {
+            _stats.bad_frames++;
+            _stats.skipped_bytes++;
+            auto rescan = static_cast<size_t>(_size - 1);
+            auto remaining = replay_size - replay_offset;
+            // the buffered frame was taken from the front of what is replayed, so both fit
+            assert(rescan + remaining <= replay.size());
+            std::memmove(replay.data() + rescan, replay.data() + replay_offset, remaining);
+            std::memcpy(replay.data(), _buffer.data() + 1, rescan);
+            replay_offset = 0;
+            replay_size = rescan + remaining;
+            _size = 0;
+        }
+
+    public:
+        /*
+         * Passes on frames of messages that are not in the message set, framed by their header alone,
+         * instead of resynchronizing after them. They are counted in Stats::unknown_frames. Since their
+         * checksum proves nothing, such a frame is only accepted if a magic byte, or the end of the pushed
+         * bytes, follows it; otherwise it is treated as a false start.
+         */
+        void setKeepUnknown(bool enabled) {
+            _keep_unknown = enabled;
+        }
+
+        /*
+         * Feeds bytes into the assembler. on_frame(const uint8_t *frame, int length) is called for every
+         * completed frame; the frame data is only valid during the call. crc_extra may be null to skip
+         * checksum verification.
+         */
+        template <typename F>
+        void push(const uint8_t *data, size_t length, CrcExtraCache *crc_extra, F &&on_frame) {
+            _process(data, length, crc_extra, on_frame);
+        }
+
+        /*
+         * Drops a partially received frame, e.g. at the end of a datagram.
+         */
+        void reset() {
+            _size = 0;
+        }
+
+        /*
+         * True if no partial frame is buffered, i.e. the next byte pushed may start a frame.
+         */
+        [[nodiscard]] bool idle() const {
+            return _size == 0;
+        }
+
+        [[nodiscard]] const Stats& stats() const {
+            return _stats;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_FRAMEASSEMBLER_H
@@ -0,0 +1,256 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_FRAMEPOOL_H
+#define LIBMAV_EXAMPLE_FRAMEPOOL_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/Frame.h>
+#include <example/FrameReader.h>
+
+namespace example {
+
+    class FramePool;
+
+    /*
+     * Reference counted handle on a frame stored in a FramePool slot. Copies share the slot, and the slot
+     * is returned to the pool when the last handle is dropped. Handles can be passed between threads,
+     * the pool must outlive all of them.
+     */
+    class PooledFrame {
+        friend class FramePool;
+    private:
+        FramePool *_pool = nullptr;
+        uint32_t _slot = 0;
+
+        PooledFrame(FramePool *pool, uint32_t slot) : _pool(pool), _slot(slot) {}
+
+    public:
+        PooledFrame() = default;
+        PooledFrame(const PooledFrame &other);
+        PooledFrame(PooledFrame &&other) noexcept;
+        PooledFrame& operator=(PooledFrame other) noexcept;
+        ~PooledFrame();
+
+        explicit operator bool() const { return _pool != nullptr; }
+
+        [[nodiscard]] FrameView view() const;
+        [[nodiscard]] const mav::ConnectionPartner& partner() const;
+    };
+
+    /*
+     * Fixed number of MAX_FRAME_SIZE slots, allocated once. Acquiring and releasing a slot is lock-free,
+     * so the receive thread never goes to the allocator and never waits for consumers.
+     */
+    class FramePool {
+        friend class PooledFrame;
+    public:
+        static constexpr uint32_t INVALID_SLOT = 0xFFFFFFFF;
+
+    private:
+        struct Slot {
+            std::atomic<uint32_t> references{0};
+            std::atomic<uint32_t> next_free{INVALID_SLOT};
+            int length = 0;
+            mav::ConnectionPartner partner;
+            std::array<uint8_t, MAX_FRAME_SIZE> data{};
+        };
+
+        std::unique_ptr<Slot[]> _slots;
+        uint32_t _size;
+        // Index of the first free slot in the lower 32 bits, ABA tag in the upper 32 bits
+        std::atomic<uint64_t> _free_head{INVALID_SLOT};
+        std::atomic<uint32_t> _available{0};
+
+        void push(uint32_t slot) {
+            uint64_t head = _free_head.load(std::memory_order_relaxed);
+            uint64_t next;
+            do {
+                _slots[slot].next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+                next = ((head >> 32) + 1) << 32 | slot;
+            } while (!_free_head.compare_exchange_weak(head, next, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+            _available.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint32_t pop() {
+            uint64_t head = _free_head.load(std::memory_order_acquire);
+            uint64_t next;
+            do {
+                auto slot = static_cast<uint32_t>(head);
+                if (slot == INVALID_SLOT) {
+                    return INVALID_SLOT;
+                }
+                uint32_t following = _slots[slot].next_free.load(std::memory_order_relaxed);
+                next = ((head >> 32) + 1) << 32 | following;
+            } while (!_free_head.compare_exchange_weak(head, next, std::memory_order_acquire,
+                                                        std::memory_order_acquire));
+            _available.fetch_sub(1, std::memory_order_relaxed);
+            return static_cast<uint32_t>(head);
+        }
+
+        void retain(uint32_t slot) {
+            _slots[slot].references.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void release(uint32_t slot) {
+            if (_slots[slot].references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                push(slot);
+            }
+        }
+
+    public:
+        explicit FramePool(uint32_t size) : _slots(new Slot[size]), _size(size) {
+            for (uint32_t i = size; i > 0; i--) {
+                push(i - 1);
+            }
+        }
+
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+
+        [[nodiscard]] uint32_t size() const { return _size; }
+        [[nodiscard]] uint32_t available() const { return _available.load(std::memory_order_relaxed); }
+
+        /*
+         * Hands out an empty slot for the producer to fill, or INVALID_SLOT if the pool is exhausted.
+         * The slot is exclusively owned by the producer until it calls commit().
+         */
+        uint32_t acquire() {
+            return pop();
+        }
+
+        uint8_t* slotData(uint32_t slot) {
+            return _slots[slot].data.data();
+        }
+
+        PooledFrame commit(uint32_t slot, int length, const mav::ConnectionPartner &partner) {
+            _slots[slot].length = length;
+            _slots[slot].partner = partner;
+            _slots[slot].references.store(1, std::memory_order_release);
+            return PooledFrame{this, slot};
+        }
+
+        void discard(uint32_t slot) {
+            push(slot);
+        }
+    };
+
+    inline PooledFrame::PooledFrame(const PooledFrame &other) : _pool(other._pool), _slot(other._slot) {
+        if (_pool) {
+            _pool->retain(_slot);
+        }
+    }
+
+    inline PooledFrame::PooledFrame(PooledFrame &&other) noexcept :
+        _pool(std::exchange(other._pool, nullptr)), _slot(other._slot) {}
+
+    inline PooledFrame& PooledFrame::operator=(PooledFrame other) noexcept {
+        std::swap(_pool, other._pool);
+        std::swap(_slot, other._slot);
+        return *this;
+    }
+
+    inline PooledFrame::~PooledFrame() {
+        if (_pool) {
+            _pool->release(_slot);
+        }
+    }
+
+    inline FrameView PooledFrame::view() const {
+        const auto &slot = _pool->_slots[_slot];
+        return {slot.data.data(), slot.length};
+    }
+
+    inline const mav::ConnectionPartner& PooledFrame::partner() const {
+        return _pool->_slots[_slot].partner;
+    }
+
+    /*
+     * Receive path that reads frames straight into FramePool slots. Use it instead of a NetworkRuntime
+     * on interfaces where you only consume traffic, e.g. a telemetry fan-in on a UDPServer: receiving a
+     * frame does not allocate, and the returned handles are views on the pooled bytes.
+     * When all slots are in use, incoming frames are dropped and counted, rather than blocking the reader.
+     */
+    class PooledReceiver {
+    private:
+        FrameReader _reader;
+        FramePool &_pool;
+        std::array<uint8_t, MAX_FRAME_SIZE> _overflow{};
+        uint64_t _dropped = 0;
+
+    public:
+        PooledReceiver(const mav::MessageSet &message_set, mav::NetworkInterface &interface, FramePool &pool) :
+            _reader(message_set, interface), _pool(pool) {}
+
+        /*
+         * Blocks until the next valid frame is received.
+         */
+        PooledFrame receive() {
+            while (true) {
+                mav::ConnectionPartner partner;
+                uint32_t slot = _pool.acquire();
+                if (slot == FramePool::INVALID_SLOT) {
+                    _reader.read(_overflow.data(), partner);
+                    _dropped++;
+                    continue;
+                }
+                int length;
+                try {
+                    length = _reader.read(_pool.slotData(slot), partner);
+                } catch (...) {
+                    _pool.discard(slot);
+                    throw;
+                }
+                return _pool.commit(slot, length, partner);
+            }
+        }
+
+        void setVerification(bool enabled) { _reader.setVerification(enabled); }
+
+        [[nodiscard]] uint64_t dropped() const { return _dropped; }
+        [[nodiscard]] const FrameReader::Stats& stats() const { return _reader.stats(); }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_FRAMEPOOL_H
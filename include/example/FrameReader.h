@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_FRAMEREADER_H
+#define LIBMAV_EXAMPLE_FRAMEREADER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+
+namespace example {
+
+    enum class Verification {
+        VALID,
+        UNKNOWN_MESSAGE,
+        BAD_CHECKSUM
+    };
+
+    inline Verification verifyFrame(const uint8_t *frame, CrcExtraCache &crc_extra_cache) {
+        int crc_extra = crc_extra_cache.get(FrameHeader{frame}.messageId());
+        if (crc_extra < 0) {
+            return Verification::UNKNOWN_MESSAGE;
+        }
+        return checkFrame(frame, static_cast<uint8_t>(crc_extra)) ? Verification::VALID : Verification::BAD_CHECKSUM;
+    }
+
+    /*
+     * Reads raw, checksum-verified frames from a NetworkInterface, without decoding them into messages.
+     * This is the building block for the receive paths in this directory that work on wire bytes. Like
+     * libmav's own stream parser, frames of messages that are not in the message set are dropped, since
+     * their checksum can not be verified.
+     * Verification can be turned off to only find frame boundaries, with the checksum checked later on
+     * another thread (see verifyFrame()). Frames of unknown messages can also be kept, framed by their
+     * header alone, which is what a router needs to pass on messages from other dialects.
+     * A frame that fails verification is not skipped as a whole: its bytes after the magic are scanned
+     * again, so a false magic byte in noise does not swallow the real frames inside its presumed length.
+     * The interface must not be driven by a NetworkRuntime at the same time.
+     */
+    class FrameReader {
+    public:
+        struct Stats {
+            uint64_t frames = 0;
+            uint64_t skipped_bytes = 0;
+            uint64_t bad_checksum = 0;
+            uint64_t unknown_message = 0;
+        };
+
+    private:
+        mav::NetworkInterface &_interface;
+        CrcExtraCache _crc_extra;
+        bool _verify = true;
+        bool _keep_unknown = false;
+        Stats _stats;
+
+        // bytes of a rejected frame, read again before anything new from the interface
+        std::array<uint8_t, MAX_FRAME_SIZE> _pending{};
+        int _pending_offset = 0;
+        int _pending_size = 0;
+        mav::ConnectionPartner _pending_partner;
+
+        mav::ConnectionPartner _receive(uint8_t *destination, int size) {
+            int replayed = std::min(size, _pending_size - _pending_offset);
+            std::memcpy(destination, _pending.data() + _pending_offset, replayed);
+            _pending_offset += replayed;
+            if (replayed == size) {
+                return _pending_partner;
+            }
+            return _interface.receive(destination + replayed, static_cast<uint32_t>(size - replayed));
+        }
+
+        void _resync(const uint8_t *frame, int length, const mav::ConnectionPartner &partner) {
+            // never larger than a frame: what is left of the pending bytes came after this frame's start
+            std::array<uint8_t, MAX_FRAME_SIZE> pending;
+            int remaining = _pending_size - _pending_offset;
+            std::memcpy(pending.data(), frame + 1, length - 1);
+            std::memcpy(pending.data() + length - 1, _pending.data() + _pending_offset, remaining);
+            _pending = pending;
+            _pending_offset = 0;
+            _pending_size = length - 1 + remaining;
+            _pending_partner = partner;
+            _stats.skipped_bytes++;
+        }
+
+    public:
+        FrameReader(const mav::MessageSet &message_set, mav::NetworkInterface &interface) :
+            _interface(interface), _crc_extra(message_set) {}
+
+        void setVerification(bool enabled) {
+            _verify = enabled;
+        }
+
+        /*
+         * Returns frames of messages that are not in the message set unverified, instead of dropping them.
+         * They are still counted in Stats::unknown_message. Their header is trusted as is, so only enable
+         * this on links that do not carry noise.
+         */
+        void setKeepUnknown(bool enabled) {
+            _keep_unknown = enabled;
+        }
+
+        /*
+         * Blocks until a valid frame has been read into destination, which must hold MAX_FRAME_SIZE bytes.
+         * Returns the length of the frame. Throws whatever the interface throws when it is closed.
+         */
+        int read(uint8_t *destination, mav::ConnectionPartner &partner) {
+            while (true) {
+                partner = _receive(destination, 1);
+                if (!FrameHeader::isMagic(destination[0])) {
+                    _stats.skipped_bytes++;
+                    continue;
+                }
+                int header_size = FrameHeader::headerSize(destination[0]);
+                _receive(destination + 1, header_size - 1);
+                FrameHeader header{destination};
+                if ((header.incompatFlags() & ~INCOMPAT_FLAG_SIGNED) != 0) {
+                    // unknown incompatibility flags, we can not even tell the frame length
+                    _resync(destination, header_size, partner);
+                    continue;
+                }
+                int length = header.frameLength();
+                _receive(destination + header_size, length - header_size);
+
+                if (_verify) {
+                    auto result = verifyFrame(destination, _crc_extra);
+                    if (result == Verification::UNKNOWN_MESSAGE) {
+                        _stats.unknown_message++;
+                        if (!_keep_unknown) {
+                            _resync(destination, length, partner);
+                            continue;
+                        }
+                    }
+                    if (result == Verification::BAD_CHECKSUM) {
+                        _stats.bad_checksum++;
+                        _resync(destination, length, partner);
+                        continue;
+                    }
+                }
+                // no markMessageBoundary() here, the frames after this one in a datagram are still wanted
+                _stats.frames++;
+                return length;
+            }
+        }
+
+        [[nodiscard]] const Stats& stats() const {
+            return _stats;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_FRAMEREADER_H
@@ -0,0 +1,136 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_LOOKUP_H
+#define LIBMAV_EXAMPLE_LOOKUP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace example {
+
+    /*
+     * Building blocks of the flat lookup tables that tools/generate_fields.py writes into
+     * <example/MessageTables.h>. The tables are constexpr arrays, with no pointers between entries and
+     * no allocation at startup. Name lookups hash once and almost always compare a single string.
+     * Use the generated wrappers instead of these directly:
+     *
+     *      example::msg::messageId("AUTOPILOT_VERSION");           // std::optional<uint32_t>
+     *      example::msg::messageName(148);                         // "AUTOPILOT_VERSION"
+     *      example::msg::enumValue("MAV_CMD_REQUEST_MESSAGE");     // std::optional<uint64_t>
+     *      example::msg::enumEntryName("MAV_STATE", 4);            // "MAV_STATE_ACTIVE"
+     */
+    struct NameEntry {
+        const char* name;
+        uint64_t value;
+    };
+
+    struct EnumInfo {
+        const char* name;
+        // range of the enum's entries in the entry table
+        uint32_t first;
+        uint32_t count;
+    };
+
+    /*
+     * FNV-1a, 32 bit. The generator hashes with the same function.
+     */
+    constexpr uint32_t nameHash(std::string_view name) {
+        uint32_t hash = 2166136261u;
+        for (char c : name) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    /*
+     * Open addressing hash index over a table of entries, with linear probing. Slots hold entry
+     * indices, -1 marks an empty slot; the table is sized to at most half full.
+     */
+    struct NameIndex {
+        const NameEntry *entries;
+        const int32_t *slots;
+        uint32_t mask;
+
+        [[nodiscard]] constexpr const NameEntry* find(std::string_view name) const {
+            for (uint32_t slot = nameHash(name) & mask;; slot = (slot + 1) & mask) {
+                int32_t index = slots[slot];
+                if (index < 0) {
+                    return nullptr;
+                }
+                if (std::string_view(entries[index].name) == name) {
+                    return &entries[index];
+                }
+            }
+        }
+    };
+
+    /*
+     * Binary search in entries sorted by value.
+     */
+    constexpr const NameEntry* findByValue(const NameEntry *entries, size_t count, uint64_t value) {
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (entries[middle].value < value) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low < count && entries[low].value == value ? &entries[low] : nullptr;
+    }
+
+    /*
+     * Binary search in enums sorted by name.
+     */
+    constexpr const EnumInfo* findEnum(const EnumInfo *enums, size_t count, std::string_view name) {
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (std::string_view(enums[middle].name) < name) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low < count && std::string_view(enums[low].name) == name ? &enums[low] : nullptr;
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_LOOKUP_H
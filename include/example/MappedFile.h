@@ -0,0 +1,126 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_MAPPEDFILE_H
+#define LIBMAV_EXAMPLE_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace example {
+
+    /*
+     * Read-only memory mapping of a whole file. An empty or missing file results in an invalid mapping
+     * instead of an exception, since callers typically have a fallback.
+     */
+    class MappedFile {
+    private:
+        void* _data = nullptr;
+        size_t _size = 0;
+
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::string &path) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            struct stat file_stat{};
+            if (::fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+                void* data = ::mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED) {
+                    _data = data;
+                    _size = static_cast<size_t>(file_stat.st_size);
+                }
+            }
+            ::close(fd);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile &&other) noexcept :
+            _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+
+        MappedFile& operator=(MappedFile &&other) noexcept {
+            if (this != &other) {
+                unmap();
+                _data = std::exchange(other._data, nullptr);
+                _size = std::exchange(other._size, 0);
+            }
+            return *this;
+        }
+
+        ~MappedFile() {
+            unmap();
+        }
+
+        [[nodiscard]] bool valid() const {
+            return _data != nullptr;
+        }
+
+        [[nodiscard]] const uint8_t* data() const {
+            return static_cast<const uint8_t*>(_data);
+        }
+
+        [[nodiscard]] size_t size() const {
+            return _size;
+        }
+
+        [[nodiscard]] std::string_view view() const {
+            return {static_cast<const char*>(_data), _size};
+        }
+
+    private:
+        void unmap() {
+            if (_data) {
+                ::munmap(_data, _size);
+                _data = nullptr;
+                _size = 0;
+            }
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_MAPPEDFILE_H
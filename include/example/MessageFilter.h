@@ -0,0 +1,283 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_MESSAGEFILTER_H
+#define LIBMAV_EXAMPLE_MESSAGEFILTER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/Frame.h>
+
+namespace example {
+
+    /*
+     * Set of allowed message ids, system ids and component ids, tested on the raw header of a frame.
+     * Message ids are 24 bit; the bitset is split into 4096 bit pages that are only allocated when an id
+     * in their range is allowed, so the common case (ids below 4096) is one page. A filter starts out
+     * allowing everything, and each dimension is restricted by the first allow...() call for it.
+     */
+    class MessageFilter {
+    private:
+        static constexpr int PAGE_BITS = 12;
+        static constexpr int PAGE_COUNT = 1 << (24 - PAGE_BITS);
+        static constexpr int WORDS_PER_PAGE = (1 << PAGE_BITS) / 64;
+
+        using Page = std::array<uint64_t, WORDS_PER_PAGE>;
+        using ByteSet = std::array<uint64_t, 4>;
+
+        std::array<std::unique_ptr<Page>, PAGE_COUNT> _pages;
+        ByteSet _systems{};
+        ByteSet _components{};
+        bool _any_message = true;
+        bool _any_system = true;
+        bool _any_component = true;
+
+        static bool _test(const ByteSet &set, uint8_t value) {
+            return (set[value >> 6] >> (value & 63)) & 1;
+        }
+
+    public:
+        MessageFilter() = default;
+
+        MessageFilter(const MessageFilter &other) :
+            _systems(other._systems), _components(other._components), _any_message(other._any_message),
+            _any_system(other._any_system), _any_component(other._any_component) {
+            for (int i = 0; i < PAGE_COUNT; i++) {
+                if (other._pages[i]) {
+                    _pages[i] = std::make_unique<Page>(*other._pages[i]);
+                }
+            }
+        }
+
+        MessageFilter& allowMessage(uint32_t message_id) {
+            message_id &= 0xFFFFFF;
+            auto &page = _pages[message_id >> PAGE_BITS];
+            if (!page) {
+                page = std::make_unique<Page>();
+            }
+            auto bit = message_id & ((1u << PAGE_BITS) - 1);
+            (*page)[bit >> 6] |= uint64_t{1} << (bit & 63);
+            _any_message = false;
+            return *this;
+        }
+
+        MessageFilter& allowMessage(const mav::MessageSet &message_set, const std::string &message_name) {
+            return allowMessage(static_cast<uint32_t>(message_set.idForMessage(message_name)));
+        }
+
+        MessageFilter& allowSystem(uint8_t system_id) {
+            _systems[system_id >> 6] |= uint64_t{1} << (system_id & 63);
+            _any_system = false;
+            return *this;
+        }
+
+        MessageFilter& allowComponent(uint8_t component_id) {
+            _components[component_id >> 6] |= uint64_t{1} << (component_id & 63);
+            _any_component = false;
+            return *this;
+        }
+
+        [[nodiscard]] bool acceptsMessage(uint32_t message_id) const {
+            if (_any_message) {
+                return true;
+            }
+            const auto &page = _pages[(message_id >> PAGE_BITS) & (PAGE_COUNT - 1)];
+            if (!page) {
+                return false;
+            }
+            auto bit = message_id & ((1u << PAGE_BITS) - 1);
+            return ((*page)[bit >> 6] >> (bit & 63)) & 1;
+        }
+
+        /*
+         * Tests a frame header, which has to be complete (see FrameHeader).
+         */
+        [[nodiscard]] bool accepts(const FrameHeader &header) const {
+            return (_any_system || _test(_systems, header.systemId())) &&
+                   (_any_component || _test(_components, header.componentId())) &&
+                   acceptsMessage(header.messageId());
+        }
+    };
+
+    /*
+     * Decorator that drops frames rejected by a MessageFilter before the runtime sees them. Only the header
+     * is inspected, so a rejected frame costs no parsing, CRC check, Message construction or dispatch; its
+     * remaining bytes are skipped. The filter can be swapped while the runtime is receiving.
+     *
+     * In eavesdropping mode, keep HEARTBEAT allowed if connections should be detected and kept alive:
+     *
+     *      FilteringInterface filtered(phy, MessageFilter{}
+     *              .allowMessage(message_set, "HEARTBEAT")
+     *              .allowMessage(message_set, "ATTITUDE"));
+     *      mav::NetworkRuntime net{message_set, filtered};
+     */
+    class FilteringInterface : public mav::NetworkInterface {
+    public:
+        struct Stats {
+            uint64_t accepted = 0;
+            uint64_t rejected = 0;
+        };
+
+    private:
+        mav::NetworkInterface &_interface;
+
+        std::mutex _filter_mutex;
+        std::shared_ptr<const MessageFilter> _shared_filter;
+        std::atomic<uint64_t> _filter_version{0};
+
+        // receive side, only touched by the receiving thread
+        std::shared_ptr<const MessageFilter> _filter;
+        uint64_t _loaded_version = 0;
+        std::array<uint8_t, MAX_FRAME_SIZE> _frame{};
+        int _frame_length = 0;
+        int _frame_offset = 0;
+        mav::ConnectionPartner _partner;
+        std::atomic<uint64_t> _accepted{0};
+        std::atomic<uint64_t> _rejected{0};
+
+        void _refreshFilter() {
+            auto version = _filter_version.load(std::memory_order_acquire);
+            if (version != _loaded_version) {
+                std::lock_guard<std::mutex> lock(_filter_mutex);
+                _filter = _shared_filter;
+                _loaded_version = _filter_version.load(std::memory_order_relaxed);
+            }
+        }
+
+        void _readFrame() {
+            while (true) {
+                _partner = _interface.receive(_frame.data(), 1);
+                if (!FrameHeader::isMagic(_frame[0])) {
+                    // not a frame start, left for the runtime to discard
+                    _frame_length = 1;
+                    _frame_offset = 0;
+                    return;
+                }
+                int header_size = FrameHeader::headerSize(_frame[0]);
+                _interface.receive(_frame.data() + 1, header_size - 1);
+                FrameHeader header{_frame.data()};
+                int length = (header.incompatFlags() & ~INCOMPAT_FLAG_SIGNED) != 0 ? header_size : header.frameLength();
+
+                _refreshFilter();
+                if (length == header_size || (_filter && !_filter->accepts(header))) {
+                    // skipped into the frame buffer, it is overwritten by the next frame anyway
+                    if (length > header_size) {
+                        _interface.receive(_frame.data() + header_size, length - header_size);
+                    }
+                    _rejected.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                _interface.receive(_frame.data() + header_size, length - header_size);
+                _accepted.fetch_add(1, std::memory_order_relaxed);
+                _frame_length = length;
+                _frame_offset = 0;
+                return;
+            }
+        }
+
+    public:
+        explicit FilteringInterface(mav::NetworkInterface &interface) : _interface(interface) {}
+
+        FilteringInterface(mav::NetworkInterface &interface, const MessageFilter &filter) : _interface(interface) {
+            setFilter(filter);
+        }
+
+        /*
+         * Replaces the filter. The receiving thread picks it up with the next frame.
+         */
+        void setFilter(const MessageFilter &filter) {
+            auto copy = std::make_shared<const MessageFilter>(filter);
+            std::lock_guard<std::mutex> lock(_filter_mutex);
+            _shared_filter = std::move(copy);
+            _filter_version.fetch_add(1, std::memory_order_release);
+        }
+
+        /*
+         * Lets all frames through again.
+         */
+        void clearFilter() {
+            std::lock_guard<std::mutex> lock(_filter_mutex);
+            _shared_filter.reset();
+            _filter_version.fetch_add(1, std::memory_order_release);
+        }
+
+        [[nodiscard]] Stats stats() const {
+            return {_accepted.load(std::memory_order_relaxed), _rejected.load(std::memory_order_relaxed)};
+        }
+
+        void close() const override {
+            _interface.close();
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return _interface.isConnectionOpen();
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            _interface.send(data, size, partner);
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            while (copied < size) {
+                if (_frame_offset >= _frame_length) {
+                    _readFrame();
+                }
+                auto chunk = std::min<uint32_t>(size - copied, static_cast<uint32_t>(_frame_length - _frame_offset));
+                std::memcpy(destination + copied, _frame.data() + _frame_offset, chunk);
+                _frame_offset += static_cast<int>(chunk);
+                copied += chunk;
+            }
+            return _partner;
+        }
+
+        void markMessageBoundary() override {
+            // the runtime gave up on the current frame, e.g. after a bad checksum
+            _frame_offset = _frame_length;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_MESSAGEFILTER_H
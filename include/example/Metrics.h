@@ -0,0 +1,455 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_METRICS_H
+#define LIBMAV_EXAMPLE_METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+#include <example/FrameAssembler.h>
+
+namespace example {
+
+    /*
+     * Log-linear latency histogram in the style of HdrHistogram: every power of two range is split into
+     * 16 linear buckets, so any recorded value is off by at most 1/16 (6.25%). Recording is a single
+     * relaxed atomic increment and can be done from any thread.
+     */
+    class LatencyHistogram {
+    public:
+        static constexpr int SUB_BUCKET_BITS = 4;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        struct Snapshot {
+            std::array<uint64_t, BUCKETS> counts{};
+            uint64_t count = 0;
+            uint64_t max = 0;
+
+            /*
+             * Approximate value at quantile q (0..1), e.g. 0.99 for the 99th percentile.
+             */
+            [[nodiscard]] uint64_t percentile(double q) const {
+                if (count == 0) {
+                    return 0;
+                }
+                auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count - 1)) + 1;
+                uint64_t seen = 0;
+                for (int i = 0; i < BUCKETS; i++) {
+                    seen += counts[i];
+                    if (seen >= rank) {
+                        return std::min(max, bucketLowerBound(i) + (bucketWidth(i) - 1) / 2);
+                    }
+                }
+                return max;
+            }
+        };
+
+    private:
+        std::array<std::atomic<uint64_t>, BUCKETS> _counts{};
+        std::atomic<uint64_t> _max{0};
+
+    public:
+        static int bucketIndex(uint64_t value) {
+            int msb = 63;
+            while (msb > 0 && !((value >> msb) & 1)) {
+                msb--;
+            }
+            if (msb < SUB_BUCKET_BITS) {
+                return static_cast<int>(value);
+            }
+            int shift = msb - SUB_BUCKET_BITS;
+            return (shift + 1) * SUB_BUCKETS + static_cast<int>((value >> shift) - SUB_BUCKETS);
+        }
+
+        static uint64_t bucketLowerBound(int index) {
+            if (index < 2 * SUB_BUCKETS) {
+                return static_cast<uint64_t>(index);
+            }
+            int shift = index / SUB_BUCKETS - 1;
+            return static_cast<uint64_t>(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        }
+
+        static uint64_t bucketWidth(int index) {
+            return index < 2 * SUB_BUCKETS ? 1 : uint64_t{1} << (index / SUB_BUCKETS - 1);
+        }
+
+        void record(uint64_t value) {
+            _counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+            auto current = _max.load(std::memory_order_relaxed);
+            while (value > current && !_max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+        }
+
+        [[nodiscard]] Snapshot snapshot() const {
+            Snapshot snapshot;
+            for (int i = 0; i < BUCKETS; i++) {
+                snapshot.counts[i] = _counts[i].load(std::memory_order_relaxed);
+                snapshot.count += snapshot.counts[i];
+            }
+            snapshot.max = _max.load(std::memory_order_relaxed);
+            return snapshot;
+        }
+    };
+
+    struct InterfaceMetrics {
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+        uint64_t frames_in = 0;
+        uint64_t frames_out = 0;
+        // Bytes discarded while looking for a frame start, and frames that did not verify
+        uint64_t parse_skipped_bytes = 0;
+        uint64_t bad_frames = 0;
+        // Frames received / missing according to the sequence numbers, per system id
+        std::array<uint64_t, 256> system_frames{};
+        std::array<uint64_t, 256> system_lost{};
+        // Frames up to 128 sequence numbers behind the expected one, i.e. reordered or duplicated
+        uint64_t reordered_frames = 0;
+        // Received frames per message id, only ids that were seen
+        std::map<uint32_t, uint64_t> message_counts;
+        // From the runtime reading the first byte of a frame to it consuming the last one. This is the
+        // parser's own time only, waiting in socket and interface buffers before is not included.
+        LatencyHistogram::Snapshot parse_latency;
+        // From the frame being parsed to InstrumentedInterface::observe(), see Stage
+        LatencyHistogram::Snapshot dispatch_latency;
+        LatencyHistogram::Snapshot wakeup_latency;
+        // Only with an arrival clock (see InstrumentedInterface::setArrivalClock()): from the frame's datagram
+        // arriving, to the runtime consuming the frame's last byte, and to observe() with Stage::DISPATCH
+        LatencyHistogram::Snapshot arrival_latency;
+        LatencyHistogram::Snapshot arrival_to_dispatch_latency;
+    };
+
+    /*
+     * Opt-in instrumentation, as a decorator around the interface the runtime drives:
+     *
+     *      InstrumentedInterface instrumented(message_set, phy);
+     *      mav::NetworkRuntime net{message_set, own_heartbeat, instrumented};
+     *      ...
+     *      auto metrics = instrumented.snapshot();
+     *
+     * Counters are relaxed atomics, so snapshot() is lock-free and can run on any thread while the
+     * runtime is receiving. Without the decorator nothing is measured and nothing is paid; with it,
+     * setEnabled(false) reduces the cost to one atomic load per call.
+     *
+     * The later stages happen in user code, which reports them with observe(): Stage::DISPATCH from a
+     * message callback, Stage::WAKEUP once a blocking receive() returned the message. The frame's parse
+     * time is found again through its header (system, component, sequence and message id).
+     *
+     * Time spent before the runtime reads a frame, in the socket and in the wrapped interface's buffers,
+     * is only visible to the wrapped interface. If it can tell when the data being read arrived, e.g.
+     * BatchedUDPServer::lastArrival() with kernel timestamps, pass that in with setArrivalClock() to
+     * also measure from arrival.
+     */
+    class InstrumentedInterface : public mav::NetworkInterface {
+    public:
+        enum class Stage {
+            DISPATCH,
+            WAKEUP
+        };
+
+        // Arrival time of the data the last receive() of the wrapped interface returned, in nanoseconds
+        // since the epoch (system clock), 0 if unknown
+        using ArrivalClock = std::function<int64_t()>;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr int PAGE_BITS = 12;
+        static constexpr int PAGE_COUNT = 1 << (24 - PAGE_BITS);
+        using CounterPage = std::array<std::atomic<uint64_t>, 1 << PAGE_BITS>;
+
+        // Recently parsed frames, for matching observe() calls. Written by the receiving thread only.
+        static constexpr int RECENT_FRAMES = 1024;
+        struct RecentFrame {
+            std::atomic<uint64_t> key{0};
+            std::atomic<int64_t> parsed_at{0};
+            std::atomic<int64_t> arrived_at{0};
+        };
+
+        mav::NetworkInterface &_interface;
+        std::atomic_bool _enabled{true};
+
+        std::atomic<uint64_t> _bytes_in{0};
+        std::atomic<uint64_t> _bytes_out{0};
+        std::atomic<uint64_t> _frames_in{0};
+        std::atomic<uint64_t> _frames_out{0};
+        std::atomic<uint64_t> _skipped_bytes{0};
+        std::atomic<uint64_t> _bad_frames{0};
+        std::array<std::atomic<uint64_t>, 256> _system_frames{};
+        std::array<std::atomic<uint64_t>, 256> _system_lost{};
+        std::atomic<uint64_t> _reordered{0};
+        std::array<std::atomic<CounterPage*>, PAGE_COUNT> _message_counts{};
+        std::array<RecentFrame, RECENT_FRAMES> _recent{};
+        LatencyHistogram _parse_latency;
+        LatencyHistogram _dispatch_latency;
+        LatencyHistogram _wakeup_latency;
+        LatencyHistogram _arrival_latency;
+        LatencyHistogram _arrival_to_dispatch_latency;
+
+        // receive side, only touched by the receiving thread
+        CrcExtraCache _crc_extra;
+        FrameAssembler _assembler;
+        mav::ConnectionPartner _last_partner;
+        int64_t _frame_started_at = 0;
+        ArrivalClock _arrival_clock;
+        int64_t _frame_arrived_at = 0;
+        FrameAssembler::Stats _reported{};
+        // per system / component: last received sequence number << 16 | 0x100 | expected next sequence number,
+        // 0 if none seen yet
+        std::array<uint32_t, 65536> _sequences{};
+
+        static int64_t _now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        }
+
+        static int64_t _wallNow() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        static uint64_t _key(const FrameHeader &header) {
+            // never 0, which marks an empty slot
+            return (uint64_t{1} << 63) | (static_cast<uint64_t>(header.messageId()) << 24) |
+                   (static_cast<uint64_t>(header.systemId()) << 16) | (static_cast<uint64_t>(header.componentId()) << 8) |
+                   header.sequence();
+        }
+
+        static size_t _slot(uint64_t key) {
+            return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 54) & (RECENT_FRAMES - 1);
+        }
+
+        void _countMessage(uint32_t message_id) {
+            auto &page_pointer = _message_counts[(message_id >> PAGE_BITS) & (PAGE_COUNT - 1)];
+            auto *page = page_pointer.load(std::memory_order_acquire);
+            if (!page) {
+                auto *fresh = new CounterPage{};
+                if (page_pointer.compare_exchange_strong(page, fresh, std::memory_order_acq_rel)) {
+                    page = fresh;
+                } else {
+                    delete fresh;
+                }
+            }
+            (*page)[message_id & ((1u << PAGE_BITS) - 1)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        void _onFrame(const uint8_t *frame) {
+            FrameHeader header{frame};
+            auto now = _now();
+            _frames_in.fetch_add(1, std::memory_order_relaxed);
+            _countMessage(header.messageId());
+            _parse_latency.record(static_cast<uint64_t>(std::max<int64_t>(0, now - _frame_started_at)));
+            if (_frame_arrived_at != 0) {
+                _arrival_latency.record(static_cast<uint64_t>(std::max<int64_t>(0, _wallNow() - _frame_arrived_at)));
+            }
+
+            auto system = header.systemId();
+            _system_frames[system].fetch_add(1, std::memory_order_relaxed);
+            auto &state = _sequences[system << 8 | header.componentId()];
+            auto sequence = header.sequence();
+            auto gap = static_cast<uint8_t>(sequence - static_cast<uint8_t>(state));
+            auto follows_last = sequence == static_cast<uint8_t>((state >> 16) + 1u);
+            if (state != 0 && gap > 128 && !follows_last) {
+                // behind the expected sequence number: a late or repeated frame. Nothing was lost, and the
+                // expectation stays where it is.
+                _reordered.fetch_add(1, std::memory_order_relaxed);
+                state = (state & 0xFFFFu) | static_cast<uint32_t>(sequence) << 16;
+            } else {
+                // a frame right after a "late" one means the sender simply went on after a gap of more than
+                // 128 frames, which can not be told from reordering and is not counted
+                if (state != 0 && gap > 0 && gap <= 128) {
+                    _system_lost[system].fetch_add(gap, std::memory_order_relaxed);
+                }
+                state = static_cast<uint32_t>(sequence) << 16 | 0x100u | static_cast<uint8_t>(sequence + 1u);
+            }
+
+            auto key = _key(header);
+            auto &recent = _recent[_slot(key)];
+            recent.key.store(0, std::memory_order_relaxed);
+            recent.parsed_at.store(now, std::memory_order_relaxed);
+            recent.arrived_at.store(_frame_arrived_at, std::memory_order_relaxed);
+            recent.key.store(key, std::memory_order_release);
+        }
+
+        void _track(const uint8_t *data, uint32_t size, const mav::ConnectionPartner &partner) {
+            if (partner != _last_partner) {
+                _assembler.reset();
+                _last_partner = partner;
+            }
+            _bytes_in.fetch_add(size, std::memory_order_relaxed);
+            _assembler.push(data, size, &_crc_extra, [this](const uint8_t *frame, int) {
+                _onFrame(frame);
+            });
+            const auto &stats = _assembler.stats();
+            if (stats.skipped_bytes != _reported.skipped_bytes || stats.bad_frames != _reported.bad_frames) {
+                _skipped_bytes.fetch_add(stats.skipped_bytes - _reported.skipped_bytes, std::memory_order_relaxed);
+                _bad_frames.fetch_add(stats.bad_frames - _reported.bad_frames, std::memory_order_relaxed);
+                _reported = stats;
+            }
+        }
+
+    public:
+        InstrumentedInterface(const mav::MessageSet &message_set, mav::NetworkInterface &interface) :
+            _interface(interface), _crc_extra(message_set) {}
+
+        InstrumentedInterface(const InstrumentedInterface&) = delete;
+        InstrumentedInterface& operator=(const InstrumentedInterface&) = delete;
+
+        ~InstrumentedInterface() override {
+            for (auto &page : _message_counts) {
+                delete page.load();
+            }
+        }
+
+        void setEnabled(bool enabled) {
+            _enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        /*
+         * Called on the receiving thread after each receive() of the wrapped interface that starts a frame.
+         * Must be set before the runtime starts receiving, e.g.
+         *
+         *      instrumented.setArrivalClock([&udp] { return udp.lastArrival(); });
+         */
+        void setArrivalClock(ArrivalClock arrival_clock) {
+            _arrival_clock = std::move(arrival_clock);
+        }
+
+        /*
+         * Records the latency from the message's frame being parsed to now. Messages whose frame is no
+         * longer among the last RECENT_FRAMES, or that were not received through this interface, are
+         * ignored.
+         */
+        void observe(const mav::Message &message, Stage stage) {
+            if (!_enabled.load(std::memory_order_relaxed)) {
+                return;
+            }
+            auto key = _key(FrameHeader{message.data()});
+            auto &recent = _recent[_slot(key)];
+            if (recent.key.load(std::memory_order_acquire) != key) {
+                return;
+            }
+            auto parsed_at = recent.parsed_at.load(std::memory_order_relaxed);
+            auto arrived_at = recent.arrived_at.load(std::memory_order_relaxed);
+            if (recent.key.load(std::memory_order_acquire) != key) {
+                return;
+            }
+            auto latency = static_cast<uint64_t>(std::max<int64_t>(0, _now() - parsed_at));
+            (stage == Stage::DISPATCH ? _dispatch_latency : _wakeup_latency).record(latency);
+            if (stage == Stage::DISPATCH && arrived_at != 0) {
+                auto since_arrival = static_cast<uint64_t>(std::max<int64_t>(0, _wallNow() - arrived_at));
+                _arrival_to_dispatch_latency.record(since_arrival);
+            }
+        }
+
+        [[nodiscard]] InterfaceMetrics snapshot() const {
+            InterfaceMetrics metrics;
+            metrics.bytes_in = _bytes_in.load(std::memory_order_relaxed);
+            metrics.bytes_out = _bytes_out.load(std::memory_order_relaxed);
+            metrics.frames_in = _frames_in.load(std::memory_order_relaxed);
+            metrics.frames_out = _frames_out.load(std::memory_order_relaxed);
+            metrics.parse_skipped_bytes = _skipped_bytes.load(std::memory_order_relaxed);
+            metrics.bad_frames = _bad_frames.load(std::memory_order_relaxed);
+            for (int i = 0; i < 256; i++) {
+                metrics.system_frames[i] = _system_frames[i].load(std::memory_order_relaxed);
+                metrics.system_lost[i] = _system_lost[i].load(std::memory_order_relaxed);
+            }
+            metrics.reordered_frames = _reordered.load(std::memory_order_relaxed);
+            for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+                const auto *counters = _message_counts[page].load(std::memory_order_acquire);
+                if (!counters) {
+                    continue;
+                }
+                for (uint32_t i = 0; i < counters->size(); i++) {
+                    auto count = (*counters)[i].load(std::memory_order_relaxed);
+                    if (count) {
+                        metrics.message_counts[page << PAGE_BITS | i] = count;
+                    }
+                }
+            }
+            metrics.parse_latency = _parse_latency.snapshot();
+            metrics.dispatch_latency = _dispatch_latency.snapshot();
+            metrics.wakeup_latency = _wakeup_latency.snapshot();
+            metrics.arrival_latency = _arrival_latency.snapshot();
+            metrics.arrival_to_dispatch_latency = _arrival_to_dispatch_latency.snapshot();
+            return metrics;
+        }
+
+        void close() const override {
+            _interface.close();
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return _interface.isConnectionOpen();
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            _interface.send(data, size, partner);
+            if (_enabled.load(std::memory_order_relaxed)) {
+                _bytes_out.fetch_add(size, std::memory_order_relaxed);
+                _frames_out.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            auto partner = _interface.receive(destination, size);
+            if (_enabled.load(std::memory_order_relaxed)) {
+                if (_assembler.idle()) {
+                    _frame_started_at = _now();
+                    _frame_arrived_at = _arrival_clock ? _arrival_clock() : 0;
+                }
+                _track(destination, size, partner);
+            }
+            return partner;
+        }
+
+        void markMessageBoundary() override {
+            _interface.markMessageBoundary();
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_METRICS_H
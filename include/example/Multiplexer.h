@@ -0,0 +1,618 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_MULTIPLEXER_H
+#define LIBMAV_EXAMPLE_MULTIPLEXER_H
+
+#ifndef __linux__
+#error "example/Multiplexer.h requires epoll and is only available on Linux"
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/FrameAssembler.h>
+#include <example/FrameReader.h>
+#include <example/PeerTable.h>
+
+namespace example {
+
+    /*
+     * Called by a source for every complete frame. The frame data is only valid during the call.
+     */
+    using FrameSink = std::function<void(const uint8_t *frame, int length, const mav::ConnectionPartner &partner)>;
+
+    /*
+     * A file descriptor based frame source that can be driven by MultiplexedInterface. All methods except
+     * send() are called from the thread receiving on the multiplexer; send() may be called from any thread.
+     */
+    class MultiplexSource {
+    public:
+        virtual ~MultiplexSource() = default;
+
+        // Descriptor the multiplexer waits on for readability
+        [[nodiscard]] virtual int fd() const = 0;
+
+        /*
+         * Reads what is available without blocking and passes complete frames to the sink. Returns false
+         * once the source reached end of stream or failed, the multiplexer then removes it.
+         */
+        virtual bool readAvailable(CrcExtraCache &crc_extra, const FrameSink &sink) = 0;
+
+        virtual void send(const uint8_t *data, uint32_t size, const mav::ConnectionPartner &partner) = 0;
+    };
+
+    /*
+     * Non-blocking UDP socket bound to a local port. Every datagram is framed on its own, and its sender
+     * becomes the connection partner.
+     */
+    class UDPSource : public MultiplexSource {
+    private:
+        // Upper bound of datagrams read per wakeup, so a busy socket can not starve the other sources
+        static constexpr int MAX_DATAGRAMS_PER_READ = 64;
+
+        int _socket = -1;
+        FrameAssembler _assembler;
+        std::vector<uint8_t> _buffer = std::vector<uint8_t>(65536);
+
+    public:
+        explicit UDPSource(int local_port, const std::string &local_address = "0.0.0.0") {
+            _socket = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (_socket < 0) {
+                throw mav::NetworkError("Could not create socket", errno);
+            }
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(local_port));
+            if (::inet_pton(AF_INET, local_address.c_str(), &address.sin_addr) != 1) {
+                ::close(_socket);
+                throw mav::NetworkError("Invalid address " + local_address, EINVAL);
+            }
+            if (::bind(_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+                int error = errno;
+                ::close(_socket);
+                throw mav::NetworkError("Could not bind socket", error);
+            }
+        }
+
+        UDPSource(const UDPSource&) = delete;
+        UDPSource& operator=(const UDPSource&) = delete;
+
+        ~UDPSource() override {
+            ::close(_socket);
+        }
+
+        [[nodiscard]] int fd() const override {
+            return _socket;
+        }
+
+        bool readAvailable(CrcExtraCache &crc_extra, const FrameSink &sink) override {
+            for (int i = 0; i < MAX_DATAGRAMS_PER_READ; i++) {
+                sockaddr_in address{};
+                socklen_t address_length = sizeof(address);
+                auto length = ::recvfrom(_socket, _buffer.data(), _buffer.size(), 0,
+                                         reinterpret_cast<sockaddr*>(&address), &address_length);
+                if (length < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                mav::ConnectionPartner partner{ntohl(address.sin_addr.s_addr), ntohs(address.sin_port), false};
+                // frames never span datagrams
+                _assembler.reset();
+                _assembler.push(_buffer.data(), static_cast<size_t>(length), &crc_extra,
+                                [&](const uint8_t *frame, int frame_length) {
+                    sink(frame, frame_length, partner);
+                });
+            }
+            return true;
+        }
+
+        void send(const uint8_t *data, uint32_t size, const mav::ConnectionPartner &partner) override {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(partner.address());
+            address.sin_port = htons(static_cast<uint16_t>(partner.port()));
+            if (::sendto(_socket, data, size, 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+                throw mav::NetworkError("Could not send to socket", errno);
+            }
+        }
+
+        [[nodiscard]] const FrameAssembler::Stats& stats() const {
+            return _assembler.stats();
+        }
+    };
+
+    /*
+     * Byte stream source over an already opened descriptor, e.g. a serial device, a pipe or a connected
+     * TCP socket. The source takes ownership of the descriptor and reports all traffic as coming from the
+     * given partner, which has to be unique among the sources of a multiplexer.
+     */
+    class StreamSource : public MultiplexSource {
+    private:
+        static constexpr int MAX_READS_PER_WAKEUP = 4;
+
+        int _fd;
+        mav::ConnectionPartner _partner;
+        FrameAssembler _assembler;
+        std::array<uint8_t, 4096> _buffer{};
+        std::mutex _send_mutex;
+
+    public:
+        StreamSource(int fd, const mav::ConnectionPartner &partner) : _fd(fd), _partner(partner) {
+            int flags = ::fcntl(_fd, F_GETFL);
+            if (flags < 0 || ::fcntl(_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+                throw mav::NetworkError("Could not make descriptor non-blocking", errno);
+            }
+        }
+
+        StreamSource(const StreamSource&) = delete;
+        StreamSource& operator=(const StreamSource&) = delete;
+
+        ~StreamSource() override {
+            ::close(_fd);
+        }
+
+        [[nodiscard]] int fd() const override {
+            return _fd;
+        }
+
+        bool readAvailable(CrcExtraCache &crc_extra, const FrameSink &sink) override {
+            for (int i = 0; i < MAX_READS_PER_WAKEUP; i++) {
+                auto length = ::read(_fd, _buffer.data(), _buffer.size());
+                if (length == 0) {
+                    return false;
+                }
+                if (length < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno == EAGAIN || errno == EWOULDBLOCK;
+                }
+                _assembler.push(_buffer.data(), static_cast<size_t>(length), &crc_extra,
+                                [&](const uint8_t *frame, int frame_length) {
+                    sink(frame, frame_length, _partner);
+                });
+            }
+            return true;
+        }
+
+        void send(const uint8_t *data, uint32_t size, const mav::ConnectionPartner &) override {
+            std::lock_guard<std::mutex> lock(_send_mutex);
+            uint32_t written = 0;
+            while (written < size) {
+                auto result = ::write(_fd, data + written, size - written);
+                if (result < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        pollfd descriptor{_fd, POLLOUT, 0};
+                        ::poll(&descriptor, 1, -1);
+                        continue;
+                    }
+                    throw mav::NetworkError("Could not write to descriptor", errno);
+                }
+                written += static_cast<uint32_t>(result);
+            }
+        }
+
+        [[nodiscard]] const FrameAssembler::Stats& stats() const {
+            return _assembler.stats();
+        }
+    };
+
+    /*
+     * Bridges an interface without a descriptor (e.g. mav::TCPServer or mav::Serial) into the multiplexer.
+     * A thread reads verified frames from the interface and signals them through an eventfd. This costs a
+     * thread per interface, so prefer UDPSource and StreamSource where possible.
+     */
+    class InterfaceSource : public MultiplexSource {
+    private:
+        struct QueuedFrame {
+            mav::ConnectionPartner partner;
+            int length;
+            std::array<uint8_t, MAX_FRAME_SIZE> data;
+        };
+
+        mav::NetworkInterface &_interface;
+        int _event_fd;
+        std::mutex _mutex;
+        std::vector<QueuedFrame> _queue;
+        std::vector<QueuedFrame> _delivering;
+        std::atomic_bool _finished{false};
+        std::thread _thread;
+
+        void _run(const mav::MessageSet &message_set) {
+            FrameReader reader(message_set, _interface);
+            QueuedFrame frame{};
+            try {
+                while (true) {
+                    frame.length = reader.read(frame.data.data(), frame.partner);
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _queue.push_back(frame);
+                    }
+                    uint64_t one = 1;
+                    (void)::write(_event_fd, &one, sizeof(one));
+                }
+            } catch (const std::exception&) {
+                // the interface was closed or failed, nothing left to bridge
+            }
+            _finished = true;
+            uint64_t one = 1;
+            (void)::write(_event_fd, &one, sizeof(one));
+        }
+
+    public:
+        InterfaceSource(const mav::MessageSet &message_set, mav::NetworkInterface &interface) :
+            _interface(interface) {
+            _event_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (_event_fd < 0) {
+                throw mav::NetworkError("Could not create eventfd", errno);
+            }
+            _thread = std::thread([this, &message_set] { _run(message_set); });
+        }
+
+        InterfaceSource(const InterfaceSource&) = delete;
+        InterfaceSource& operator=(const InterfaceSource&) = delete;
+
+        ~InterfaceSource() override {
+            _interface.close();
+            _thread.join();
+            ::close(_event_fd);
+        }
+
+        [[nodiscard]] int fd() const override {
+            return _event_fd;
+        }
+
+        bool readAvailable(CrcExtraCache &, const FrameSink &sink) override {
+            uint64_t count;
+            (void)::read(_event_fd, &count, sizeof(count));
+            // read the flag before draining, so frames queued ahead of the end are still delivered
+            bool finished = _finished;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _delivering.swap(_queue);
+            }
+            for (const auto &frame : _delivering) {
+                sink(frame.data.data(), frame.length, frame.partner);
+            }
+            _delivering.clear();
+            return !finished;
+        }
+
+        void send(const uint8_t *data, uint32_t size, const mav::ConnectionPartner &partner) override {
+            _interface.send(data, size, partner);
+        }
+    };
+
+    /*
+     * A NetworkInterface that aggregates any number of sources behind a single epoll instance, so that one
+     * NetworkRuntime (and its threads) serves all of them instead of one runtime per link. The runtime's
+     * receive thread doubles as the event loop: it waits on epoll, lets the ready sources frame their input,
+     * and is then served whole frames. Sends are routed to the source a partner was last heard on. Sends to
+     * partners no source has seen (yet, or any more) are dropped and counted in unroutableCount(), since
+     * libmav keeps sending heartbeats on connections whose partner went quiet. Routes go away with their
+     * source, when libmav reports the connection lost (see attach()), or after the idle timeout of the
+     * PeerTableConfig passed in, so churning peers do not grow the table.
+     *
+     *      MultiplexedInterface mux(message_set);
+     *      mux.addSource(std::make_shared<UDPSource>(14550));
+     *      mux.addSource(std::make_shared<StreamSource>(serial_fd, mav::ConnectionPartner(0, 1, true)));
+     *      mav::NetworkRuntime runtime(message_set, heartbeat, mux);
+     *      mux.attach(runtime);
+     */
+    class MultiplexedInterface : public mav::NetworkInterface {
+    private:
+        struct PendingFrame {
+            mav::ConnectionPartner partner;
+            int length;
+            std::array<uint8_t, MAX_FRAME_SIZE> data;
+        };
+
+        static constexpr int MAX_EVENTS = 32;
+
+        int _epoll_fd = -1;
+        int _wake_fd = -1;
+        mutable std::atomic_bool _should_terminate{false};
+        CrcExtraCache _crc_extra;
+
+        std::mutex _sources_mutex;
+        std::vector<std::shared_ptr<MultiplexSource>> _sources;
+
+        // partner -> source that last received from it, for routing sends
+        PeerTable<std::shared_ptr<MultiplexSource>> _routes;
+        std::atomic<uint64_t> _unroutable{0};
+        std::atomic<uint64_t> _discarded_bytes{0};
+
+        // receive side, only touched by the receiving thread
+        std::vector<PendingFrame> _frames;
+        size_t _frame_index = 0;
+        int _frame_offset = 0;
+        MultiplexSource *_reading = nullptr;
+        std::shared_ptr<MultiplexSource> _reading_shared;
+        PeerTable<std::shared_ptr<MultiplexSource>>::LastHit _last_route;
+        FrameSink _sink;
+
+        void _onFrame(const uint8_t *frame, int length, const mav::ConnectionPartner &partner) {
+            _routes.seen(_last_route, partner, _reading_shared);
+            if (_frame_index >= _frames.size()) {
+                _frames.emplace_back();
+            }
+            auto &pending = _frames[_frame_index++];
+            pending.partner = partner;
+            pending.length = length;
+            std::memcpy(pending.data.data(), frame, length);
+        }
+
+        void _discardFrame() {
+            if (_frame_index >= _frames.size() || _frame_offset >= _frames[_frame_index].length) {
+                return;
+            }
+            _discarded_bytes.fetch_add(static_cast<uint64_t>(_frames[_frame_index].length - _frame_offset),
+                                       std::memory_order_relaxed);
+            _frame_offset = _frames[_frame_index].length;
+        }
+
+        void _removeSource(MultiplexSource *source) {
+            ::epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, source->fd(), nullptr);
+            _routes.eraseIf([source](const mav::ConnectionPartner &, const std::shared_ptr<MultiplexSource> &route) {
+                return route.get() == source;
+            });
+            std::lock_guard<std::mutex> lock(_sources_mutex);
+            for (auto it = _sources.begin(); it != _sources.end(); ++it) {
+                if (it->get() == source) {
+                    _sources.erase(it);
+                    break;
+                }
+            }
+            _last_route.reset();
+        }
+
+        std::shared_ptr<MultiplexSource> _findSource(MultiplexSource *source) {
+            std::lock_guard<std::mutex> lock(_sources_mutex);
+            for (const auto &candidate : _sources) {
+                if (candidate.get() == source) {
+                    return candidate;
+                }
+            }
+            return nullptr;
+        }
+
+        // Blocks until at least one frame is pending. Frames are collected at the front of _frames.
+        void _poll() {
+            size_t collected = 0;
+            epoll_event events[MAX_EVENTS];
+            while (collected == 0) {
+                if (_should_terminate) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+                int ready = ::epoll_wait(_epoll_fd, events, MAX_EVENTS, -1);
+                if (ready < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw mav::NetworkError("epoll_wait failed", errno);
+                }
+                _frame_index = 0;
+                for (int i = 0; i < ready; i++) {
+                    if (events[i].data.ptr == nullptr) {
+                        continue;
+                    }
+                    _reading = static_cast<MultiplexSource*>(events[i].data.ptr);
+                    _reading_shared = _findSource(_reading);
+                    if (!_reading_shared) {
+                        continue;
+                    }
+                    bool alive = _reading->readAvailable(_crc_extra, _sink);
+                    if (!alive) {
+                        _removeSource(_reading);
+                    }
+                }
+                _reading = nullptr;
+                _reading_shared.reset();
+                _routes.maybeEvictIdle();
+                collected = _frame_index;
+            }
+            _frames.resize(collected);
+            _frame_index = 0;
+            _frame_offset = 0;
+        }
+
+    public:
+        // Routes of partners not heard for a minute are evicted, long after libmav gave up on their connection
+        static PeerTableConfig defaultRoutes() {
+            PeerTableConfig routes;
+            routes.idle_timeout = std::chrono::milliseconds{60000};
+            return routes;
+        }
+
+        explicit MultiplexedInterface(const mav::MessageSet &message_set,
+                                      const PeerTableConfig &routes = defaultRoutes()) :
+                _crc_extra(message_set), _routes(routes) {
+            _epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (_epoll_fd < 0) {
+                throw mav::NetworkError("Could not create epoll instance", errno);
+            }
+            _wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (_wake_fd < 0) {
+                int error = errno;
+                ::close(_epoll_fd);
+                throw mav::NetworkError("Could not create eventfd", error);
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;
+            ::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &event);
+            _sink = [this](const uint8_t *frame, int length, const mav::ConnectionPartner &partner) {
+                _onFrame(frame, length, partner);
+            };
+        }
+
+        MultiplexedInterface(const MultiplexedInterface&) = delete;
+        MultiplexedInterface& operator=(const MultiplexedInterface&) = delete;
+
+        ~MultiplexedInterface() override {
+            close();
+            _routes.clear();
+            {
+                std::lock_guard<std::mutex> lock(_sources_mutex);
+                _sources.clear();
+            }
+            ::close(_wake_fd);
+            ::close(_epoll_fd);
+        }
+
+        /*
+         * Adds a source. This is safe while the interface is being received on; the source is picked up
+         * on the next wakeup.
+         */
+        MultiplexSource& addSource(std::shared_ptr<MultiplexSource> source) {
+            {
+                std::lock_guard<std::mutex> lock(_sources_mutex);
+                _sources.push_back(source);
+            }
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = source.get();
+            if (::epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, source->fd(), &event) < 0) {
+                int error = errno;
+                std::lock_guard<std::mutex> lock(_sources_mutex);
+                _sources.pop_back();
+                throw mav::NetworkError("Could not add source to epoll", error);
+            }
+            return *source;
+        }
+
+        /*
+         * Drops the route of every connection the runtime loses, instead of waiting for the idle timeout.
+         * The runtime must be stopped before the multiplexer is destroyed, as it has to be anyway.
+         */
+        void attach(mav::NetworkRuntime &runtime) {
+            runtime.onConnectionLost([this](const std::shared_ptr<mav::Connection> &connection) {
+                _routes.erase(connection->partner());
+            });
+        }
+
+        [[nodiscard]] size_t sourceCount() {
+            std::lock_guard<std::mutex> lock(_sources_mutex);
+            return _sources.size();
+        }
+
+        void close() const override {
+            if (_should_terminate.exchange(true)) {
+                return;
+            }
+            uint64_t one = 1;
+            (void)::write(_wake_fd, &one, sizeof(one));
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return !_should_terminate;
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            auto source = _routes.find(partner);
+            if (!source) {
+                _unroutable.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            (*source)->send(data, size, partner);
+        }
+
+        /*
+         * Number of sends dropped because no source has seen the partner.
+         */
+        [[nodiscard]] uint64_t unroutableCount() const {
+            return _unroutable.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * Bytes of frames dropped because a read did not fit the rest of the frame, or the runtime gave up on it.
+         */
+        [[nodiscard]] uint64_t discardedBytes() const {
+            return _discarded_bytes.load(std::memory_order_relaxed);
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            // every read is served from a single frame, so it never mixes bytes of different partners
+            while (_frame_index >= _frames.size() ||
+                    _frames[_frame_index].length - _frame_offset < static_cast<int>(size)) {
+                _discardFrame();
+                if (_frame_index + 1 < _frames.size()) {
+                    _frame_index++;
+                    _frame_offset = 0;
+                } else {
+                    _poll();
+                }
+            }
+            const auto &frame = _frames[_frame_index];
+            std::memcpy(destination, frame.data.data() + _frame_offset, size);
+            _frame_offset += static_cast<int>(size);
+            return frame.partner;
+        }
+
+        void markMessageBoundary() override {
+            _discardFrame();
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_MULTIPLEXER_H
@@ -0,0 +1,370 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_PARAMETERCLIENT_H
+#define LIBMAV_EXAMPLE_PARAMETERCLIENT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/FieldHandle.h>
+#include <example/Frame.h>
+
+namespace example {
+
+    struct Parameter {
+        std::string id;
+        // The raw field value. For integer parameters, the bytes of the integer are sent in the float.
+        float value = 0;
+        uint8_t type = 0;
+        uint16_t index = 0;
+
+        /*
+         * Same as Message::floatUnpack(): reinterprets the bytes of the float as T.
+         */
+        template <typename T>
+        T floatUnpack() const {
+            static_assert(sizeof(T) <= sizeof(float), "Parameter values are at most 4 bytes");
+            T result{};
+            std::memcpy(&result, &value, sizeof(T));
+            return result;
+        }
+    };
+
+    struct ParameterClientConfig {
+        int target_system = 1;
+        int target_component = 1;
+        // Maximum number of PARAM_REQUEST_READ for missing indices in flight at the same time
+        int window = 16;
+        // Retransmission timeout bounds; the timeout in use adapts to the measured round trip time
+        int min_timeout_ms = 20;
+        int max_timeout_ms = 1000;
+        int initial_timeout_ms = 200;
+    };
+
+    /*
+     * Downloads and caches the full parameter table of a component.
+     *
+     * fetchAll() sends PARAM_REQUEST_LIST and tracks the received indices in a bitmap while the autopilot
+     * streams the table. As soon as the stream stalls, the missing indices are re-requested with
+     * PARAM_REQUEST_READ, keeping up to `window` requests in flight. Request timeouts follow the measured
+     * round trip times (smoothed RTT plus four times its variation, as TCP does), so lost messages are
+     * recovered quickly on a good link without flooding a slow one.
+     */
+    class ParameterClient {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        const mav::MessageSet &_message_set;
+        std::shared_ptr<mav::Connection> _connection;
+        ParameterClientConfig _config;
+        mav::CallbackHandle _callback_handle;
+
+        FieldHandle _value_id, _value_value, _value_type, _value_count, _value_index;
+        FieldHandle _list_target_system, _list_target_component;
+        FieldHandle _read_target_system, _read_target_component, _read_param_id, _read_param_index;
+        int _param_value_id;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _updated;
+        int _count = -1;
+        int _received_count = 0;
+        std::vector<uint64_t> _received;
+        std::vector<Parameter> _parameters;
+        std::unordered_map<std::string, int> _index_by_id;
+        std::unordered_map<int, Clock::time_point> _in_flight;
+        Clock::time_point _last_progress;
+
+        // adaptive timeout state, in milliseconds
+        double _smoothed_rtt = 0;
+        double _rtt_variation = 0;
+        bool _has_rtt = false;
+
+        bool _isReceived(int index) const {
+            return (_received[index / 64] >> (index % 64)) & 1;
+        }
+
+        void _onParamValue(const mav::Message &message) {
+            FrameHeader header{message.data()};
+            if (header.systemId() != _config.target_system || header.componentId() != _config.target_component) {
+                return;
+            }
+            Parameter parameter;
+            parameter.id = std::string{getString(message, _value_id)};
+            parameter.value = example::get<float>(message, _value_value);
+            parameter.type = example::get<uint8_t>(message, _value_type);
+            parameter.index = example::get<uint16_t>(message, _value_index);
+            int count = example::get<int>(message, _value_count);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_count < 0 && count > 0) {
+                _count = count;
+                _received.assign((count + 63) / 64, 0);
+                _parameters.resize(count);
+            }
+            int index = parameter.index;
+            if (index == 0xFFFF) {
+                // answer to a read by name, which does not carry an index
+                auto it = _index_by_id.find(parameter.id);
+                if (it == _index_by_id.end()) {
+                    return;
+                }
+                index = it->second;
+                parameter.index = static_cast<uint16_t>(index);
+            }
+            if (index >= _count) {
+                return;
+            }
+            auto in_flight = _in_flight.find(index);
+            if (in_flight != _in_flight.end()) {
+                _sampleRtt(std::chrono::duration<double, std::milli>(Clock::now() - in_flight->second).count());
+                _in_flight.erase(in_flight);
+            }
+            if (!_isReceived(index)) {
+                _received[index / 64] |= uint64_t{1} << (index % 64);
+                _received_count++;
+                _last_progress = Clock::now();
+            }
+            _index_by_id[parameter.id] = index;
+            _parameters[index] = std::move(parameter);
+            _updated.notify_all();
+        }
+
+        void _sampleRtt(double rtt_ms) {
+            if (!_has_rtt) {
+                _smoothed_rtt = rtt_ms;
+                _rtt_variation = rtt_ms / 2;
+                _has_rtt = true;
+                return;
+            }
+            _rtt_variation = 0.75 * _rtt_variation + 0.25 * std::abs(_smoothed_rtt - rtt_ms);
+            _smoothed_rtt = 0.875 * _smoothed_rtt + 0.125 * rtt_ms;
+        }
+
+        std::chrono::milliseconds _timeoutLocked() const {
+            double timeout = _has_rtt ? _smoothed_rtt + 4 * _rtt_variation : _config.initial_timeout_ms;
+            timeout = std::clamp(timeout, static_cast<double>(_config.min_timeout_ms),
+                                 static_cast<double>(_config.max_timeout_ms));
+            return std::chrono::milliseconds(static_cast<int>(timeout));
+        }
+
+        void _sendRequestList() {
+            auto request = _message_set.create("PARAM_REQUEST_LIST");
+            set(request, _list_target_system, _config.target_system);
+            set(request, _list_target_component, _config.target_component);
+            _connection->send(request);
+        }
+
+        void _sendRequestRead(int index) {
+            auto request = _message_set.create("PARAM_REQUEST_READ");
+            set(request, _read_target_system, _config.target_system);
+            set(request, _read_target_component, _config.target_component);
+            setString(request, _read_param_id, "");
+            set(request, _read_param_index, index);
+            _connection->send(request);
+        }
+
+        /*
+         * Picks missing indices to re-request: the ones never requested, and the ones whose request timed out.
+         */
+        std::vector<int> _collectRerequestsLocked(Clock::time_point now) {
+            std::vector<int> indices;
+            auto timeout = _timeoutLocked();
+            for (auto it = _in_flight.begin(); it != _in_flight.end();) {
+                if (now - it->second >= timeout) {
+                    indices.push_back(it->first);
+                    it = _in_flight.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            for (int index = 0; index < _count &&
+                    static_cast<int>(_in_flight.size() + indices.size()) < _config.window; index++) {
+                if (!_isReceived(index) && _in_flight.find(index) == _in_flight.end() &&
+                    std::find(indices.begin(), indices.end(), index) == indices.end()) {
+                    indices.push_back(index);
+                }
+            }
+            if (static_cast<int>(indices.size()) > _config.window) {
+                indices.resize(_config.window);
+            }
+            for (int index : indices) {
+                _in_flight[index] = now;
+            }
+            return indices;
+        }
+
+    public:
+        ParameterClient(const mav::MessageSet &message_set, std::shared_ptr<mav::Connection> connection,
+                        const ParameterClientConfig &config = {}) :
+                _message_set(message_set), _connection(std::move(connection)), _config(config),
+                _value_id(field(message_set, "PARAM_VALUE", "param_id")),
+                _value_value(field(message_set, "PARAM_VALUE", "param_value")),
+                _value_type(field(message_set, "PARAM_VALUE", "param_type")),
+                _value_count(field(message_set, "PARAM_VALUE", "param_count")),
+                _value_index(field(message_set, "PARAM_VALUE", "param_index")),
+                _list_target_system(field(message_set, "PARAM_REQUEST_LIST", "target_system")),
+                _list_target_component(field(message_set, "PARAM_REQUEST_LIST", "target_component")),
+                _read_target_system(field(message_set, "PARAM_REQUEST_READ", "target_system")),
+                _read_target_component(field(message_set, "PARAM_REQUEST_READ", "target_component")),
+                _read_param_id(field(message_set, "PARAM_REQUEST_READ", "param_id")),
+                _read_param_index(field(message_set, "PARAM_REQUEST_READ", "param_index")),
+                _param_value_id(message_set.idForMessage("PARAM_VALUE")) {
+            _callback_handle = _connection->addMessageCallback([this](const mav::Message &message) {
+                if (message.id() == _param_value_id) {
+                    _onParamValue(message);
+                }
+            });
+        }
+
+        ParameterClient(const ParameterClient&) = delete;
+        ParameterClient& operator=(const ParameterClient&) = delete;
+
+        ~ParameterClient() {
+            _connection->removeMessageCallback(_callback_handle);
+        }
+
+        /*
+         * Downloads the full parameter table. Returns true once every index has been received, false if the
+         * table is still incomplete after timeout_ms. Parameters received so far stay available either way,
+         * and a later call only fetches what is still missing.
+         */
+        bool fetchAll(int timeout_ms) {
+            auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_count < 0 || _received_count == 0) {
+                lock.unlock();
+                _sendRequestList();
+                lock.lock();
+                _last_progress = Clock::now();
+            }
+            // once the stream stalled, keep the request window full until the table is complete
+            bool filling_gaps = false;
+            while (_count < 0 || _received_count < _count) {
+                auto now = Clock::now();
+                if (now >= deadline) {
+                    return false;
+                }
+                auto timeout = _timeoutLocked();
+                if (_count < 0) {
+                    // nothing received yet, the list request or all answers got lost
+                    if (now - _last_progress >= timeout) {
+                        lock.unlock();
+                        _sendRequestList();
+                        lock.lock();
+                        _last_progress = Clock::now();
+                    }
+                } else if (filling_gaps || now - _last_progress >= timeout) {
+                    filling_gaps = true;
+                    auto indices = _collectRerequestsLocked(now);
+                    lock.unlock();
+                    for (int index : indices) {
+                        _sendRequestRead(index);
+                    }
+                    lock.lock();
+                }
+                _updated.wait_until(lock, std::min(deadline, Clock::now() + timeout / 4));
+            }
+            _in_flight.clear();
+            return true;
+        }
+
+        [[nodiscard]] bool complete() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _count >= 0 && _received_count == _count;
+        }
+
+        /*
+         * Number of parameters the component announced, or -1 if no PARAM_VALUE was received yet.
+         */
+        [[nodiscard]] int count() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _count;
+        }
+
+        [[nodiscard]] int receivedCount() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _received_count;
+        }
+
+        [[nodiscard]] std::optional<Parameter> get(const std::string &id) const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _index_by_id.find(id);
+            if (it == _index_by_id.end()) {
+                return std::nullopt;
+            }
+            return _parameters[it->second];
+        }
+
+        [[nodiscard]] std::optional<Parameter> at(int index) const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (index < 0 || index >= _count || !_isReceived(index)) {
+                return std::nullopt;
+            }
+            return _parameters[index];
+        }
+
+        /*
+         * Copy of all received parameters, ordered by index.
+         */
+        [[nodiscard]] std::vector<Parameter> parameters() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::vector<Parameter> result;
+            for (int index = 0; index < std::max(_count, 0); index++) {
+                if (_isReceived(index)) {
+                    result.push_back(_parameters[index]);
+                }
+            }
+            return result;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_PARAMETERCLIENT_H
@@ -0,0 +1,327 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_PEERTABLE_H
+#define LIBMAV_EXAMPLE_PEERTABLE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+#include <mav/Network.h>
+
+namespace example {
+
+    struct PeerTableConfig {
+        // Number of independently locked shards, rounded up to a power of two
+        int shards = 16;
+        // Peers not seen for this long are dropped by evictIdle(). Zero disables eviction.
+        std::chrono::milliseconds idle_timeout{60000};
+    };
+
+    struct PeerTableStats {
+        uint64_t peers = 0;
+        uint64_t inserted = 0;
+        uint64_t evicted = 0;
+    };
+
+    /*
+     * Packs a partner into a single integer: address, port and the uart flag.
+     */
+    inline uint64_t peerKey(const mav::ConnectionPartner &partner) {
+        return (static_cast<uint64_t>(partner.address()) << 17) |
+               (static_cast<uint64_t>(static_cast<uint16_t>(partner.port())) << 1) |
+               static_cast<uint64_t>(partner.isUart());
+    }
+
+    inline mav::ConnectionPartner peerFromKey(uint64_t key) {
+        return {static_cast<uint32_t>(key >> 17), static_cast<int>((key >> 1) & 0xFFFF), (key & 1) != 0};
+    }
+
+    /*
+     * Concurrent map from connection partners to a value, for servers with thousands of peers. Keys are the
+     * packed partner, spread over shards that each have their own lock, so lookups for different peers rarely
+     * contend. A receive loop passes a LastHit cache, so that runs of frames from the same peer do not take a
+     * lock at all.
+     *
+     * Every lookup through a LastHit refreshes the peer, evictIdle() drops the ones that were not refreshed
+     * within the idle timeout, which keeps the table bounded when peers come and go.
+     */
+    template <typename V>
+    class PeerTable {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Entry {
+            const V value;
+            std::atomic<int64_t> last_seen;
+            std::atomic_bool removed{false};
+
+            Entry(V value_, int64_t now) : value(std::move(value_)), last_seen(now) {}
+        };
+
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            std::unordered_map<uint64_t, std::shared_ptr<Entry>> peers;
+        };
+
+        PeerTableConfig _config;
+        std::unique_ptr<Shard[]> _shards;
+        uint64_t _shard_mask;
+        std::atomic<uint64_t> _size{0};
+        std::atomic<uint64_t> _inserted{0};
+        std::atomic<uint64_t> _evicted{0};
+        std::atomic<int64_t> _last_sweep{0};
+
+        static int64_t _now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        }
+
+        static size_t _roundUp(int shards) {
+            size_t size = 1;
+            while (size < static_cast<size_t>(shards)) {
+                size <<= 1;
+            }
+            return size;
+        }
+
+        Shard& _shard(uint64_t key) const {
+            // multiplicative mix, consecutive ports of one address should not land in one shard
+            return _shards[((key * 0x9E3779B97F4A7C15ull) >> 40) & _shard_mask];
+        }
+
+        void _remove(Shard &shard, typename std::unordered_map<uint64_t, std::shared_ptr<Entry>>::iterator it) {
+            it->second->removed.store(true, std::memory_order_relaxed);
+            shard.peers.erase(it);
+            _size.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        template <typename Predicate>
+        size_t _eraseEntries(Predicate predicate) {
+            size_t removed = 0;
+            for (size_t i = 0; i <= _shard_mask; i++) {
+                auto &shard = _shards[i];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                for (auto it = shard.peers.begin(); it != shard.peers.end();) {
+                    auto next = std::next(it);
+                    if (predicate(it->first, *it->second)) {
+                        _remove(shard, it);
+                        removed++;
+                    }
+                    it = next;
+                }
+            }
+            return removed;
+        }
+
+    public:
+        /*
+         * Remembers the entry of the last lookup. Owned by a single thread, and only valid for the table it
+         * was used with.
+         */
+        class LastHit {
+        private:
+            friend class PeerTable;
+            uint64_t _key = 0;
+            std::shared_ptr<Entry> _entry;
+
+        public:
+            void reset() {
+                _entry.reset();
+            }
+        };
+
+        explicit PeerTable(const PeerTableConfig &config = {}) : _config(config),
+            _shards(new Shard[_roundUp(config.shards)]), _shard_mask(_roundUp(config.shards) - 1) {}
+
+        PeerTable(const PeerTable&) = delete;
+        PeerTable& operator=(const PeerTable&) = delete;
+
+        /*
+         * Looks up a peer without refreshing it, e.g. to route a send.
+         */
+        std::optional<V> find(const mav::ConnectionPartner &partner) const {
+            auto key = peerKey(partner);
+            auto &shard = _shard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.peers.find(key);
+            if (it == shard.peers.end()) {
+                return std::nullopt;
+            }
+            return it->second->value;
+        }
+
+        /*
+         * Looks up and refreshes a peer, on the receive path.
+         */
+        std::optional<V> find(LastHit &cache, const mav::ConnectionPartner &partner) {
+            auto key = peerKey(partner);
+            auto now = _now();
+            if (cache._entry && cache._key == key && !cache._entry->removed.load(std::memory_order_relaxed)) {
+                cache._entry->last_seen.store(now, std::memory_order_relaxed);
+                return cache._entry->value;
+            }
+            auto &shard = _shard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.peers.find(key);
+            if (it == shard.peers.end()) {
+                cache._entry.reset();
+                return std::nullopt;
+            }
+            it->second->last_seen.store(now, std::memory_order_relaxed);
+            cache._key = key;
+            cache._entry = it->second;
+            return it->second->value;
+        }
+
+        /*
+         * Records that partner was seen with value, replacing a different value. Returns true for a new peer.
+         */
+        bool seen(LastHit &cache, const mav::ConnectionPartner &partner, const V &value) {
+            auto key = peerKey(partner);
+            auto now = _now();
+            if (cache._entry && cache._key == key && !cache._entry->removed.load(std::memory_order_relaxed) &&
+                    cache._entry->value == value) {
+                cache._entry->last_seen.store(now, std::memory_order_relaxed);
+                return false;
+            }
+            auto &shard = _shard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto &entry = shard.peers[key];
+            bool inserted = !entry;
+            if (entry && entry->value == value) {
+                entry->last_seen.store(now, std::memory_order_relaxed);
+            } else {
+                if (entry) {
+                    entry->removed.store(true, std::memory_order_relaxed);
+                } else {
+                    _size.fetch_add(1, std::memory_order_relaxed);
+                    _inserted.fetch_add(1, std::memory_order_relaxed);
+                }
+                entry = std::make_shared<Entry>(value, now);
+            }
+            cache._key = key;
+            cache._entry = entry;
+            return inserted;
+        }
+
+        bool erase(const mav::ConnectionPartner &partner) {
+            auto key = peerKey(partner);
+            auto &shard = _shard(key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.peers.find(key);
+            if (it == shard.peers.end()) {
+                return false;
+            }
+            _remove(shard, it);
+            return true;
+        }
+
+        /*
+         * Removes all peers for which predicate(partner, value) is true. Returns the number removed.
+         */
+        template <typename Predicate>
+        size_t eraseIf(Predicate predicate) {
+            return _eraseEntries([&predicate](uint64_t key, const Entry &entry) {
+                return predicate(peerFromKey(key), entry.value);
+            });
+        }
+
+        /*
+         * Drops peers that were not refreshed within the idle timeout, calling on_evict(partner, value) for each,
+         * with the shard lock held. Returns the number dropped.
+         */
+        template <typename OnEvict>
+        size_t evictIdle(OnEvict on_evict) {
+            if (_config.idle_timeout.count() <= 0) {
+                return 0;
+            }
+            auto now = _now();
+            _last_sweep.store(now, std::memory_order_relaxed);
+            auto deadline = now - std::chrono::duration_cast<std::chrono::nanoseconds>(_config.idle_timeout).count();
+            auto evicted = _eraseEntries([deadline, &on_evict](uint64_t key, const Entry &entry) {
+                if (entry.last_seen.load(std::memory_order_relaxed) >= deadline) {
+                    return false;
+                }
+                on_evict(peerFromKey(key), entry.value);
+                return true;
+            });
+            _evicted.fetch_add(evicted, std::memory_order_relaxed);
+            return evicted;
+        }
+
+        size_t evictIdle() {
+            return evictIdle([](const mav::ConnectionPartner&, const V&) {});
+        }
+
+        /*
+         * Runs evictIdle() if the last sweep is more than a quarter of the idle timeout ago, so it can be called
+         * from a receive loop on every wakeup.
+         */
+        template <typename OnEvict>
+        size_t maybeEvictIdle(OnEvict on_evict) {
+            auto interval = std::chrono::duration_cast<std::chrono::nanoseconds>(_config.idle_timeout).count() / 4;
+            if (interval <= 0 || _now() - _last_sweep.load(std::memory_order_relaxed) < interval) {
+                return 0;
+            }
+            return evictIdle(on_evict);
+        }
+
+        size_t maybeEvictIdle() {
+            return maybeEvictIdle([](const mav::ConnectionPartner&, const V&) {});
+        }
+
+        void clear() {
+            eraseIf([](const mav::ConnectionPartner&, const V&) { return true; });
+        }
+
+        [[nodiscard]] size_t size() const {
+            return _size.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] PeerTableStats stats() const {
+            return {_size.load(std::memory_order_relaxed), _inserted.load(std::memory_order_relaxed),
+                    _evicted.load(std::memory_order_relaxed)};
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_PEERTABLE_H
@@ -0,0 +1,366 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_PERIODICSCHEDULER_H
+#define LIBMAV_EXAMPLE_PERIODICSCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+namespace example {
+
+    struct PeriodicSchedulerConfig {
+        // Timer resolution. Periods are rounded to whole ticks, with a minimum of one tick.
+        std::chrono::milliseconds tick{10};
+        // Slots of the timer wheel. Periods longer than wheel_size ticks take extra rounds.
+        int wheel_size = 512;
+    };
+
+    /*
+     * Sends heartbeats and other periodic messages, each at its own rate, from a single thread. Streams are
+     * kept in a hashed timer wheel, so a tick only touches the streams that are due. All streams due in the
+     * same tick are sent together, between the begin / flush hooks set with setBatching(), which lets a
+     * batching interface (see BatchedUDP.h) push them out with one syscall.
+     *
+     * To have the scheduler send the heartbeat, construct the NetworkRuntime without one and add it here:
+     *
+     *      PeriodicScheduler scheduler;
+     *      scheduler.attach(runtime);
+     *      scheduler.add(own_heartbeat, std::chrono::seconds(1));
+     *      scheduler.add(attitude, std::chrono::milliseconds(20), [](mav::Message &message) { ... });
+     */
+    class PeriodicScheduler {
+    public:
+        using StreamId = uint64_t;
+        // Called on the scheduler thread right before each send, to bring the message up to date
+        using Prepare = std::function<void(mav::Message &message)>;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        struct Stream {
+            StreamId id;
+            std::optional<mav::Message> message;
+            Prepare prepare;
+            // empty for streams sent to every connection
+            std::weak_ptr<mav::Connection> target;
+            bool targeted = false;
+            int64_t period_ticks;
+            int64_t rounds = 0;
+            bool removed = false;
+        };
+
+        PeriodicSchedulerConfig _config;
+        std::mutex _mutex;
+        std::condition_variable _wakeup;
+        std::vector<std::vector<Stream*>> _wheel;
+        std::vector<Stream*> _slot_scratch;
+        std::unordered_map<StreamId, std::unique_ptr<Stream>> _streams;
+        std::vector<std::weak_ptr<mav::Connection>> _connections;
+        std::function<void()> _begin_batch;
+        std::function<void()> _flush_batch;
+        StreamId _next_id = 1;
+        int64_t _current_tick = 0;
+        bool _should_terminate = false;
+        std::thread _worker;
+
+        int64_t _toTicks(std::chrono::milliseconds period) const {
+            return std::max<int64_t>(1, (period.count() + _config.tick.count() / 2) / _config.tick.count());
+        }
+
+        void _schedule(Stream *stream, int64_t delay_ticks) {
+            auto slot = (_current_tick + delay_ticks) % _config.wheel_size;
+            stream->rounds = (delay_ticks - 1) / _config.wheel_size;
+            _wheel[slot].push_back(stream);
+        }
+
+        // Collects the streams due in the current tick and reschedules them. Called with the mutex held.
+        void _collectDue(std::vector<std::pair<mav::Message, Stream*>> &due) {
+            auto &slot = _wheel[_current_tick % _config.wheel_size];
+            _slot_scratch.swap(slot);
+            for (auto *stream : _slot_scratch) {
+                if (stream->removed) {
+                    _streams.erase(stream->id);
+                    continue;
+                }
+                if (stream->rounds > 0) {
+                    stream->rounds--;
+                    slot.push_back(stream);
+                    continue;
+                }
+                if (stream->targeted) {
+                    auto target = stream->target.lock();
+                    if (!target || !target->alive()) {
+                        // the target connection is gone, and with it the stream
+                        _streams.erase(stream->id);
+                        continue;
+                    }
+                }
+                due.emplace_back(*stream->message, stream);
+                _schedule(stream, stream->period_ticks);
+            }
+            _slot_scratch.clear();
+        }
+
+        void _send(mav::Message &message, const std::shared_ptr<mav::Connection> &connection) {
+            try {
+                connection->send(message);
+            } catch (const std::exception&) {
+                // a failing connection is dropped once the runtime notices it is gone
+            }
+        }
+
+        struct Dispatch {
+            Prepare prepare;
+            std::shared_ptr<mav::Connection> target;
+            bool targeted;
+        };
+
+        void _workerLoop() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto next_tick = Clock::now() + _config.tick;
+            std::vector<std::pair<mav::Message, Stream*>> due;
+            std::vector<Dispatch> dispatch;
+            std::vector<std::shared_ptr<mav::Connection>> connections;
+
+            while (!_should_terminate) {
+                if (_wakeup.wait_until(lock, next_tick, [this] { return _should_terminate; })) {
+                    break;
+                }
+                // process every tick that elapsed, in case sending took longer than a tick
+                auto now = Clock::now();
+                due.clear();
+                while (next_tick <= now) {
+                    _current_tick++;
+                    _collectDue(due);
+                    next_tick += _config.tick;
+                }
+                if (due.empty()) {
+                    continue;
+                }
+
+                // snapshot everything needed for sending, so that no lock is held while sending
+                dispatch.clear();
+                for (const auto &[message, stream] : due) {
+                    dispatch.push_back({stream->prepare, stream->target.lock(), stream->targeted});
+                }
+                connections.clear();
+                _connections.erase(std::remove_if(_connections.begin(), _connections.end(),
+                    [&connections](const std::weak_ptr<mav::Connection> &weak) {
+                        auto connection = weak.lock();
+                        if (!connection || !connection->alive()) {
+                            return true;
+                        }
+                        connections.push_back(std::move(connection));
+                        return false;
+                    }), _connections.end());
+                auto begin_batch = _begin_batch;
+                auto flush_batch = _flush_batch;
+
+                lock.unlock();
+                if (begin_batch) {
+                    try {
+                        begin_batch();
+                    } catch (const std::exception&) {
+                        // the sends still go out, just not batched
+                    }
+                }
+                for (size_t i = 0; i < due.size(); i++) {
+                    auto &message = due[i].first;
+                    auto &[prepare, target, targeted] = dispatch[i];
+                    if (prepare) {
+                        try {
+                            prepare(message);
+                        } catch (const std::exception&) {
+                            // skip this send, the stream stays scheduled
+                            continue;
+                        }
+                    }
+                    if (targeted) {
+                        // a target that expired since the snapshot gets nothing, not a broadcast
+                        if (target) {
+                            _send(message, target);
+                        }
+                        continue;
+                    }
+                    for (const auto &connection : connections) {
+                        _send(message, connection);
+                    }
+                }
+                if (flush_batch) {
+                    try {
+                        flush_batch();
+                    } catch (const std::exception&) {
+                        // same as a failed send, the next tick tries again
+                    }
+                }
+                lock.lock();
+            }
+        }
+
+    public:
+        explicit PeriodicScheduler(const PeriodicSchedulerConfig &config = {}) : _config(config) {
+            _config.tick = std::max(_config.tick, std::chrono::milliseconds(1));
+            _config.wheel_size = std::max(1, _config.wheel_size);
+            _wheel.resize(_config.wheel_size);
+            _worker = std::thread{&PeriodicScheduler::_workerLoop, this};
+        }
+
+        PeriodicScheduler(const PeriodicScheduler&) = delete;
+        PeriodicScheduler& operator=(const PeriodicScheduler&) = delete;
+
+        ~PeriodicScheduler() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _should_terminate = true;
+            }
+            _wakeup.notify_one();
+            _worker.join();
+        }
+
+        /*
+         * Sends stream messages to every connection the runtime establishes from now on.
+         */
+        void attach(mav::NetworkRuntime &runtime) {
+            runtime.onConnection([this](const std::shared_ptr<mav::Connection> &connection) {
+                addConnection(connection);
+            });
+        }
+
+        /*
+         * Adds a connection that untargeted streams are sent to. Connections are dropped by the scheduler
+         * once they are no longer alive.
+         */
+        void addConnection(const std::shared_ptr<mav::Connection> &connection) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _connections.push_back(connection);
+        }
+
+        /*
+         * Hooks run before and after the sends of a tick, e.g. beginSendBatch() / flushSendBatch() of a
+         * BatchedUDPServer.
+         */
+        void setBatching(std::function<void()> begin_batch, std::function<void()> flush_batch) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _begin_batch = std::move(begin_batch);
+            _flush_batch = std::move(flush_batch);
+        }
+
+        /*
+         * Starts sending the message every period, to all connections or only to target. The first send
+         * happens one period from now. The scheduler keeps its own copy of the message; prepare gets to
+         * update a copy of it before each send. If prepare throws, that send is skipped. A targeted stream
+         * is removed once its target connection is no longer alive.
+         */
+        StreamId add(const mav::Message &message, std::chrono::milliseconds period, Prepare prepare = {},
+                     const std::shared_ptr<mav::Connection> &target = nullptr) {
+            auto stream = std::make_unique<Stream>();
+            stream->message.emplace(message);
+            stream->prepare = std::move(prepare);
+            stream->target = target;
+            stream->targeted = target != nullptr;
+            stream->period_ticks = _toTicks(period);
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto id = _next_id++;
+            stream->id = id;
+            _schedule(stream.get(), stream->period_ticks);
+            _streams.emplace(id, std::move(stream));
+            return id;
+        }
+
+        /*
+         * Replaces the message of a stream, e.g. to change the heartbeat's system status.
+         * Returns false if the stream does not exist.
+         */
+        bool update(StreamId id, const mav::Message &message) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _streams.find(id);
+            if (it == _streams.end() || it->second->removed) {
+                return false;
+            }
+            it->second->message.emplace(message);
+            return true;
+        }
+
+        /*
+         * Changes the period of a stream, taking effect after its next send.
+         */
+        bool setPeriod(StreamId id, std::chrono::milliseconds period) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _streams.find(id);
+            if (it == _streams.end() || it->second->removed) {
+                return false;
+            }
+            it->second->period_ticks = _toTicks(period);
+            return true;
+        }
+
+        /*
+         * Stops a stream. A send already underway on the scheduler thread may still complete.
+         */
+        bool remove(StreamId id) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _streams.find(id);
+            if (it == _streams.end() || it->second->removed) {
+                return false;
+            }
+            // the wheel still points to the stream, it is freed when its slot comes up
+            it->second->removed = true;
+            return true;
+        }
+
+        [[nodiscard]] size_t streamCount() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return static_cast<size_t>(std::count_if(_streams.begin(), _streams.end(),
+                [](const auto &entry) { return !entry.second->removed; }));
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_PERIODICSCHEDULER_H
@@ -0,0 +1,332 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_ROUTER_H
+#define LIBMAV_EXAMPLE_ROUTER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/FieldHandle.h>
+#include <example/Frame.h>
+#include <example/FrameReader.h>
+
+namespace example {
+
+    struct RouterStats {
+        uint64_t received = 0;
+        // Number of frame copies sent, a broadcast counts once per destination
+        uint64_t forwarded = 0;
+        // Frames with a target system / component that has not been seen on any link
+        uint64_t unroutable = 0;
+        uint64_t send_errors = 0;
+    };
+
+    struct RouterConfig {
+        // Forward frames of messages outside the loaded dialect, framed by their header alone since their
+        // checksum can not be verified. Off, such frames are dropped like libmav's own parser does. Only
+        // turn this on for links without noise, a false magic byte would be forwarded as a frame.
+        bool forward_unknown = false;
+    };
+
+    /*
+     * Forwards raw frames between interfaces, without decoding them into messages and re-finalizing them.
+     * Every link gets a reader thread that pulls checksum-verified frames (see FrameReader) and writes
+     * their bytes unchanged to the destination interfaces. Frames of unknown messages are dropped,
+     * unless RouterConfig::forward_unknown is on.
+     *
+     * Routing follows the MAVLink routing rules: the router learns on which link (and from which partner)
+     * each system / component is heard. Messages with a target_system / target_component field go only to
+     * where that target was seen, messages without a target or with target system 0 go everywhere, but
+     * never back to where they came from. Target fields are resolved per message id on first sight.
+     */
+    class Router {
+    public:
+        /*
+         * Called for every copy of a frame before it is sent to the link with index destination, e.g. to
+         * re-sign it. The frame can be modified in place, the buffer holds MAX_FRAME_SIZE bytes. Returns the
+         * new frame length, or 0 to not send this copy.
+         */
+        using Transform = std::function<int(uint8_t *frame, int length, size_t destination)>;
+
+    private:
+        struct Endpoint {
+            size_t link;
+            mav::ConnectionPartner partner;
+
+            bool operator==(const Endpoint &other) const {
+                return link == other.link && partner == other.partner;
+            }
+        };
+
+        struct TargetFields {
+            int system_offset = -1;
+            int component_offset = -1;
+        };
+
+        struct Link {
+            mav::NetworkInterface *interface;
+            std::thread thread;
+            // only used by the thread forwarding frames from this link
+            std::unordered_map<uint32_t, TargetFields> targets;
+            std::vector<Endpoint> destinations;
+            std::array<uint8_t, MAX_FRAME_SIZE> scratch{};
+        };
+
+        const mav::MessageSet &_message_set;
+        RouterConfig _config;
+        std::vector<std::unique_ptr<Link>> _links;
+        Transform _transform;
+        bool _started = false;
+
+        std::shared_mutex _routes_mutex;
+        // keyed by system id << 8 | component id
+        std::map<uint16_t, Endpoint> _components;
+        std::vector<Endpoint> _endpoints;
+
+        std::atomic<uint64_t> _received{0};
+        std::atomic<uint64_t> _forwarded{0};
+        std::atomic<uint64_t> _unroutable{0};
+        std::atomic<uint64_t> _send_errors{0};
+
+        const TargetFields& _targetFields(Link &link, uint32_t message_id) {
+            auto it = link.targets.find(message_id);
+            if (it != link.targets.end()) {
+                return it->second;
+            }
+            TargetFields fields;
+            auto definition = _message_set.getMessageDefinition(static_cast<int>(message_id));
+            if (!definition.has_value()) {
+                // not cached, unknown ids may be anything up to 2^24 on a noisy link
+                static const TargetFields no_targets;
+                return no_targets;
+            }
+            if (definition.get().containsField("target_system")) {
+                fields.system_offset = field(definition.get(), "target_system").offset;
+            }
+            if (definition.get().containsField("target_component")) {
+                fields.component_offset = field(definition.get(), "target_component").offset;
+            }
+            return link.targets.emplace(message_id, fields).first->second;
+        }
+
+        void _learn(const Endpoint &source, uint16_t component_key) {
+            {
+                std::shared_lock<std::shared_mutex> lock(_routes_mutex);
+                auto it = _components.find(component_key);
+                if (it != _components.end() && it->second == source) {
+                    return;
+                }
+            }
+            std::unique_lock<std::shared_mutex> lock(_routes_mutex);
+            _components[component_key] = source;
+            if (std::find(_endpoints.begin(), _endpoints.end(), source) == _endpoints.end()) {
+                _endpoints.push_back(source);
+            }
+        }
+
+        void _readLoop(size_t index) {
+            auto &link = *_links[index];
+            FrameReader reader(_message_set, *link.interface);
+            reader.setKeepUnknown(_config.forward_unknown);
+            std::array<uint8_t, MAX_FRAME_SIZE> frame{};
+            mav::ConnectionPartner partner;
+            try {
+                while (true) {
+                    int length = reader.read(frame.data(), partner);
+                    forward(frame.data(), length, index, partner);
+                }
+            } catch (const std::exception&) {
+                // the interface was closed
+            }
+        }
+
+    public:
+        explicit Router(const mav::MessageSet &message_set, const RouterConfig &config = {}) :
+            _message_set(message_set), _config(config) {}
+
+        Router(const Router&) = delete;
+        Router& operator=(const Router&) = delete;
+
+        ~Router() {
+            stop();
+        }
+
+        /*
+         * Adds a link and returns its index. All links have to be added before start().
+         */
+        size_t addLink(mav::NetworkInterface &interface) {
+            if (_started) {
+                throw std::logic_error("Links can not be added to a running router");
+            }
+            auto link = std::make_unique<Link>();
+            link->interface = &interface;
+            _links.push_back(std::move(link));
+            return _links.size() - 1;
+        }
+
+        /*
+         * Sets a transform applied to every outgoing copy. Must be set before start().
+         */
+        void setTransform(Transform transform) {
+            _transform = std::move(transform);
+        }
+
+        void start() {
+            if (_started) {
+                return;
+            }
+            _started = true;
+            for (size_t i = 0; i < _links.size(); i++) {
+                _links[i]->thread = std::thread{&Router::_readLoop, this, i};
+            }
+        }
+
+        /*
+         * Closes all links and joins the reader threads.
+         */
+        void stop() {
+            for (auto &link : _links) {
+                link->interface->close();
+            }
+            for (auto &link : _links) {
+                if (link->thread.joinable()) {
+                    link->thread.join();
+                }
+            }
+        }
+
+        /*
+         * Routes a complete frame that was received on link source_link from partner. This is what
+         * the reader threads do; it is public for frames obtained elsewhere, e.g. from a local component.
+         * Must not be called concurrently for the same source link.
+         */
+        void forward(const uint8_t *frame, int length, size_t source_link, const mav::ConnectionPartner &partner) {
+            _received.fetch_add(1, std::memory_order_relaxed);
+            auto &link = *_links[source_link];
+            FrameView view{frame, length};
+            auto header = view.header();
+            Endpoint source{source_link, partner};
+            _learn(source, static_cast<uint16_t>(header.systemId() << 8 | header.componentId()));
+
+            const auto &targets = _targetFields(link, header.messageId());
+            int target_system = 0;
+            int target_component = 0;
+            if (targets.system_offset >= 0) {
+                uint8_t value;
+                view.readPayload(&value, targets.system_offset, 1);
+                target_system = value;
+            }
+            if (targets.component_offset >= 0) {
+                uint8_t value;
+                view.readPayload(&value, targets.component_offset, 1);
+                target_component = value;
+            }
+
+            auto &destinations = link.destinations;
+            destinations.clear();
+            {
+                std::shared_lock<std::shared_mutex> lock(_routes_mutex);
+                if (target_system == 0) {
+                    for (const auto &endpoint : _endpoints) {
+                        if (!(endpoint == source)) {
+                            destinations.push_back(endpoint);
+                        }
+                    }
+                } else {
+                    auto begin = _components.lower_bound(static_cast<uint16_t>(target_system << 8));
+                    auto end = _components.upper_bound(static_cast<uint16_t>(target_system << 8 | 0xFF));
+                    for (auto it = begin; it != end; ++it) {
+                        int component = it->first & 0xFF;
+                        if ((target_component != 0 && component != target_component) || it->second == source ||
+                            std::find(destinations.begin(), destinations.end(), it->second) != destinations.end()) {
+                            continue;
+                        }
+                        destinations.push_back(it->second);
+                    }
+                    if (destinations.empty()) {
+                        _unroutable.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            for (const auto &destination : destinations) {
+                const uint8_t *data = frame;
+                int data_length = length;
+                if (_transform) {
+                    std::memcpy(link.scratch.data(), frame, length);
+                    data_length = _transform(link.scratch.data(), length, destination.link);
+                    if (data_length <= 0) {
+                        continue;
+                    }
+                    data = link.scratch.data();
+                }
+                try {
+                    _links[destination.link]->interface->send(data, static_cast<uint32_t>(data_length),
+                                                              destination.partner);
+                    _forwarded.fetch_add(1, std::memory_order_relaxed);
+                } catch (const std::exception&) {
+                    _send_errors.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        [[nodiscard]] RouterStats stats() const {
+            RouterStats stats;
+            stats.received = _received.load(std::memory_order_relaxed);
+            stats.forwarded = _forwarded.load(std::memory_order_relaxed);
+            stats.unroutable = _unroutable.load(std::memory_order_relaxed);
+            stats.send_errors = _send_errors.load(std::memory_order_relaxed);
+            return stats;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_ROUTER_H
@@ -0,0 +1,309 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_SENDQUEUE_H
+#define LIBMAV_EXAMPLE_SENDQUEUE_H
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <mav/Network.h>
+
+#include <example/Frame.h>
+
+namespace example {
+
+    enum class SendPriority : int {
+        HIGH = 0,
+        NORMAL = 1,
+        BULK = 2
+    };
+
+    enum class OverflowPolicy {
+        // send() waits until the queue has room
+        BLOCK,
+        // the frame being sent is dropped
+        DROP_NEWEST,
+        // the oldest queued frame of the same priority is dropped to make room
+        DROP_OLDEST
+    };
+
+    struct SendQueueConfig {
+        // Capacity in frames, per priority class
+        int capacity = 256;
+        OverflowPolicy policy = OverflowPolicy::DROP_OLDEST;
+        // Consecutive frames to the same partner are joined into one write of up to this many bytes.
+        // Only enable for transports that accept several frames per write, e.g. serial or TCP.
+        int max_coalesce_bytes = 0;
+    };
+
+    struct SendQueueStats {
+        static constexpr int CLASSES = 3;
+        std::array<uint64_t, CLASSES> depth{};
+        std::array<uint64_t, CLASSES> max_depth{};
+        std::array<uint64_t, CLASSES> enqueued{};
+        std::array<uint64_t, CLASSES> dropped{};
+        uint64_t writes = 0;
+        uint64_t frames_sent = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t send_errors = 0;
+    };
+
+    /*
+     * Decorator that makes send() non-blocking: frames are queued, and a sender thread writes them to the
+     * wrapped interface, highest priority first. Priorities are assigned per message id with setPriority(),
+     * everything else is NORMAL. This keeps e.g. a control loop calling Connection::send() from stalling on
+     * a slow serial link, and lets commands overtake bulk telemetry queued in front of them.
+     *
+     *      QueuedInterface queued(serial, {256, OverflowPolicy::DROP_OLDEST, 512});
+     *      queued.setPriority(message_set.idForMessage("COMMAND_LONG"), SendPriority::HIGH);
+     *      mav::NetworkRuntime net{message_set, own_heartbeat, queued};
+     */
+    class QueuedInterface : public mav::NetworkInterface {
+    private:
+        static constexpr int CLASSES = SendQueueStats::CLASSES;
+
+        struct QueuedFrame {
+            mav::ConnectionPartner partner;
+            int length = 0;
+            std::array<uint8_t, MAX_FRAME_SIZE> data{};
+        };
+
+        // Fixed capacity ring, so queueing never allocates
+        struct Ring {
+            std::vector<QueuedFrame> frames;
+            size_t head = 0;
+            size_t size = 0;
+
+            QueuedFrame& front() { return frames[head]; }
+            QueuedFrame& pushBack() { return frames[(head + size++) % frames.size()]; }
+            void popFront() { head = (head + 1) % frames.size(); size--; }
+        };
+
+        mav::NetworkInterface &_interface;
+        SendQueueConfig _config;
+
+        mutable std::mutex _mutex;
+        mutable std::condition_variable _not_empty;
+        mutable std::condition_variable _not_full;
+        mutable std::condition_variable _drained;
+        std::array<Ring, CLASSES> _queues;
+        std::unordered_map<uint32_t, SendPriority> _priorities;
+        SendQueueStats _stats;
+        bool _writing = false;
+        mutable bool _should_terminate = false;
+        std::thread _sender;
+
+        bool _empty() const {
+            return std::all_of(_queues.begin(), _queues.end(), [](const Ring &ring) { return ring.size == 0; });
+        }
+
+        Ring* _highest() {
+            for (auto &ring : _queues) {
+                if (ring.size > 0) {
+                    return &ring;
+                }
+            }
+            return nullptr;
+        }
+
+        void _senderLoop() {
+            std::vector<uint8_t> buffer(std::max<size_t>(MAX_FRAME_SIZE, _config.max_coalesce_bytes));
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (true) {
+                _not_empty.wait(lock, [this] { return _should_terminate || !_empty(); });
+                if (_should_terminate) {
+                    return;
+                }
+                // take the first frame, then keep joining frames for the same partner while they fit
+                auto *ring = _highest();
+                auto partner = ring->front().partner;
+                size_t length = 0;
+                uint64_t frames = 0;
+                do {
+                    auto &frame = ring->front();
+                    std::memcpy(buffer.data() + length, frame.data.data(), frame.length);
+                    length += frame.length;
+                    frames++;
+                    ring->popFront();
+                    ring = _highest();
+                } while (ring && ring->front().partner == partner &&
+                         length + ring->front().length <= static_cast<size_t>(_config.max_coalesce_bytes));
+                _writing = true;
+                _not_full.notify_all();
+
+                lock.unlock();
+                bool failed = false;
+                try {
+                    _interface.send(buffer.data(), static_cast<uint32_t>(length), partner);
+                } catch (const std::exception&) {
+                    failed = true;
+                }
+                lock.lock();
+
+                _writing = false;
+                _stats.writes++;
+                if (failed) {
+                    _stats.send_errors++;
+                } else {
+                    _stats.frames_sent += frames;
+                    _stats.bytes_sent += length;
+                }
+                if (_empty()) {
+                    _drained.notify_all();
+                }
+            }
+        }
+
+    public:
+        explicit QueuedInterface(mav::NetworkInterface &interface, const SendQueueConfig &config = {}) :
+                _interface(interface), _config(config) {
+            _config.capacity = std::max(1, _config.capacity);
+            for (auto &ring : _queues) {
+                ring.frames.resize(_config.capacity);
+            }
+            _sender = std::thread{&QueuedInterface::_senderLoop, this};
+        }
+
+        QueuedInterface(const QueuedInterface&) = delete;
+        QueuedInterface& operator=(const QueuedInterface&) = delete;
+
+        ~QueuedInterface() override {
+            close();
+            _sender.join();
+        }
+
+        void setPriority(uint32_t message_id, SendPriority priority) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _priorities[message_id] = priority;
+        }
+
+        /*
+         * Blocks until every frame queued so far has been written.
+         */
+        void flush() {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _drained.wait(lock, [this] { return _should_terminate || (_empty() && !_writing); });
+        }
+
+        [[nodiscard]] SendQueueStats stats() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto stats = _stats;
+            for (int i = 0; i < CLASSES; i++) {
+                stats.depth[i] = _queues[i].size;
+            }
+            return stats;
+        }
+
+        /*
+         * Stops the sender, dropping whatever is still queued, and closes the wrapped interface.
+         */
+        void close() const override {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_should_terminate) {
+                    return;
+                }
+                _should_terminate = true;
+            }
+            _not_empty.notify_all();
+            _not_full.notify_all();
+            _drained.notify_all();
+            _interface.close();
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return _interface.isConnectionOpen();
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            if (size > static_cast<uint32_t>(MAX_FRAME_SIZE)) {
+                throw mav::NetworkError("Frame exceeds MAX_FRAME_SIZE", EMSGSIZE);
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto priority = SendPriority::NORMAL;
+            if (!_priorities.empty() && size >= static_cast<uint32_t>(HEADER_SIZE_V1)) {
+                auto it = _priorities.find(FrameHeader{data}.messageId());
+                if (it != _priorities.end()) {
+                    priority = it->second;
+                }
+            }
+            auto index = static_cast<int>(priority);
+            auto &ring = _queues[index];
+
+            if (ring.size == ring.frames.size()) {
+                if (_config.policy == OverflowPolicy::DROP_NEWEST) {
+                    _stats.dropped[index]++;
+                    return;
+                }
+                if (_config.policy == OverflowPolicy::DROP_OLDEST) {
+                    ring.popFront();
+                    _stats.dropped[index]++;
+                } else {
+                    _not_full.wait(lock, [this, &ring] { return _should_terminate || ring.size < ring.frames.size(); });
+                }
+            }
+            if (_should_terminate) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            auto &frame = ring.pushBack();
+            frame.partner = partner;
+            frame.length = static_cast<int>(size);
+            std::memcpy(frame.data.data(), data, size);
+            _stats.enqueued[index]++;
+            _stats.max_depth[index] = std::max<uint64_t>(_stats.max_depth[index], ring.size);
+            lock.unlock();
+            _not_empty.notify_one();
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            return _interface.receive(destination, size);
+        }
+
+        void markMessageBoundary() override {
+            _interface.markMessageBoundary();
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_SENDQUEUE_H
@@ -0,0 +1,275 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_SHA256_H
+#define LIBMAV_EXAMPLE_SHA256_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIBMAV_EXAMPLE_SHA256_X86 1
+#endif
+
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define LIBMAV_EXAMPLE_SHA256_ARM 1
+#endif
+
+namespace example {
+
+    namespace detail {
+
+        alignas(64) inline constexpr uint32_t SHA256_K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        inline uint32_t rotr(uint32_t value, int count) {
+            return (value >> count) | (value << (32 - count));
+        }
+
+        inline void sha256CompressGeneric(uint32_t state[8], const uint8_t *blocks, size_t count) {
+            for (; count > 0; count--, blocks += 64) {
+                uint32_t w[64];
+                for (int i = 0; i < 16; i++) {
+                    w[i] = (static_cast<uint32_t>(blocks[i * 4]) << 24) | (static_cast<uint32_t>(blocks[i * 4 + 1]) << 16) |
+                           (static_cast<uint32_t>(blocks[i * 4 + 2]) << 8) | static_cast<uint32_t>(blocks[i * 4 + 3]);
+                }
+                for (int i = 16; i < 64; i++) {
+                    uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                    uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+                }
+                uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+                uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+                for (int i = 0; i < 64; i++) {
+                    uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+                    uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                    h = g;
+                    g = f;
+                    f = e;
+                    e = d + t1;
+                    d = c;
+                    c = b;
+                    b = a;
+                    a = t1 + t2;
+                }
+                state[0] += a;
+                state[1] += b;
+                state[2] += c;
+                state[3] += d;
+                state[4] += e;
+                state[5] += f;
+                state[6] += g;
+                state[7] += h;
+            }
+        }
+
+#ifdef LIBMAV_EXAMPLE_SHA256_X86
+        /*
+         * SHA extensions (SHA-NI). Each sha256rnds2 runs two rounds; the message schedule is computed four
+         * words at a time with sha256msg1 / sha256msg2.
+         */
+        __attribute__((target("sha,sse4.1")))
+        inline void sha256CompressShaNi(uint32_t state[8], const uint8_t *blocks, size_t count) {
+            const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bll, 0x0405060700010203ll);
+            // the instructions want the state as ABEF / CDGH
+            __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+            __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+            tmp = _mm_shuffle_epi32(tmp, 0xB1);
+            state1 = _mm_shuffle_epi32(state1, 0x1B);
+            __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+            state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+            for (; count > 0; count--, blocks += 64) {
+                const __m128i abef_save = state0;
+                const __m128i cdgh_save = state1;
+                __m128i msg[4];
+                for (int i = 0; i < 4; i++) {
+                    msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i * 16)),
+                                              byte_swap);
+                }
+                for (int i = 0; i < 16; i++) {
+                    __m128i &current = msg[i & 3];
+                    __m128i words = _mm_add_epi32(current,
+                        _mm_load_si128(reinterpret_cast<const __m128i*>(&SHA256_K[i * 4])));
+                    if (i < 12) {
+                        // W[4i + 16 .. 4i + 19] replace W[4i .. 4i + 3], which are not needed any more
+                        current = _mm_add_epi32(_mm_sha256msg1_epu32(current, msg[(i + 1) & 3]),
+                                                _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4));
+                        current = _mm_sha256msg2_epu32(current, msg[(i + 3) & 3]);
+                    }
+                    state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+                    words = _mm_shuffle_epi32(words, 0x0E);
+                    state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+                }
+                state0 = _mm_add_epi32(state0, abef_save);
+                state1 = _mm_add_epi32(state1, cdgh_save);
+            }
+
+            tmp = _mm_shuffle_epi32(state0, 0x1B);
+            state1 = _mm_shuffle_epi32(state1, 0xB1);
+            state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+            state1 = _mm_alignr_epi8(state1, tmp, 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+        }
+#endif
+
+#ifdef LIBMAV_EXAMPLE_SHA256_ARM
+        /*
+         * ARMv8 cryptography extensions. Each sha256h / sha256h2 pair runs four rounds.
+         */
+        inline void sha256CompressArm(uint32_t state[8], const uint8_t *blocks, size_t count) {
+            uint32x4_t state0 = vld1q_u32(&state[0]);
+            uint32x4_t state1 = vld1q_u32(&state[4]);
+            for (; count > 0; count--, blocks += 64) {
+                const uint32x4_t abcd_save = state0;
+                const uint32x4_t efgh_save = state1;
+                uint32x4_t msg[4];
+                for (int i = 0; i < 4; i++) {
+                    msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + i * 16)));
+                }
+                for (int i = 0; i < 16; i++) {
+                    uint32x4_t &current = msg[i & 3];
+                    uint32x4_t words = vaddq_u32(current, vld1q_u32(&SHA256_K[i * 4]));
+                    if (i < 12) {
+                        // W[4i + 16 .. 4i + 19] replace W[4i .. 4i + 3], which are not needed any more
+                        current = vsha256su1q_u32(vsha256su0q_u32(current, msg[(i + 1) & 3]),
+                                                  msg[(i + 2) & 3], msg[(i + 3) & 3]);
+                    }
+                    uint32x4_t previous = state0;
+                    state0 = vsha256hq_u32(state0, state1, words);
+                    state1 = vsha256h2q_u32(state1, previous, words);
+                }
+                state0 = vaddq_u32(state0, abcd_save);
+                state1 = vaddq_u32(state1, efgh_save);
+            }
+            vst1q_u32(&state[0], state0);
+            vst1q_u32(&state[4], state1);
+        }
+#endif
+
+        using Sha256Compress = void (*)(uint32_t state[8], const uint8_t *blocks, size_t count);
+
+        inline Sha256Compress selectSha256Compress() {
+#if defined(LIBMAV_EXAMPLE_SHA256_X86)
+            if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) {
+                return sha256CompressShaNi;
+            }
+#elif defined(LIBMAV_EXAMPLE_SHA256_ARM)
+            return sha256CompressArm;
+#endif
+            return sha256CompressGeneric;
+        }
+
+        inline const Sha256Compress SHA256_COMPRESS = selectSha256Compress();
+    }
+
+    using Sha256Digest = std::array<uint8_t, 32>;
+
+    /*
+     * Incremental SHA-256. The compression function is picked once at startup: SHA-NI on x86 CPUs that have
+     * it, the ARMv8 cryptography extensions when compiled for them, portable code otherwise.
+     */
+    class Sha256 {
+    private:
+        uint32_t _state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        uint8_t _buffer[64] = {};
+        size_t _buffered = 0;
+        uint64_t _length = 0;
+
+    public:
+        Sha256& update(const void *data, size_t size) {
+            auto bytes = static_cast<const uint8_t*>(data);
+            _length += size;
+            if (_buffered > 0) {
+                size_t take = std::min(size, sizeof(_buffer) - _buffered);
+                std::memcpy(_buffer + _buffered, bytes, take);
+                _buffered += take;
+                bytes += take;
+                size -= take;
+                if (_buffered < sizeof(_buffer)) {
+                    return *this;
+                }
+                detail::SHA256_COMPRESS(_state, _buffer, 1);
+                _buffered = 0;
+            }
+            if (size >= 64) {
+                detail::SHA256_COMPRESS(_state, bytes, size / 64);
+                bytes += size & ~static_cast<size_t>(63);
+                size &= 63;
+            }
+            std::memcpy(_buffer, bytes, size);
+            _buffered = size;
+            return *this;
+        }
+
+        Sha256Digest finish() {
+            uint64_t bit_length = _length * 8;
+            uint8_t padding[72] = {0x80};
+            size_t padding_length = (_buffered < 56 ? 56 : 120) - _buffered;
+            for (int i = 0; i < 8; i++) {
+                padding[padding_length + i] = static_cast<uint8_t>(bit_length >> (56 - 8 * i));
+            }
+            update(padding, padding_length + 8);
+            Sha256Digest digest;
+            for (int i = 0; i < 8; i++) {
+                digest[i * 4] = static_cast<uint8_t>(_state[i] >> 24);
+                digest[i * 4 + 1] = static_cast<uint8_t>(_state[i] >> 16);
+                digest[i * 4 + 2] = static_cast<uint8_t>(_state[i] >> 8);
+                digest[i * 4 + 3] = static_cast<uint8_t>(_state[i]);
+            }
+            return digest;
+        }
+    };
+
+    inline Sha256Digest sha256(const void *data, size_t size) {
+        return Sha256{}.update(data, size).finish();
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_SHA256_H
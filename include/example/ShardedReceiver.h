@@ -0,0 +1,249 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_SHARDEDRECEIVER_H
+#define LIBMAV_EXAMPLE_SHARDEDRECEIVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/FramePool.h>
+#include <example/FrameReader.h>
+#include <example/SpscQueue.h>
+
+namespace example {
+
+    struct ShardConfig {
+        int shards = static_cast<int>(std::max(2u, std::thread::hardware_concurrency()) - 1);
+        // Frames buffered per shard before the receive thread starts dropping frames for it
+        size_t queue_capacity = 1024;
+        // Pool shared by all shards, should cover all queues plus the frames held by callbacks
+        uint32_t pool_size = 8192;
+    };
+
+    /*
+     * Receive thread plus a pool of worker threads. The receive thread only finds frame boundaries and
+     * hands the raw frame to the worker that owns the frame's ConnectionPartner, through a lock-free SPSC
+     * queue. Checksum verification and the callback run on the worker. Each connection partner always maps
+     * to the same worker, so frames of one connection are processed in the order they were received, while
+     * different vehicles are spread across cores.
+     *
+     * This consumes the interface by itself, use it instead of a NetworkRuntime on receive-only links.
+     * The callback runs concurrently on different workers and has to be thread-safe. If the interface fails,
+     * or the callback throws, the first exception is kept for error(); a failed interface ends receiving.
+     */
+    class ShardedReceiver {
+    public:
+        using Callback = std::function<void(const PooledFrame &frame)>;
+
+        struct ShardStats {
+            uint64_t frames = 0;
+            uint64_t queue_full = 0;
+            uint64_t bad_checksum = 0;
+            uint64_t unknown_message = 0;
+        };
+
+    private:
+        struct Shard {
+            SpscQueue<PooledFrame> queue;
+            std::thread worker;
+            std::mutex mutex;
+            std::condition_variable wakeup;
+            std::atomic_bool sleeping{false};
+            std::atomic<uint64_t> frames{0};
+            std::atomic<uint64_t> queue_full{0};
+            std::atomic<uint64_t> bad_checksum{0};
+            std::atomic<uint64_t> unknown_message{0};
+
+            explicit Shard(size_t capacity) : queue(capacity) {}
+        };
+
+        const mav::MessageSet &_message_set;
+        mav::NetworkInterface &_interface;
+        Callback _callback;
+        FramePool _pool;
+        std::vector<std::unique_ptr<Shard>> _shards;
+        std::thread _receive_thread;
+        std::atomic_bool _should_terminate{false};
+
+        mutable std::mutex _error_mutex;
+        std::exception_ptr _error;
+
+        void _fail(std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(_error_mutex);
+            if (!_error) {
+                _error = std::move(error);
+            }
+        }
+
+        static size_t shardIndex(const mav::ConnectionPartner &partner, size_t shards) {
+            uint64_t key = (static_cast<uint64_t>(partner.address()) << 32) ^
+                (static_cast<uint64_t>(static_cast<uint32_t>(partner.port())) << 1) ^
+                static_cast<uint64_t>(partner.isUart());
+            key *= 0x9E3779B97F4A7C15ull;
+            return static_cast<size_t>(key >> 32) % shards;
+        }
+
+        void _receiveLoop() {
+            PooledReceiver receiver{_message_set, _interface, _pool};
+            // Checksums are verified on the workers
+            receiver.setVerification(false);
+            try {
+                while (!_should_terminate) {
+                    auto frame = receiver.receive();
+                    auto &shard = *_shards[shardIndex(frame.partner(), _shards.size())];
+                    if (!shard.queue.push(std::move(frame))) {
+                        shard.queue_full.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                    // pairs with the fence in _workerLoop(): either the worker sees the frame, or this sees
+                    // the worker sleeping
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (shard.sleeping.load(std::memory_order_relaxed)) {
+                        // under the lock, the worker is either still before its check or already waiting
+                        std::lock_guard<std::mutex> lock(shard.mutex);
+                        shard.wakeup.notify_one();
+                    }
+                }
+            } catch (const mav::NetworkInterfaceInterrupt&) {
+                // interface closed, regular shutdown
+            } catch (...) {
+                _fail(std::current_exception());
+            }
+        }
+
+        void _workerLoop(Shard &shard) {
+            CrcExtraCache crc_extra{_message_set};
+            PooledFrame frame;
+            while (!_should_terminate) {
+                if (!shard.queue.pop(frame)) {
+                    std::unique_lock<std::mutex> lock(shard.mutex);
+                    shard.sleeping.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    shard.wakeup.wait(lock, [&shard, this] {
+                        return !shard.queue.empty() || _should_terminate;
+                    });
+                    shard.sleeping.store(false, std::memory_order_relaxed);
+                    continue;
+                }
+                auto result = verifyFrame(frame.view().data(), crc_extra);
+                if (result == Verification::UNKNOWN_MESSAGE) {
+                    shard.unknown_message.fetch_add(1, std::memory_order_relaxed);
+                } else if (result == Verification::BAD_CHECKSUM) {
+                    shard.bad_checksum.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    shard.frames.fetch_add(1, std::memory_order_relaxed);
+                    try {
+                        _callback(frame);
+                    } catch (...) {
+                        _fail(std::current_exception());
+                    }
+                }
+                frame = PooledFrame{};
+            }
+        }
+
+    public:
+        ShardedReceiver(const mav::MessageSet &message_set, mav::NetworkInterface &interface, Callback callback,
+                        const ShardConfig &config = {}) :
+                _message_set(message_set), _interface(interface), _callback(std::move(callback)),
+                _pool(config.pool_size) {
+            for (int i = 0; i < std::max(1, config.shards); i++) {
+                _shards.push_back(std::make_unique<Shard>(config.queue_capacity));
+            }
+            for (auto &shard : _shards) {
+                shard->worker = std::thread{&ShardedReceiver::_workerLoop, this, std::ref(*shard)};
+            }
+            _receive_thread = std::thread{&ShardedReceiver::_receiveLoop, this};
+        }
+
+        ShardedReceiver(const ShardedReceiver&) = delete;
+        ShardedReceiver& operator=(const ShardedReceiver&) = delete;
+
+        ~ShardedReceiver() {
+            stop();
+        }
+
+        /*
+         * Closes the interface and joins all threads. Frames still queued are discarded.
+         */
+        void stop() {
+            if (_should_terminate.exchange(true)) {
+                return;
+            }
+            _interface.close();
+            _receive_thread.join();
+            for (auto &shard : _shards) {
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    shard->wakeup.notify_one();
+                }
+                shard->worker.join();
+            }
+        }
+
+        /*
+         * The first exception thrown by the interface (other than for closing it) or by the callback, if any.
+         */
+        [[nodiscard]] std::exception_ptr error() const {
+            std::lock_guard<std::mutex> lock(_error_mutex);
+            return _error;
+        }
+
+        [[nodiscard]] size_t shardCount() const {
+            return _shards.size();
+        }
+
+        [[nodiscard]] ShardStats stats(size_t shard_index) const {
+            const auto &shard = *_shards.at(shard_index);
+            return {shard.frames.load(), shard.queue_full.load(), shard.bad_checksum.load(),
+                    shard.unknown_message.load()};
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_SHARDEDRECEIVER_H
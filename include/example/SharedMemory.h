@@ -0,0 +1,469 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_SHAREDMEMORY_H
+#define LIBMAV_EXAMPLE_SHAREDMEMORY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <mav/Network.h>
+
+namespace example {
+
+    struct SharedMemoryConfig {
+        // Bytes per direction, rounded up to a power of two
+        uint32_t ring_size = 1 << 20;
+        // Polls before the receiver goes to sleep on a futex. Spinning keeps the latency down for
+        // streams with small gaps between frames, at the cost of CPU time.
+        int spin_count = 2000;
+        // If true, send() waits for the other side to make room, otherwise the frame is dropped like
+        // a UDP datagram would be and counted in SharedMemoryStats::dropped.
+        bool block_when_full = false;
+    };
+
+    struct SharedMemoryStats {
+        uint64_t frames_sent = 0;
+        uint64_t frames_received = 0;
+        uint64_t dropped = 0;
+        uint64_t sleeps = 0;
+    };
+
+    namespace detail {
+
+        static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                      "Shared memory rings need address-free atomics");
+
+        constexpr char SHARED_MEMORY_MAGIC[8] = {'L', 'M', 'A', 'V', 'S', 'H', 'M', '1'};
+
+        /*
+         * Control block of a single producer / single consumer byte ring. Frames are stored as a 4 byte
+         * length followed by the frame, and may wrap around the end of the ring. The counters are futex
+         * words, bumped only when the other side announced that it is going to sleep.
+         */
+        struct SharedRing {
+            alignas(64) std::atomic<uint64_t> head;
+            alignas(64) std::atomic<uint64_t> tail;
+            alignas(64) std::atomic<uint32_t> data_counter;
+            std::atomic<uint32_t> consumer_waiting;
+            alignas(64) std::atomic<uint32_t> space_counter;
+            std::atomic<uint32_t> producer_waiting;
+        };
+
+        struct SharedSegmentHeader {
+            char magic[8];
+            uint32_t ring_size;
+            std::atomic<uint32_t> ready;
+            SharedRing rings[2];
+        };
+
+        inline size_t sharedSegmentSize(uint32_t ring_size) {
+            return sizeof(SharedSegmentHeader) + 2 * static_cast<size_t>(ring_size);
+        }
+
+        inline void futexWait(std::atomic<uint32_t> &word, uint32_t expected, int timeout_ms) {
+            timespec timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+        }
+
+        inline void futexWake(std::atomic<uint32_t> &word) {
+            ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+        }
+
+        inline void notify(std::atomic<uint32_t> &counter, std::atomic<uint32_t> &waiting) {
+            // pairs with the fence in waitFor: either the sleeper sees our update, or we see it waiting
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting.load(std::memory_order_relaxed)) {
+                counter.fetch_add(1, std::memory_order_release);
+                futexWake(counter);
+            }
+        }
+
+        /*
+         * Blocks until ready() holds or should_stop is set. The timeout only bounds the time to notice a
+         * peer that died while we were asleep.
+         */
+        template <typename Ready>
+        inline bool waitFor(std::atomic<uint32_t> &counter, std::atomic<uint32_t> &waiting, int spin_count,
+                            const std::atomic_bool &should_stop, std::atomic<uint64_t> &sleeps, Ready ready) {
+            for (int i = 0; i < spin_count; i++) {
+                if (ready()) {
+                    return true;
+                }
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            while (!should_stop) {
+                waiting.store(1, std::memory_order_relaxed);
+                auto observed = counter.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (ready()) {
+                    waiting.store(0, std::memory_order_relaxed);
+                    return true;
+                }
+                sleeps.fetch_add(1, std::memory_order_relaxed);
+                futexWait(counter, observed, 100);
+                waiting.store(0, std::memory_order_relaxed);
+                if (ready()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /*
+         * Owns the mapping of a segment. A named segment is unlinked again by the side that created it.
+         */
+        class SharedSegment {
+        private:
+            SharedSegmentHeader *_header = nullptr;
+            size_t _size = 0;
+            std::string _unlink_name;
+
+        public:
+            SharedSegment(const SharedSegment&) = delete;
+            SharedSegment& operator=(const SharedSegment&) = delete;
+
+            SharedSegment(void *memory, size_t size, std::string unlink_name) :
+                _header(static_cast<SharedSegmentHeader*>(memory)), _size(size), _unlink_name(std::move(unlink_name)) {}
+
+            ~SharedSegment() {
+                ::munmap(_header, _size);
+                if (!_unlink_name.empty()) {
+                    ::shm_unlink(_unlink_name.c_str());
+                }
+            }
+
+            static void initialize(void *memory, uint32_t ring_size) {
+                auto header = new (memory) SharedSegmentHeader{};
+                std::memcpy(header->magic, SHARED_MEMORY_MAGIC, sizeof(SHARED_MEMORY_MAGIC));
+                header->ring_size = ring_size;
+                header->ready.store(1, std::memory_order_release);
+            }
+
+            static std::shared_ptr<SharedSegment> anonymous(uint32_t ring_size) {
+                auto size = sharedSegmentSize(ring_size);
+                void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+                if (memory == MAP_FAILED) {
+                    throw mav::NetworkError("Could not map shared memory", errno);
+                }
+                initialize(memory, ring_size);
+                return std::make_shared<SharedSegment>(memory, size, "");
+            }
+
+            static std::shared_ptr<SharedSegment> create(const std::string &name, uint32_t ring_size) {
+                // a segment left behind by a crashed process is replaced, not reused
+                ::shm_unlink(name.c_str());
+                int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+                if (fd < 0) {
+                    throw mav::NetworkError("Could not create shared memory segment " + name, errno);
+                }
+                auto size = sharedSegmentSize(ring_size);
+                if (::ftruncate(fd, static_cast<off_t>(size)) < 0) {
+                    int error = errno;
+                    ::close(fd);
+                    ::shm_unlink(name.c_str());
+                    throw mav::NetworkError("Could not size shared memory segment " + name, error);
+                }
+                void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                int error = errno;
+                ::close(fd);
+                if (memory == MAP_FAILED) {
+                    ::shm_unlink(name.c_str());
+                    throw mav::NetworkError("Could not map shared memory segment " + name, error);
+                }
+                initialize(memory, ring_size);
+                return std::make_shared<SharedSegment>(memory, size, name);
+            }
+
+            static std::shared_ptr<SharedSegment> open(const std::string &name) {
+                int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+                if (fd < 0) {
+                    throw mav::NetworkError("Could not open shared memory segment " + name, errno);
+                }
+                struct stat info{};
+                if (::fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < sizeof(SharedSegmentHeader)) {
+                    ::close(fd);
+                    throw mav::NetworkError("Shared memory segment " + name + " is not initialized", EAGAIN);
+                }
+                auto size = static_cast<size_t>(info.st_size);
+                void *memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                int error = errno;
+                ::close(fd);
+                if (memory == MAP_FAILED) {
+                    throw mav::NetworkError("Could not map shared memory segment " + name, error);
+                }
+                auto segment = std::make_shared<SharedSegment>(memory, size, "");
+                auto header = segment->header();
+                if (header->ready.load(std::memory_order_acquire) != 1 ||
+                        std::memcmp(header->magic, SHARED_MEMORY_MAGIC, sizeof(SHARED_MEMORY_MAGIC)) != 0 ||
+                        sharedSegmentSize(header->ring_size) != size) {
+                    throw mav::NetworkError("Shared memory segment " + name + " is not a libmav segment", EINVAL);
+                }
+                return segment;
+            }
+
+            [[nodiscard]] SharedSegmentHeader* header() const {
+                return _header;
+            }
+
+            [[nodiscard]] uint8_t* ringData(int index) const {
+                return reinterpret_cast<uint8_t*>(_header + 1) + static_cast<size_t>(index) * _header->ring_size;
+            }
+        };
+
+        inline uint32_t roundUpPowerOfTwo(uint32_t value) {
+            uint32_t size = 1;
+            while (size < value) {
+                size <<= 1;
+            }
+            return size;
+        }
+    }
+
+    /*
+     * NetworkInterface over a pair of lock-free rings in shared memory, for exchanging frames with another
+     * process (or another thread, see sharedMemoryPair) without going through the kernel network stack.
+     * The only syscalls are futex wakeups, and only when the receiver had nothing to do and went to sleep.
+     *
+     * There is exactly one peer, so every frame arrives from sharedMemoryPartner(). Any number of threads may
+     * send; they are serialized by a process local mutex, the rings themselves are single producer.
+     * Frames are kept together like datagrams, markMessageBoundary() drops the rest of the current one.
+     */
+    class SharedMemoryInterface : public mav::NetworkInterface {
+    private:
+        std::shared_ptr<detail::SharedSegment> _segment;
+        detail::SharedRing *_rx_ring;
+        detail::SharedRing *_tx_ring;
+        uint8_t *_rx_data;
+        uint8_t *_tx_data;
+        uint64_t _mask;
+        SharedMemoryConfig _config;
+        mutable std::atomic_bool _should_terminate{false};
+
+        // receive side, only touched by the receiving thread
+        std::vector<uint8_t> _rx_frame;
+        uint32_t _rx_length = 0;
+        uint32_t _rx_offset = 0;
+
+        std::mutex _tx_mutex;
+
+        std::atomic<uint64_t> _frames_sent{0};
+        std::atomic<uint64_t> _frames_received{0};
+        std::atomic<uint64_t> _dropped{0};
+        std::atomic<uint64_t> _sleeps{0};
+
+        void _copyIn(uint64_t position, const uint8_t *data, uint32_t size) {
+            auto offset = position & _mask;
+            auto first = std::min<uint64_t>(size, _mask + 1 - offset);
+            std::memcpy(_tx_data + offset, data, first);
+            std::memcpy(_tx_data, data + first, size - first);
+        }
+
+        void _copyOut(uint64_t position, uint8_t *data, uint32_t size) const {
+            auto offset = position & _mask;
+            auto first = std::min<uint64_t>(size, _mask + 1 - offset);
+            std::memcpy(data, _rx_data + offset, first);
+            std::memcpy(data + first, _rx_data, size - first);
+        }
+
+        void _fillFrame() {
+            auto head = _rx_ring->head.load(std::memory_order_relaxed);
+            bool available = detail::waitFor(_rx_ring->data_counter, _rx_ring->consumer_waiting, _config.spin_count,
+                                             _should_terminate, _sleeps, [this, head] {
+                return _rx_ring->tail.load(std::memory_order_acquire) != head;
+            });
+            if (!available) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            uint32_t length;
+            _copyOut(head, reinterpret_cast<uint8_t*>(&length), sizeof(length));
+            if (length > _mask + 1 - sizeof(length)) {
+                throw mav::NetworkError("Corrupt shared memory ring", EPROTO);
+            }
+            _rx_frame.resize(std::max<size_t>(_rx_frame.size(), length));
+            _copyOut(head + sizeof(length), _rx_frame.data(), length);
+            // the frame is copied, so its space goes back to the sender right away
+            _rx_ring->head.store(head + sizeof(length) + length, std::memory_order_release);
+            detail::notify(_rx_ring->space_counter, _rx_ring->producer_waiting);
+            _rx_length = length;
+            _rx_offset = 0;
+            _frames_received.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    protected:
+        SharedMemoryInterface(std::shared_ptr<detail::SharedSegment> segment, int side, const SharedMemoryConfig &config) :
+                _segment(std::move(segment)), _config(config) {
+            auto header = _segment->header();
+            _rx_ring = &header->rings[side];
+            _tx_ring = &header->rings[1 - side];
+            _rx_data = _segment->ringData(side);
+            _tx_data = _segment->ringData(1 - side);
+            _mask = header->ring_size - 1;
+        }
+
+    public:
+        SharedMemoryInterface(const SharedMemoryInterface&) = delete;
+        SharedMemoryInterface& operator=(const SharedMemoryInterface&) = delete;
+
+        ~SharedMemoryInterface() override {
+            close();
+        }
+
+        void close() const override {
+            if (_should_terminate.exchange(true)) {
+                return;
+            }
+            // wake our own receiver and sender if they sleep
+            _rx_ring->data_counter.fetch_add(1, std::memory_order_release);
+            detail::futexWake(_rx_ring->data_counter);
+            _tx_ring->space_counter.fetch_add(1, std::memory_order_release);
+            detail::futexWake(_tx_ring->space_counter);
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return !_should_terminate;
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner) override {
+            uint64_t needed = sizeof(uint32_t) + static_cast<uint64_t>(size);
+            if (needed > _mask + 1) {
+                throw mav::NetworkError("Frame does not fit the shared memory ring", EMSGSIZE);
+            }
+            std::lock_guard<std::mutex> lock(_tx_mutex);
+            auto tail = _tx_ring->tail.load(std::memory_order_relaxed);
+            auto has_space = [this, tail, needed] {
+                return tail + needed - _tx_ring->head.load(std::memory_order_acquire) <= _mask + 1;
+            };
+            if (!has_space()) {
+                if (!_config.block_when_full) {
+                    _dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                if (!detail::waitFor(_tx_ring->space_counter, _tx_ring->producer_waiting, _config.spin_count,
+                                     _should_terminate, _sleeps, has_space)) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+            }
+            _copyIn(tail, reinterpret_cast<const uint8_t*>(&size), sizeof(size));
+            _copyIn(tail + sizeof(size), data, size);
+            _tx_ring->tail.store(tail + needed, std::memory_order_release);
+            detail::notify(_tx_ring->data_counter, _tx_ring->consumer_waiting);
+            _frames_sent.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            while (copied < size) {
+                if (_rx_offset >= _rx_length) {
+                    _fillFrame();
+                }
+                auto chunk = std::min(size - copied, _rx_length - _rx_offset);
+                std::memcpy(destination + copied, _rx_frame.data() + _rx_offset, chunk);
+                _rx_offset += chunk;
+                copied += chunk;
+            }
+            return partner();
+        }
+
+        void markMessageBoundary() override {
+            _rx_offset = _rx_length;
+        }
+
+        [[nodiscard]] static mav::ConnectionPartner partner() {
+            return {0, 0, false};
+        }
+
+        [[nodiscard]] SharedMemoryStats stats() const {
+            return {_frames_sent.load(std::memory_order_relaxed), _frames_received.load(std::memory_order_relaxed),
+                    _dropped.load(std::memory_order_relaxed), _sleeps.load(std::memory_order_relaxed)};
+        }
+
+        friend std::pair<std::unique_ptr<SharedMemoryInterface>, std::unique_ptr<SharedMemoryInterface>>
+        sharedMemoryPair(const SharedMemoryConfig &config);
+    };
+
+    /*
+     * Creates the named segment (POSIX shm, so "/name") and removes it again on destruction.
+     * Use it in place of mav::UDPServer on the side that starts first.
+     */
+    class SharedMemoryServer : public SharedMemoryInterface {
+    public:
+        explicit SharedMemoryServer(const std::string &name, const SharedMemoryConfig &config = {}) :
+            SharedMemoryInterface(detail::SharedSegment::create(
+                name, detail::roundUpPowerOfTwo(std::max<uint32_t>(config.ring_size, 4096))), 0, config) {}
+    };
+
+    /*
+     * Attaches to a segment created by a SharedMemoryServer. Throws mav::NetworkError if there is none yet.
+     */
+    class SharedMemoryClient : public SharedMemoryInterface {
+    public:
+        explicit SharedMemoryClient(const std::string &name, const SharedMemoryConfig &config = {}) :
+            SharedMemoryInterface(detail::SharedSegment::open(name), 1, config) {}
+    };
+
+    /*
+     * Two connected interfaces within one process, e.g. to run a NetworkRuntime against a simulated vehicle
+     * in benchmarks and tests.
+     */
+    inline std::pair<std::unique_ptr<SharedMemoryInterface>, std::unique_ptr<SharedMemoryInterface>>
+    sharedMemoryPair(const SharedMemoryConfig &config = {}) {
+        auto segment = detail::SharedSegment::anonymous(
+            detail::roundUpPowerOfTwo(std::max<uint32_t>(config.ring_size, 4096)));
+        return {std::unique_ptr<SharedMemoryInterface>(new SharedMemoryInterface(segment, 0, config)),
+                std::unique_ptr<SharedMemoryInterface>(new SharedMemoryInterface(segment, 1, config))};
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_SHAREDMEMORY_H
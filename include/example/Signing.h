@@ -0,0 +1,412 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_SIGNING_H
+#define LIBMAV_EXAMPLE_SIGNING_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include <mav/MessageSet.h>
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+#include <example/Sha256.h>
+
+namespace example {
+
+    /*
+     * The 32 byte secret shared by both ends of a signed link.
+     */
+    struct SigningKey {
+        std::array<uint8_t, 32> secret{};
+
+        /*
+         * Derives the key as the SHA-256 of a passphrase, which is what ground stations do.
+         */
+        static SigningKey fromPassphrase(std::string_view passphrase) {
+            return {sha256(passphrase.data(), passphrase.size())};
+        }
+    };
+
+    struct SigningConfig {
+        // Pass unsigned frames on instead of dropping them, e.g. while not all vehicles are set up for signing
+        bool accept_unsigned = false;
+        // How far, in 10 microsecond units, the first timestamp of a stream may lag behind the newest one
+        // seen from any stream. The MAVLink specification recommends one minute.
+        uint64_t new_stream_window = 6000000;
+    };
+
+    enum class SignatureCheck {
+        VALID,
+        UNSIGNED,
+        BAD_SIGNATURE,
+        REPLAYED
+    };
+
+    namespace detail {
+        constexpr int SIGNATURE_LINK_ID_OFFSET = 0;
+        constexpr int SIGNATURE_TIMESTAMP_OFFSET = 1;
+        constexpr int SIGNATURE_HASH_OFFSET = 7;
+        constexpr int SIGNATURE_HASH_SIZE = 6;
+        // 2015-01-01T00:00:00Z, the epoch of signature timestamps
+        constexpr int64_t SIGNING_EPOCH_UNIX_SECONDS = 1420070400;
+
+        inline uint64_t signingTimestampNow() {
+            auto micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+            return static_cast<uint64_t>(micros - SIGNING_EPOCH_UNIX_SECONDS * 1000000) / 10;
+        }
+
+        inline uint64_t loadLittleEndian48(const uint8_t *source) {
+            uint64_t value = 0;
+            for (int i = 5; i >= 0; i--) {
+                value = (value << 8) | source[i];
+            }
+            return value;
+        }
+
+        inline void storeLittleEndian48(uint8_t *destination, uint64_t value) {
+            for (int i = 0; i < 6; i++) {
+                destination[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        /*
+         * The first 48 bits of SHA-256 over the key and the frame up to the signature hash, that is header,
+         * payload, checksum, link id and timestamp.
+         */
+        inline void signatureHash(const SigningKey &key, const uint8_t *frame, int signed_length, uint8_t *hash) {
+            auto digest = Sha256{}.update(key.secret.data(), key.secret.size()).update(frame, signed_length).finish();
+            std::memcpy(hash, digest.data(), SIGNATURE_HASH_SIZE);
+        }
+
+        inline void writeChecksum(uint8_t *frame, uint8_t crc_extra) {
+            FrameHeader header{frame};
+            auto checksum = frameChecksum(frame, crc_extra);
+            uint8_t *destination = frame + header.headerSize() + header.payloadLength();
+            destination[0] = static_cast<uint8_t>(checksum & 0xFF);
+            destination[1] = static_cast<uint8_t>(checksum >> 8);
+        }
+    }
+
+    /*
+     * Signs outgoing MAVLink v2 frames for one link. Timestamps are strictly increasing, even when the clock
+     * is not. Not thread-safe.
+     */
+    class Signer {
+    private:
+        SigningKey _key;
+        uint8_t _link_id;
+        uint64_t _last_timestamp = 0;
+
+    public:
+        Signer(const SigningKey &key, uint8_t link_id) : _key(key), _link_id(link_id) {}
+
+        void setKey(const SigningKey &key) {
+            _key = key;
+        }
+
+        /*
+         * Signs an unsigned v2 frame in place and returns its new length. The buffer must have room for
+         * SIGNATURE_SIZE more bytes. The checksum changes as well, as it covers the incompatibility flags.
+         */
+        int sign(uint8_t *frame, int length, uint8_t crc_extra) {
+            frame[2] |= INCOMPAT_FLAG_SIGNED;
+            detail::writeChecksum(frame, crc_extra);
+            _last_timestamp = std::max(detail::signingTimestampNow(), _last_timestamp + 1);
+            uint8_t *signature = frame + length;
+            signature[detail::SIGNATURE_LINK_ID_OFFSET] = _link_id;
+            detail::storeLittleEndian48(signature + detail::SIGNATURE_TIMESTAMP_OFFSET, _last_timestamp);
+            detail::signatureHash(_key, frame, length + detail::SIGNATURE_HASH_OFFSET,
+                                  signature + detail::SIGNATURE_HASH_OFFSET);
+            return length + SIGNATURE_SIZE;
+        }
+    };
+
+    /*
+     * Checks signatures of incoming frames, and rejects replays: per stream of link id, system id and component
+     * id, every timestamp has to be newer than the last accepted one. Not thread-safe.
+     */
+    class Verifier {
+    private:
+        SigningKey _key;
+        SigningConfig _config;
+        std::unordered_map<uint32_t, uint64_t> _streams;
+        uint64_t _newest_timestamp = 0;
+
+    public:
+        explicit Verifier(const SigningKey &key, const SigningConfig &config = {}) : _key(key), _config(config) {}
+
+        void setKey(const SigningKey &key) {
+            _key = key;
+        }
+
+        SignatureCheck check(const uint8_t *frame, int length) {
+            FrameHeader header{frame};
+            if (!header.isSigned() || length != header.frameLength()) {
+                return SignatureCheck::UNSIGNED;
+            }
+            const uint8_t *signature = frame + length - SIGNATURE_SIZE;
+            uint8_t expected[detail::SIGNATURE_HASH_SIZE];
+            detail::signatureHash(_key, frame, length - detail::SIGNATURE_HASH_SIZE, expected);
+            if (std::memcmp(expected, signature + detail::SIGNATURE_HASH_OFFSET, detail::SIGNATURE_HASH_SIZE) != 0) {
+                return SignatureCheck::BAD_SIGNATURE;
+            }
+
+            uint64_t timestamp = detail::loadLittleEndian48(signature + detail::SIGNATURE_TIMESTAMP_OFFSET);
+            uint32_t stream = (static_cast<uint32_t>(signature[detail::SIGNATURE_LINK_ID_OFFSET]) << 16) |
+                              (static_cast<uint32_t>(header.systemId()) << 8) | header.componentId();
+            auto it = _streams.find(stream);
+            if (it == _streams.end()) {
+                if (timestamp + _config.new_stream_window < _newest_timestamp) {
+                    return SignatureCheck::REPLAYED;
+                }
+                _streams.emplace(stream, timestamp);
+            } else {
+                if (timestamp <= it->second) {
+                    return SignatureCheck::REPLAYED;
+                }
+                it->second = timestamp;
+            }
+            _newest_timestamp = std::max(_newest_timestamp, timestamp);
+            return SignatureCheck::VALID;
+        }
+    };
+
+    struct SigningStats {
+        uint64_t signed_sent = 0;
+        uint64_t verified = 0;
+        uint64_t unsigned_accepted = 0;
+        uint64_t unsigned_rejected = 0;
+        uint64_t bad_signature = 0;
+        uint64_t replayed = 0;
+    };
+
+    /*
+     * Adds MAVLink v2 signing to any interface. Frames sent by the runtime are signed on their way out;
+     * incoming frames are verified, and handed to the runtime with the signature removed, so libmav sees
+     * plain v2 frames. Frames that fail the check never reach the runtime.
+     *
+     *      mav::UDPServer udp{14550};
+     *      example::SigningInterface phy{message_set, udp, example::SigningKey::fromPassphrase("..."), 1};
+     *      mav::NetworkRuntime runtime{message_set, heartbeat, phy};
+     *
+     * Signing and verifying cost a SHA-256 over the frame each, which runs on the SHA extensions of the CPU
+     * where available (see Sha256.h).
+     */
+    class SigningInterface : public mav::NetworkInterface {
+    private:
+        mav::NetworkInterface &_interface;
+        SigningConfig _config;
+
+        std::mutex _send_mutex;
+        Signer _signer;
+        CrcExtraCache _send_crc_extra;
+        std::array<uint8_t, MAX_FRAME_SIZE> _send_frame{};
+
+        std::mutex _key_mutex;
+        SigningKey _shared_key;
+        std::atomic<uint64_t> _key_version{0};
+
+        // receive side, only touched by the receiving thread
+        Verifier _verifier;
+        uint64_t _loaded_key_version = 0;
+        CrcExtraCache _receive_crc_extra;
+        std::array<uint8_t, MAX_FRAME_SIZE> _frame{};
+        int _frame_length = 0;
+        int _frame_offset = 0;
+        mav::ConnectionPartner _partner;
+
+        std::atomic<uint64_t> _signed_sent{0};
+        std::atomic<uint64_t> _verified{0};
+        std::atomic<uint64_t> _unsigned_accepted{0};
+        std::atomic<uint64_t> _unsigned_rejected{0};
+        std::atomic<uint64_t> _bad_signature{0};
+        std::atomic<uint64_t> _replayed{0};
+
+        void _refreshKey() {
+            auto version = _key_version.load(std::memory_order_acquire);
+            if (version != _loaded_key_version) {
+                std::lock_guard<std::mutex> lock(_key_mutex);
+                _verifier.setKey(_shared_key);
+                _loaded_key_version = _key_version.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Returns false if the frame is to be dropped
+        bool _accept(int &length) {
+            switch (_verifier.check(_frame.data(), length)) {
+                case SignatureCheck::VALID: {
+                    int crc_extra = _receive_crc_extra.get(FrameHeader{_frame.data()}.messageId());
+                    if (crc_extra < 0) {
+                        return false;
+                    }
+                    // hand on a plain v2 frame
+                    _frame[2] &= static_cast<uint8_t>(~INCOMPAT_FLAG_SIGNED);
+                    detail::writeChecksum(_frame.data(), static_cast<uint8_t>(crc_extra));
+                    length -= SIGNATURE_SIZE;
+                    _verified.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+                case SignatureCheck::UNSIGNED:
+                    if (_config.accept_unsigned) {
+                        _unsigned_accepted.fetch_add(1, std::memory_order_relaxed);
+                        return true;
+                    }
+                    _unsigned_rejected.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                case SignatureCheck::BAD_SIGNATURE:
+                    _bad_signature.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                case SignatureCheck::REPLAYED:
+                    _replayed.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+            }
+            return false;
+        }
+
+        void _readFrame() {
+            while (true) {
+                _partner = _interface.receive(_frame.data(), 1);
+                if (!FrameHeader::isMagic(_frame[0])) {
+                    // not a frame start, left for the runtime to discard
+                    _frame_length = 1;
+                    _frame_offset = 0;
+                    return;
+                }
+                int header_size = FrameHeader::headerSize(_frame[0]);
+                _interface.receive(_frame.data() + 1, header_size - 1);
+                FrameHeader header{_frame.data()};
+                int length = header.frameLength();
+                _interface.receive(_frame.data() + header_size, length - header_size);
+
+                _refreshKey();
+                // MAVLink v1 frames can not be signed
+                bool accepted = header.isV2() ? _accept(length) : _config.accept_unsigned;
+                if (!accepted) {
+                    continue;
+                }
+                _frame_length = length;
+                _frame_offset = 0;
+                return;
+            }
+        }
+
+    public:
+        SigningInterface(const mav::MessageSet &message_set, mav::NetworkInterface &interface, const SigningKey &key,
+                         uint8_t link_id, const SigningConfig &config = {}) :
+                _interface(interface), _config(config), _signer(key, link_id), _send_crc_extra(message_set),
+                _shared_key(key), _verifier(key, config), _receive_crc_extra(message_set) {}
+
+        /*
+         * Replaces the key, e.g. when it is rotated. Sends use it right away, the receiving thread picks it
+         * up with the next frame.
+         */
+        void setKey(const SigningKey &key) {
+            {
+                std::lock_guard<std::mutex> lock(_send_mutex);
+                _signer.setKey(key);
+            }
+            std::lock_guard<std::mutex> lock(_key_mutex);
+            _shared_key = key;
+            _key_version.fetch_add(1, std::memory_order_release);
+        }
+
+        [[nodiscard]] SigningStats stats() const {
+            return {_signed_sent.load(std::memory_order_relaxed), _verified.load(std::memory_order_relaxed),
+                    _unsigned_accepted.load(std::memory_order_relaxed),
+                    _unsigned_rejected.load(std::memory_order_relaxed),
+                    _bad_signature.load(std::memory_order_relaxed), _replayed.load(std::memory_order_relaxed)};
+        }
+
+        void close() const override {
+            _interface.close();
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return _interface.isConnectionOpen();
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            FrameHeader header{data};
+            if (size < static_cast<uint32_t>(HEADER_SIZE_V2) || !header.isV2() || header.isSigned() ||
+                    size + SIGNATURE_SIZE > _send_frame.size()) {
+                _interface.send(data, size, partner);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(_send_mutex);
+            int crc_extra = _send_crc_extra.get(header.messageId());
+            if (crc_extra < 0) {
+                _interface.send(data, size, partner);
+                return;
+            }
+            std::memcpy(_send_frame.data(), data, size);
+            int length = _signer.sign(_send_frame.data(), static_cast<int>(size), static_cast<uint8_t>(crc_extra));
+            _interface.send(_send_frame.data(), static_cast<uint32_t>(length), partner);
+            _signed_sent.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            while (copied < size) {
+                if (_frame_offset >= _frame_length) {
+                    _readFrame();
+                }
+                auto chunk = std::min<uint32_t>(size - copied, static_cast<uint32_t>(_frame_length - _frame_offset));
+                std::memcpy(destination + copied, _frame.data() + _frame_offset, chunk);
+                _frame_offset += static_cast<int>(chunk);
+                copied += chunk;
+            }
+            return _partner;
+        }
+
+        void markMessageBoundary() override {
+            // the runtime gave up on the current frame, e.g. after a bad checksum
+            _frame_offset = _frame_length;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_SIGNING_H
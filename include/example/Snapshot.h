@@ -0,0 +1,82 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_SNAPSHOT_H
+#define LIBMAV_EXAMPLE_SNAPSHOT_H
+
+#include <string>
+#include <string_view>
+
+#include <mav/MessageSet.h>
+
+#include <example/MappedFile.h>
+
+namespace example {
+
+    constexpr std::string_view SNAPSHOT_MAGIC = "<!-- libmav-example snapshot sha256=";
+
+    /*
+     * Returns the source hash a snapshot was generated from, or an empty view if the data is not a snapshot.
+     */
+    inline std::string_view snapshotSourceHash(std::string_view snapshot) {
+        if (snapshot.substr(0, SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC) {
+            return {};
+        }
+        auto hash = snapshot.substr(SNAPSHOT_MAGIC.size());
+        return hash.substr(0, hash.find(' '));
+    }
+
+    /*
+     * Adds the definitions of a snapshot produced by tools/generate_snapshot.py to the message set.
+     * A snapshot has all includes resolved and everything libmav does not need stripped, so loading it
+     * is a single parse of a much smaller document, without touching any other file.
+     *
+     * The snapshot is only used if it was generated from the sources with the given hash, which should
+     * be example::msg::SOURCE_HASH from the generated <example/MessageFields.h>. Returns false if the
+     * snapshot is missing or stale, in which case the message set is left untouched and the caller should
+     * fall back to MessageSet::addFromXML().
+     */
+    inline bool addFromSnapshot(mav::MessageSet &message_set, const std::string &snapshot_path,
+                                std::string_view expected_source_hash) {
+        MappedFile file{snapshot_path};
+        if (!file.valid() || snapshotSourceHash(file.view()) != expected_source_hash) {
+            return false;
+        }
+        message_set.addFromXMLString(std::string{file.view()});
+        return true;
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_SNAPSHOT_H
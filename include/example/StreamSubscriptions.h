@@ -0,0 +1,309 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_STREAMSUBSCRIPTIONS_H
+#define LIBMAV_EXAMPLE_STREAMSUBSCRIPTIONS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/CommandClient.h>
+#include <example/FieldHandle.h>
+
+namespace example {
+
+    struct StreamSubscriptionsConfig {
+        int target_system = 1;
+        int target_component = 1;
+        // What a stream falls back to once nobody needs it: off, or the autopilot's default rate
+        bool restore_default_rate = false;
+        // How often an interval command that timed out or was not accepted is sent again, before the stream
+        // waits for its rate to change or for renegotiate()
+        int retry_rounds = 3;
+    };
+
+    /*
+     * What was last negotiated for a message. rate_hz is 0 for a stream that was turned off.
+     */
+    struct StreamState {
+        double requested_rate_hz = 0;
+        double acknowledged_rate_hz = 0;
+        // MAV_RESULT of the last interval command, -1 if it timed out or none was sent yet
+        int last_result = -1;
+        bool in_flight = false;
+    };
+
+    /*
+     * Aggregates message rate requirements of independent consumers on one connection, and negotiates them
+     * with MAV_CMD_SET_MESSAGE_INTERVAL. Each consumer subscribes with the minimum rate it needs; the
+     * stream is requested at the highest rate any subscriber needs, and turned off again when the last
+     * subscriber is gone, so no bandwidth is spent on streams nobody reads.
+     *
+     *      example::StreamSubscriptions streams{message_set, commands, connection};
+     *      auto attitude = streams.subscribe("ATTITUDE", 20);
+     *      ...
+     *      streams.unsubscribe(attitude);
+     *
+     * Only changes of the aggregated rate are sent, and commands that were lost or not accepted are retried up
+     * to StreamSubscriptionsConfig::retry_rounds times. At most one command per message is in flight, further
+     * changes in the meantime are folded into a single follow-up command once it completes.
+     */
+    class StreamSubscriptions {
+    public:
+        using SubscriptionId = uint64_t;
+
+    private:
+        static constexpr int MAV_RESULT_ACCEPTED = 0;
+
+        struct Stream {
+            // subscription id -> rate
+            std::map<SubscriptionId, double> subscribers;
+            StreamState state;
+            // rate of the command in flight
+            double sending_rate_hz = 0;
+            // whether an interval was ever set, so that streams that were never touched are not turned off
+            bool touched = false;
+            // set by renegotiate() and for retries, sends the rate again even if it did not change
+            bool needs_resend = false;
+            // consecutive commands for the current rate that were lost or not accepted
+            int failed_rounds = 0;
+        };
+
+        /*
+         * Everything the command callbacks need. They only hold it weakly and may run after the subscriptions
+         * object is gone, so nothing in here refers back to it.
+         */
+        struct Shared : std::enable_shared_from_this<Shared> {
+            const mav::MessageSet &message_set;
+            CommandClient &commands;
+            std::shared_ptr<mav::Connection> connection;
+            StreamSubscriptionsConfig config;
+            int set_message_interval;
+
+            std::mutex mutex;
+            std::map<int, Stream> streams;
+            std::map<SubscriptionId, int> subscriptions;
+            SubscriptionId next_id = 1;
+
+            Shared(const mav::MessageSet &message_set_, CommandClient &commands_,
+                   std::shared_ptr<mav::Connection> connection_, const StreamSubscriptionsConfig &config_) :
+                message_set(message_set_), commands(commands_), connection(std::move(connection_)), config(config_),
+                set_message_interval(message_set_.e("MAV_CMD_SET_MESSAGE_INTERVAL")) {}
+
+            /*
+             * Returns the command to send for the stream, if its aggregated rate is not what was last requested
+             * or a resend is due, and no command is in flight. Called with the mutex held.
+             */
+            std::optional<mav::Message> update(int message_id, Stream &stream) {
+                double rate = 0;
+                for (const auto &[id, subscriber_rate] : stream.subscribers) {
+                    rate = std::max(rate, subscriber_rate);
+                }
+                if (stream.state.in_flight) {
+                    // picked up again when the command completes
+                    return std::nullopt;
+                }
+                if (!stream.needs_resend && ((rate == stream.state.requested_rate_hz && stream.touched) ||
+                        (rate == 0 && !stream.touched))) {
+                    return std::nullopt;
+                }
+                if (rate != stream.state.requested_rate_hz) {
+                    stream.failed_rounds = 0;
+                }
+                stream.needs_resend = false;
+                stream.state.in_flight = true;
+                stream.sending_rate_hz = rate;
+                stream.touched = true;
+                // param2: interval in microseconds, -1 turns the stream off, 0 restores the default rate
+                float interval = rate > 0 ? static_cast<float>(std::round(1e6 / rate)) :
+                                 (config.restore_default_rate ? 0.f : -1.f);
+                return message_set.create("COMMAND_LONG").set({
+                    {"command", set_message_interval},
+                    {"param1", message_id},
+                    {"param2", interval},
+                    {"target_system", config.target_system},
+                    {"target_component", config.target_component}
+                });
+            }
+
+            void submit(int message_id, std::optional<mav::Message> command) {
+                if (!command) {
+                    return;
+                }
+                std::weak_ptr<Shared> weak = shared_from_this();
+                commands.submit(connection, *command, [weak, message_id](const CommandResult &result) {
+                    auto shared = weak.lock();
+                    if (!shared) {
+                        return;
+                    }
+                    std::optional<mav::Message> next;
+                    {
+                        std::lock_guard<std::mutex> lock(shared->mutex);
+                        auto &stream = shared->streams[message_id];
+                        stream.state.in_flight = false;
+                        stream.state.last_result = result.timed_out ? -1 : result.result;
+                        stream.state.requested_rate_hz = stream.sending_rate_hz;
+                        if (!result.timed_out && result.result == MAV_RESULT_ACCEPTED) {
+                            stream.state.acknowledged_rate_hz = stream.sending_rate_hz;
+                            stream.failed_rounds = 0;
+                        } else if (stream.failed_rounds++ < shared->config.retry_rounds) {
+                            stream.needs_resend = true;
+                        }
+                        // changes made while the command was in flight
+                        next = shared->update(message_id, stream);
+                    }
+                    shared->submit(message_id, std::move(next));
+                });
+            }
+        };
+
+        std::shared_ptr<Shared> _shared;
+
+    public:
+        StreamSubscriptions(const mav::MessageSet &message_set, CommandClient &commands,
+                            std::shared_ptr<mav::Connection> connection, const StreamSubscriptionsConfig &config = {}) :
+                _shared(std::make_shared<Shared>(message_set, commands, std::move(connection), config)) {}
+
+        StreamSubscriptions(const StreamSubscriptions&) = delete;
+        StreamSubscriptions& operator=(const StreamSubscriptions&) = delete;
+
+        /*
+         * Declares that the caller needs the message at least at rate_hz. Returns a handle for unsubscribe()
+         * and resubscribe().
+         */
+        SubscriptionId subscribe(const std::string &message_name, double rate_hz) {
+            return subscribe(_shared->message_set.idForMessage(message_name), rate_hz);
+        }
+
+        SubscriptionId subscribe(int message_id, double rate_hz) {
+            SubscriptionId id;
+            std::optional<mav::Message> command;
+            {
+                std::lock_guard<std::mutex> lock(_shared->mutex);
+                id = _shared->next_id++;
+                _shared->subscriptions[id] = message_id;
+                auto &stream = _shared->streams[message_id];
+                stream.subscribers[id] = std::max(rate_hz, 0.0);
+                command = _shared->update(message_id, stream);
+            }
+            _shared->submit(message_id, std::move(command));
+            return id;
+        }
+
+        /*
+         * Changes the rate a subscription needs.
+         */
+        void resubscribe(SubscriptionId id, double rate_hz) {
+            std::optional<mav::Message> command;
+            int message_id;
+            {
+                std::lock_guard<std::mutex> lock(_shared->mutex);
+                auto it = _shared->subscriptions.find(id);
+                if (it == _shared->subscriptions.end()) {
+                    return;
+                }
+                message_id = it->second;
+                auto &stream = _shared->streams[message_id];
+                stream.subscribers[id] = std::max(rate_hz, 0.0);
+                command = _shared->update(message_id, stream);
+            }
+            _shared->submit(message_id, std::move(command));
+        }
+
+        void unsubscribe(SubscriptionId id) {
+            std::optional<mav::Message> command;
+            int message_id;
+            {
+                std::lock_guard<std::mutex> lock(_shared->mutex);
+                auto it = _shared->subscriptions.find(id);
+                if (it == _shared->subscriptions.end()) {
+                    return;
+                }
+                message_id = it->second;
+                _shared->subscriptions.erase(it);
+                auto &stream = _shared->streams[message_id];
+                stream.subscribers.erase(id);
+                command = _shared->update(message_id, stream);
+            }
+            _shared->submit(message_id, std::move(command));
+        }
+
+        /*
+         * Sends the current aggregated rates again, e.g. after the autopilot rebooted and lost them. This covers
+         * streams that were turned off, which come back at their default rate after a reboot. Streams with a
+         * command in flight send theirs once it completes.
+         */
+        void renegotiate() {
+            std::vector<std::pair<int, std::optional<mav::Message>>> commands;
+            {
+                std::lock_guard<std::mutex> lock(_shared->mutex);
+                for (auto &[message_id, stream] : _shared->streams) {
+                    if (stream.touched) {
+                        stream.needs_resend = true;
+                        stream.failed_rounds = 0;
+                        commands.emplace_back(message_id, _shared->update(message_id, stream));
+                    }
+                }
+            }
+            for (auto &[message_id, command] : commands) {
+                _shared->submit(message_id, std::move(command));
+            }
+        }
+
+        [[nodiscard]] StreamState state(const std::string &message_name) {
+            return state(_shared->message_set.idForMessage(message_name));
+        }
+
+        [[nodiscard]] StreamState state(int message_id) {
+            std::lock_guard<std::mutex> lock(_shared->mutex);
+            auto it = _shared->streams.find(message_id);
+            return it == _shared->streams.end() ? StreamState{} : it->second.state;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_STREAMSUBSCRIPTIONS_H
@@ -0,0 +1,194 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_TICKARENA_H
+#define LIBMAV_EXAMPLE_TICKARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+#include <mav/Message.h>
+
+namespace example {
+
+    /*
+     * Resolved message prototypes. MessageSet::create(name) looks the definition up by name and builds
+     * the message from scratch every time; copying a prototype is a single copy of the message's fixed
+     * size backing memory. Prototypes are resolved up front, after that lookups are read-only and may
+     * be done from any thread.
+     */
+    class MessagePrototypes {
+    private:
+        std::unordered_map<std::string, mav::Message> _by_name;
+        std::unordered_map<int, const mav::Message*> _by_id;
+
+    public:
+        MessagePrototypes(const mav::MessageSet &message_set, std::initializer_list<std::string> message_names) {
+            for (const auto &name : message_names) {
+                auto &prototype = _by_name.emplace(name, message_set.create(name)).first->second;
+                _by_id.emplace(prototype.id(), &prototype);
+            }
+        }
+
+        /*
+         * Throws std::out_of_range for messages that were not resolved in the constructor.
+         */
+        [[nodiscard]] const mav::Message& get(const std::string &message_name) const {
+            return _by_name.at(message_name);
+        }
+
+        [[nodiscard]] const mav::Message& get(int message_id) const {
+            return *_by_id.at(message_id);
+        }
+    };
+
+    /*
+     * Per-tick monotonic arena. Objects made in the arena live until the next reset(), which runs their
+     * destructors and rewinds the arena in one go. Meant for the transient messages and scratch containers
+     * of one iteration of a control loop:
+     *
+     *      TickArena arena(64 * 1024);
+     *      while (running) {
+     *          auto &command = arena.message(prototypes.get("COMMAND_LONG"));
+     *          ...
+     *          connection->send(command);
+     *          arena.reset();
+     *      }
+     *
+     * resource() can be handed to std::pmr containers. When the initial buffer is used up, the arena falls
+     * back to the heap; spilledBytes() tells whether the capacity should be raised. Not thread-safe.
+     */
+    class TickArena {
+    private:
+        // Counts what the monotonic resource has to take from the heap once the initial buffer is full
+        class SpillCounter : public std::pmr::memory_resource {
+        public:
+            size_t spilled = 0;
+
+        private:
+            void* do_allocate(size_t bytes, size_t alignment) override {
+                spilled += bytes;
+                return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+            }
+
+            void do_deallocate(void *pointer, size_t bytes, size_t alignment) override {
+                std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+            }
+
+            [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+                return this == &other;
+            }
+        };
+
+        struct Destructor {
+            void (*destroy)(void *object);
+            void *object;
+        };
+
+        std::vector<std::byte> _buffer;
+        SpillCounter _upstream;
+        std::pmr::monotonic_buffer_resource _resource;
+        // pending destructors, kept outside of the arena so that they survive the rewind
+        std::vector<Destructor> _destructors;
+
+    public:
+        explicit TickArena(size_t capacity) :
+            _buffer(capacity), _resource(_buffer.data(), _buffer.size(), &_upstream) {}
+
+        TickArena(const TickArena&) = delete;
+        TickArena& operator=(const TickArena&) = delete;
+
+        ~TickArena() {
+            reset();
+        }
+
+        /*
+         * Constructs a T in the arena. Its destructor runs on reset(), unless it is trivial.
+         */
+        template <typename T, typename... Args>
+        T& make(Args&&... args) {
+            void *memory = _resource.allocate(sizeof(T), alignof(T));
+            auto object = new (memory) T(std::forward<Args>(args)...);
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                _destructors.push_back({[](void *pointer) { static_cast<T*>(pointer)->~T(); }, object});
+            }
+            return *object;
+        }
+
+        /*
+         * Copy of a message (typically a prototype) in the arena.
+         */
+        mav::Message& message(const mav::Message &prototype) {
+            return make<mav::Message>(prototype);
+        }
+
+        [[nodiscard]] std::pmr::memory_resource* resource() {
+            return &_resource;
+        }
+
+        /*
+         * Destroys everything made since the last reset, newest first, and rewinds the arena.
+         */
+        void reset() {
+            for (auto it = _destructors.rbegin(); it != _destructors.rend(); ++it) {
+                it->destroy(it->object);
+            }
+            _destructors.clear();
+            _resource.release();
+        }
+
+        [[nodiscard]] size_t capacity() const {
+            return _buffer.size();
+        }
+
+        /*
+         * Bytes taken from the heap because the capacity was exceeded, since construction.
+         */
+        [[nodiscard]] size_t spilledBytes() const {
+            return _upstream.spilled;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_TICKARENA_H
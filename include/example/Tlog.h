@@ -0,0 +1,618 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_TLOG_H
+#define LIBMAV_EXAMPLE_TLOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+#include <example/FrameAssembler.h>
+#include <example/MappedFile.h>
+
+namespace example {
+
+    /*
+     * A tlog is the de-facto standard MAVLink log format: every frame is preceded by its receive time in
+     * microseconds since the unix epoch, as a big endian uint64. The recorder keeps it that way, so logs
+     * open in any tlog tool, and writes its seek index into a sidecar file next to the log (path + ".idx").
+     */
+    constexpr int TLOG_TIMESTAMP_SIZE = 8;
+
+    struct TlogIndexEntry {
+        uint64_t timestamp_us;
+        uint64_t offset;
+    };
+
+    struct TlogRecorderConfig {
+        // The log file is grown in steps of this size, and truncated to its real length when finished
+        size_t preallocate_bytes = 64 * 1024 * 1024;
+        // A time index entry is written every index_interval frames
+        int index_interval = 1024;
+        // Also keep the offsets of every frame per message id
+        bool index_message_ids = true;
+        // Record frames sent through the interface, not just received ones
+        bool record_sent = true;
+        // Also record received frames of messages outside the message set, which can not be verified
+        bool record_unknown = false;
+    };
+
+    namespace detail {
+        // "LMAVTIDX" in file byte order
+        constexpr uint64_t TLOG_INDEX_MAGIC = 0x5844495456414d4cULL;
+
+        inline void storeBigEndian64(uint8_t *destination, uint64_t value) {
+            for (int i = 7; i >= 0; i--) {
+                destination[i] = static_cast<uint8_t>(value);
+                value >>= 8;
+            }
+        }
+
+        inline uint64_t loadBigEndian64(const uint8_t *source) {
+            uint64_t value = 0;
+            for (int i = 0; i < 8; i++) {
+                value = (value << 8) | source[i];
+            }
+            return value;
+        }
+
+        inline uint64_t nowMicros() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+        }
+
+        /*
+         * Shared, writable mapping of a file that is appended to. The file is extended in large steps, so
+         * appends are plain memory copies almost always.
+         */
+        class AppendMappedFile {
+        private:
+            int _fd = -1;
+            uint8_t *_data = nullptr;
+            size_t _size = 0;
+            size_t _capacity = 0;
+            size_t _step;
+
+            void _map(size_t capacity) {
+                if (_data) {
+                    ::munmap(_data, _capacity);
+                    _data = nullptr;
+                }
+                if (::ftruncate(_fd, static_cast<off_t>(capacity)) < 0) {
+                    throw mav::NetworkError("Could not extend log file", errno);
+                }
+                void *data = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+                if (data == MAP_FAILED) {
+                    throw mav::NetworkError("Could not map log file", errno);
+                }
+                _data = static_cast<uint8_t*>(data);
+                _capacity = capacity;
+            }
+
+        public:
+            AppendMappedFile(const std::string &path, size_t step) : _step(std::max<size_t>(step, 4096)) {
+                _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (_fd < 0) {
+                    throw mav::NetworkError("Could not open " + path, errno);
+                }
+                _map(_step);
+            }
+
+            AppendMappedFile(const AppendMappedFile&) = delete;
+            AppendMappedFile& operator=(const AppendMappedFile&) = delete;
+
+            ~AppendMappedFile() {
+                close();
+            }
+
+            // Returns a pointer to size writable bytes at the end of the file
+            uint8_t* append(size_t size) {
+                if (_size + size > _capacity) {
+                    _map(std::max(_capacity + _step, _size + size));
+                }
+                auto destination = _data + _size;
+                _size += size;
+                return destination;
+            }
+
+            [[nodiscard]] size_t size() const {
+                return _size;
+            }
+
+            void close() {
+                if (_fd < 0) {
+                    return;
+                }
+                ::munmap(_data, _capacity);
+                _data = nullptr;
+                (void)::ftruncate(_fd, static_cast<off_t>(_size));
+                ::close(_fd);
+                _fd = -1;
+            }
+        };
+    }
+
+    /*
+     * Decorator that records all frames passing through an interface into a tlog, while the runtime uses
+     * it as usual:
+     *
+     *      TlogRecorder recorder(message_set, phy, "flight.tlog");
+     *      mav::NetworkRuntime net{message_set, own_heartbeat, recorder};
+     *
+     * Received bytes are framed as the runtime reads them, so recording adds a copy per frame but no
+     * extra reads. Only frames that pass verification against the message set are recorded, unless
+     * TlogRecorderConfig::record_unknown is set. The log and its index are complete once finish() was called or the recorder destroyed.
+     */
+    class TlogRecorder : public mav::NetworkInterface {
+    private:
+        mav::NetworkInterface &_interface;
+        std::string _path;
+        TlogRecorderConfig _config;
+
+        std::mutex _mutex;
+        detail::AppendMappedFile _file;
+        std::vector<TlogIndexEntry> _time_index;
+        std::map<uint32_t, std::vector<uint64_t>> _message_index;
+        uint64_t _frames = 0;
+        bool _finished = false;
+
+        // receive side framing, only touched by the receiving thread
+        FrameAssembler _assembler;
+        CrcExtraCache _crc_extra;
+        mav::ConnectionPartner _last_partner;
+
+        void _append(const uint8_t *frame, int length) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_finished) {
+                return;
+            }
+            auto timestamp = detail::nowMicros();
+            uint64_t offset = _file.size();
+            auto destination = _file.append(TLOG_TIMESTAMP_SIZE + length);
+            detail::storeBigEndian64(destination, timestamp);
+            std::memcpy(destination + TLOG_TIMESTAMP_SIZE, frame, length);
+            if (_frames % static_cast<uint64_t>(_config.index_interval) == 0) {
+                _time_index.push_back({timestamp, offset});
+            }
+            if (_config.index_message_ids) {
+                _message_index[FrameHeader{frame}.messageId()].push_back(offset);
+            }
+            _frames++;
+        }
+
+        void _writeIndex() {
+            auto temporary = _path + ".idx.tmp";
+            std::FILE *file = std::fopen(temporary.c_str(), "wb");
+            if (!file) {
+                return;
+            }
+            auto write64 = [file](uint64_t value) { std::fwrite(&value, sizeof(value), 1, file); };
+            write64(detail::TLOG_INDEX_MAGIC);
+            write64(_file.size());
+            write64(_time_index.size());
+            write64(_message_index.size());
+            std::fwrite(_time_index.data(), sizeof(TlogIndexEntry), _time_index.size(), file);
+            for (const auto &[message_id, offsets] : _message_index) {
+                write64(message_id);
+                write64(offsets.size());
+                std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file);
+            }
+            bool ok = std::fclose(file) == 0;
+            if (ok) {
+                std::rename(temporary.c_str(), (_path + ".idx").c_str());
+            } else {
+                std::remove(temporary.c_str());
+            }
+        }
+
+    public:
+        TlogRecorder(const mav::MessageSet &message_set, mav::NetworkInterface &interface, const std::string &path,
+                     const TlogRecorderConfig &config = {}) :
+            _interface(interface), _path(path), _config(config), _file(path, config.preallocate_bytes),
+            _crc_extra(message_set) {
+            _config.index_interval = std::max(1, _config.index_interval);
+            _assembler.setKeepUnknown(_config.record_unknown);
+        }
+
+        TlogRecorder(const TlogRecorder&) = delete;
+        TlogRecorder& operator=(const TlogRecorder&) = delete;
+
+        ~TlogRecorder() override {
+            finish();
+        }
+
+        /*
+         * Stops recording, truncates the log to its length and writes the index.
+         */
+        void finish() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_finished) {
+                return;
+            }
+            _finished = true;
+            _file.close();
+            _writeIndex();
+        }
+
+        [[nodiscard]] uint64_t framesRecorded() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _frames;
+        }
+
+        void close() const override {
+            _interface.close();
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return _interface.isConnectionOpen();
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner partner) override {
+            _interface.send(data, size, partner);
+            if (!_config.record_sent) {
+                return;
+            }
+            // a write can carry several frames, e.g. from a coalescing QueuedInterface, and each one gets its
+            // own entry; a trailing partial frame is not recorded
+            uint32_t offset = 0;
+            while (size - offset >= static_cast<uint32_t>(HEADER_SIZE_V1)) {
+                const uint8_t *frame = data + offset;
+                if (!FrameHeader::isMagic(frame[0]) ||
+                        size - offset < static_cast<uint32_t>(FrameHeader::headerSize(frame[0]))) {
+                    break;
+                }
+                auto length = static_cast<uint32_t>(FrameHeader{frame}.frameLength());
+                if (length > size - offset) {
+                    break;
+                }
+                _append(frame, static_cast<int>(length));
+                offset += length;
+            }
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            auto partner = _interface.receive(destination, size);
+            if (partner != _last_partner) {
+                // frames never continue across partners
+                _assembler.reset();
+                _last_partner = partner;
+            }
+            _assembler.push(destination, size, &_crc_extra, [this](const uint8_t *frame, int length) {
+                _append(frame, length);
+            });
+            return partner;
+        }
+
+        void markMessageBoundary() override {
+            _interface.markMessageBoundary();
+        }
+    };
+
+    /*
+     * Sequential and indexed access to a tlog through a read-only mapping. The index written by
+     * TlogRecorder is used when it belongs to the log; without it, seeking falls back to a linear scan.
+     */
+    class TlogReader {
+    public:
+        struct Entry {
+            uint64_t timestamp_us = 0;
+            uint64_t offset = 0;
+            FrameView frame;
+        };
+
+    private:
+        MappedFile _file;
+        size_t _cursor = 0;
+        std::vector<TlogIndexEntry> _time_index;
+        std::map<uint32_t, std::vector<uint64_t>> _message_index;
+        bool _has_index = false;
+
+        void _loadIndex(const std::string &path) {
+            MappedFile index(path + ".idx");
+            if (!index.valid() || index.size() < 4 * sizeof(uint64_t)) {
+                return;
+            }
+            const uint8_t *data = index.data();
+            const uint8_t *end = data + index.size();
+            auto read64 = [&data, end](uint64_t &value) {
+                if (end - data < static_cast<ptrdiff_t>(sizeof(uint64_t))) {
+                    return false;
+                }
+                std::memcpy(&value, data, sizeof(value));
+                data += sizeof(value);
+                return true;
+            };
+            uint64_t magic, log_size, time_count, message_count;
+            read64(magic);
+            read64(log_size);
+            read64(time_count);
+            read64(message_count);
+            if (magic != detail::TLOG_INDEX_MAGIC || log_size != _file.size() ||
+                static_cast<uint64_t>(end - data) / sizeof(TlogIndexEntry) < time_count) {
+                return;
+            }
+            _time_index.resize(time_count);
+            std::memcpy(_time_index.data(), data, time_count * sizeof(TlogIndexEntry));
+            data += time_count * sizeof(TlogIndexEntry);
+            for (uint64_t i = 0; i < message_count; i++) {
+                uint64_t message_id, count;
+                if (!read64(message_id) || !read64(count) ||
+                    static_cast<uint64_t>(end - data) / sizeof(uint64_t) < count) {
+                    _time_index.clear();
+                    _message_index.clear();
+                    return;
+                }
+                auto &offsets = _message_index[static_cast<uint32_t>(message_id)];
+                offsets.resize(count);
+                std::memcpy(offsets.data(), data, count * sizeof(uint64_t));
+                data += count * sizeof(uint64_t);
+            }
+            _has_index = true;
+        }
+
+    public:
+        explicit TlogReader(const std::string &path) : _file(path) {
+            if (_file.valid()) {
+                _loadIndex(path);
+            }
+        }
+
+        [[nodiscard]] bool valid() const {
+            return _file.valid();
+        }
+
+        [[nodiscard]] bool hasIndex() const {
+            return _has_index;
+        }
+
+        /*
+         * Reads the entry at offset without moving the cursor. Returns false past the end, or if the data
+         * at offset is not a complete entry.
+         */
+        bool read(uint64_t offset, Entry &entry) const {
+            size_t available = offset < _file.size() ? _file.size() - offset : 0;
+            if (available < static_cast<size_t>(TLOG_TIMESTAMP_SIZE + HEADER_SIZE_V1)) {
+                return false;
+            }
+            const uint8_t *data = _file.data() + offset;
+            const uint8_t *frame = data + TLOG_TIMESTAMP_SIZE;
+            if (!FrameHeader::isMagic(frame[0]) ||
+                available < static_cast<size_t>(TLOG_TIMESTAMP_SIZE + FrameHeader::headerSize(frame[0]))) {
+                return false;
+            }
+            int length = FrameHeader{frame}.frameLength();
+            if (available < static_cast<size_t>(TLOG_TIMESTAMP_SIZE + length)) {
+                return false;
+            }
+            entry.timestamp_us = detail::loadBigEndian64(data);
+            entry.offset = offset;
+            entry.frame = FrameView{frame, length};
+            return true;
+        }
+
+        /*
+         * Reads the entry at the cursor and advances it.
+         */
+        bool next(Entry &entry) {
+            if (!read(_cursor, entry)) {
+                return false;
+            }
+            _cursor += TLOG_TIMESTAMP_SIZE + entry.frame.length();
+            return true;
+        }
+
+        void rewind() {
+            _cursor = 0;
+        }
+
+        /*
+         * Moves the cursor to an entry offset, e.g. one from offsetsFor().
+         */
+        void seek(uint64_t offset) {
+            _cursor = static_cast<size_t>(offset);
+        }
+
+        /*
+         * Moves the cursor to the first entry at or after the timestamp.
+         */
+        void seekTime(uint64_t timestamp_us) {
+            _cursor = 0;
+            if (_has_index && !_time_index.empty()) {
+                auto it = std::upper_bound(_time_index.begin(), _time_index.end(), timestamp_us,
+                    [](uint64_t value, const TlogIndexEntry &entry) { return value <= entry.timestamp_us; });
+                if (it != _time_index.begin()) {
+                    _cursor = static_cast<size_t>(std::prev(it)->offset);
+                }
+            }
+            Entry entry;
+            while (read(_cursor, entry) && entry.timestamp_us < timestamp_us) {
+                _cursor += TLOG_TIMESTAMP_SIZE + entry.frame.length();
+            }
+        }
+
+        /*
+         * Offsets of all entries with the message id, or nullptr if the log has no message index.
+         */
+        [[nodiscard]] const std::vector<uint64_t>* offsetsFor(uint32_t message_id) const {
+            static const std::vector<uint64_t> none;
+            if (!_has_index) {
+                return nullptr;
+            }
+            auto it = _message_index.find(message_id);
+            return it == _message_index.end() ? &none : &it->second;
+        }
+    };
+
+    struct TlogReplayConfig {
+        // Replay speed relative to the recording, 0 replays as fast as possible
+        double speed = 1.0;
+        // Partner all frames appear to come from
+        mav::ConnectionPartner partner{0, 0, false};
+        // Skip the log up to this time, 0 starts at the beginning
+        uint64_t start_time_us = 0;
+    };
+
+    /*
+     * NetworkInterface that plays back a tlog, so recorded flights can be fed through the regular
+     * NetworkRuntime / Connection API:
+     *
+     *      TlogReplay replay("flight.tlog", {0.0});
+     *      mav::NetworkRuntime net{message_set, replay};
+     *
+     * Sends are discarded. At the end of the log, receive() blocks until the interface is closed, so the
+     * connection stays up for inspection; use finished() or waitFinished() to tell when replay is done.
+     */
+    class TlogReplay : public mav::NetworkInterface {
+    private:
+        TlogReader _reader;
+        TlogReplayConfig _config;
+
+        mutable std::mutex _mutex;
+        mutable std::condition_variable _condition;
+        mutable std::atomic_bool _should_terminate{false};
+        bool _finished = false;
+
+        // receive side, only touched by the receiving thread
+        TlogReader::Entry _entry;
+        int _offset = 0;
+        bool _has_entry = false;
+        bool _started = false;
+        uint64_t _first_timestamp = 0;
+        std::chrono::steady_clock::time_point _start_time;
+        std::atomic<uint64_t> _frames{0};
+
+        void _nextEntry() {
+            if (!_reader.next(_entry)) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _finished = true;
+                _condition.notify_all();
+                _condition.wait(lock, [this] { return _should_terminate.load(); });
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            if (!_started) {
+                _started = true;
+                _first_timestamp = _entry.timestamp_us;
+                _start_time = std::chrono::steady_clock::now();
+            }
+            if (_config.speed > 0 && _entry.timestamp_us > _first_timestamp) {
+                auto delay = std::chrono::microseconds(static_cast<int64_t>(
+                    static_cast<double>(_entry.timestamp_us - _first_timestamp) / _config.speed));
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait_until(lock, _start_time + delay, [this] { return _should_terminate.load(); });
+            }
+            if (_should_terminate) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            _offset = 0;
+            _has_entry = true;
+            _frames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    public:
+        explicit TlogReplay(const std::string &path, const TlogReplayConfig &config = {}) :
+                _reader(path), _config(config) {
+            if (!_reader.valid()) {
+                throw mav::NetworkError("Could not open " + path, ENOENT);
+            }
+            if (_config.start_time_us > 0) {
+                _reader.seekTime(_config.start_time_us);
+            }
+        }
+
+        [[nodiscard]] bool finished() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _finished;
+        }
+
+        void waitFinished() const {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this] { return _finished || _should_terminate.load(); });
+        }
+
+        [[nodiscard]] uint64_t framesReplayed() const {
+            return _frames.load(std::memory_order_relaxed);
+        }
+
+        void close() const override {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _should_terminate = true;
+            _condition.notify_all();
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return !_should_terminate;
+        }
+
+        void send(const uint8_t *, uint32_t, mav::ConnectionPartner) override {}
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            while (copied < size) {
+                if (!_has_entry || _offset >= _entry.frame.length()) {
+                    _nextEntry();
+                }
+                auto chunk = std::min<uint32_t>(size - copied, static_cast<uint32_t>(_entry.frame.length() - _offset));
+                std::memcpy(destination + copied, _entry.frame.data() + _offset, chunk);
+                _offset += static_cast<int>(chunk);
+                copied += chunk;
+            }
+            return _config.partner;
+        }
+
+        void markMessageBoundary() override {
+            _offset = _has_entry ? _entry.frame.length() : 0;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_TLOG_H
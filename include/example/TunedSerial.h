@@ -0,0 +1,328 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_TUNEDSERIAL_H
+#define LIBMAV_EXAMPLE_TUNEDSERIAL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+#endif
+
+#include <mav/Network.h>
+
+namespace example {
+
+    struct SerialConfig {
+        int baud_rate = 921600;
+        bool flow_control = false;
+        // Bytes requested per read(). Large reads drain the driver buffer in one syscall at high baud rates.
+        int read_chunk_size = 4096;
+        // termios VMIN / VTIME (tenths of a second), applied once poll() reported data. With the default 0 / 0,
+        // read() returns whatever has arrived. vmin > 1 collects larger chunks per read(), but should come with
+        // a non-zero vtime, or a quiet line stalls the read (and close()) until vmin bytes arrived.
+        int vmin = 0;
+        int vtime = 0;
+        // Sets ASYNC_LOW_LATENCY, which makes the driver push received bytes to the tty layer right away
+        // instead of on its next timer tick. Not every driver supports it, see TunedSerial::lowLatency().
+        bool low_latency = true;
+    };
+
+    /*
+     * Counters for tuning the read side. If full_reads is a large share of read_calls, the driver had more
+     * data waiting than one read could take, and a larger read_chunk_size saves syscalls.
+     */
+    struct SerialStats {
+        uint64_t read_calls = 0;
+        uint64_t bytes_read = 0;
+        uint64_t largest_read = 0;
+        uint64_t full_reads = 0;
+        uint64_t bytes_written = 0;
+    };
+
+    namespace detail {
+        inline speed_t toSpeed(int baud_rate) {
+            switch (baud_rate) {
+                case 9600: return B9600;
+                case 19200: return B19200;
+                case 38400: return B38400;
+                case 57600: return B57600;
+                case 115200: return B115200;
+                case 230400: return B230400;
+#ifdef B460800
+                case 460800: return B460800;
+#endif
+#ifdef B500000
+                case 500000: return B500000;
+#endif
+#ifdef B921600
+                case 921600: return B921600;
+#endif
+#ifdef B1000000
+                case 1000000: return B1000000;
+#endif
+#ifdef B1500000
+                case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+                case 2000000: return B2000000;
+#endif
+#ifdef B3000000
+                case 3000000: return B3000000;
+#endif
+#ifdef B4000000
+                case 4000000: return B4000000;
+#endif
+                default:
+                    throw mav::NetworkError("Unsupported baud rate " + std::to_string(baud_rate), EINVAL);
+            }
+        }
+    }
+
+    /*
+     * Alternative to mav::Serial for high baud rate links. Reads go through a user space buffer of
+     * read_chunk_size bytes, so that a frame costs a fraction of a syscall rather than one read() per
+     * header and payload, and the termios and driver settings are exposed for tuning. Pair it with a
+     * FrameAssembler or FrameReader, which scan line noise for the next magic byte with memchr().
+     */
+    class TunedSerial : public mav::NetworkInterface {
+    private:
+        int _fd = -1;
+        // written on close() to wake up a receive blocked in poll()
+        int _wakeup[2] = {-1, -1};
+        mutable std::atomic_bool _should_terminate{false};
+        SerialConfig _config;
+        bool _low_latency = false;
+
+        // receive side, only touched by the receiving thread
+        std::vector<uint8_t> _rx_buffer;
+        size_t _rx_begin = 0;
+        size_t _rx_end = 0;
+
+        std::mutex _tx_mutex;
+
+        mutable std::mutex _stats_mutex;
+        SerialStats _stats;
+
+        void _configure(const std::string &device) {
+            termios tty{};
+            if (::tcgetattr(_fd, &tty) < 0) {
+                throw mav::NetworkError("Could not get attributes of " + device, errno);
+            }
+            ::cfmakeraw(&tty);
+            tty.c_cflag |= CLOCAL | CREAD;
+            if (_config.flow_control) {
+                tty.c_cflag |= CRTSCTS;
+            } else {
+                tty.c_cflag &= ~CRTSCTS;
+            }
+            tty.c_cc[VMIN] = static_cast<cc_t>(std::clamp(_config.vmin, 0, 255));
+            tty.c_cc[VTIME] = static_cast<cc_t>(std::clamp(_config.vtime, 0, 255));
+            auto speed = detail::toSpeed(_config.baud_rate);
+            if (::cfsetispeed(&tty, speed) < 0 || ::cfsetospeed(&tty, speed) < 0 ||
+                    ::tcsetattr(_fd, TCSANOW, &tty) < 0) {
+                throw mav::NetworkError("Could not configure " + device, errno);
+            }
+            ::tcflush(_fd, TCIOFLUSH);
+
+#ifdef __linux__
+            if (_config.low_latency) {
+                serial_struct serial{};
+                if (::ioctl(_fd, TIOCGSERIAL, &serial) == 0) {
+                    serial.flags |= ASYNC_LOW_LATENCY;
+                    _low_latency = ::ioctl(_fd, TIOCSSERIAL, &serial) == 0;
+                }
+            }
+#endif
+            // opened non-blocking so that open() does not wait for carrier detect, but VMIN / VTIME only
+            // apply to blocking reads
+            int flags = ::fcntl(_fd, F_GETFL);
+            if (flags < 0 || ::fcntl(_fd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+                throw mav::NetworkError("Could not configure " + device, errno);
+            }
+        }
+
+        void _fillReceiveBuffer() {
+            while (true) {
+                pollfd fds[2] = {{_fd, POLLIN, 0}, {_wakeup[0], POLLIN, 0}};
+                int ready = ::poll(fds, 2, -1);
+                if (_should_terminate) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+                if (ready < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw mav::NetworkError("Could not poll serial port", errno);
+                }
+                if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                    throw mav::NetworkError("Serial port disconnected", EIO);
+                }
+                if (!(fds[0].revents & POLLIN)) {
+                    continue;
+                }
+                auto length = ::read(_fd, _rx_buffer.data(), _rx_buffer.size());
+                if (_should_terminate) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+                if (length < 0) {
+                    if (errno == EINTR || errno == EAGAIN) {
+                        continue;
+                    }
+                    throw mav::NetworkError("Could not read from serial port", errno);
+                }
+                if (length == 0) {
+                    continue;
+                }
+                _rx_begin = 0;
+                _rx_end = static_cast<size_t>(length);
+
+                std::lock_guard<std::mutex> lock(_stats_mutex);
+                _stats.read_calls++;
+                _stats.bytes_read += _rx_end;
+                _stats.largest_read = std::max<uint64_t>(_stats.largest_read, _rx_end);
+                if (_rx_end == _rx_buffer.size()) {
+                    _stats.full_reads++;
+                }
+                return;
+            }
+        }
+
+    public:
+        explicit TunedSerial(const std::string &device, const SerialConfig &config = {}) :
+            _config(config), _rx_buffer(static_cast<size_t>(std::max(config.read_chunk_size, 1))) {
+            _fd = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+            if (_fd < 0) {
+                throw mav::NetworkError("Could not open " + device, errno);
+            }
+            try {
+                _configure(device);
+                if (::pipe(_wakeup) < 0) {
+                    throw mav::NetworkError("Could not create wakeup pipe", errno);
+                }
+            } catch (...) {
+                ::close(_fd);
+                throw;
+            }
+        }
+
+        TunedSerial(const TunedSerial&) = delete;
+        TunedSerial& operator=(const TunedSerial&) = delete;
+
+        ~TunedSerial() override {
+            close();
+            ::close(_fd);
+            ::close(_wakeup[0]);
+            ::close(_wakeup[1]);
+        }
+
+        void close() const override {
+            if (_should_terminate.exchange(true)) {
+                return;
+            }
+            uint8_t byte = 0;
+            [[maybe_unused]] auto written = ::write(_wakeup[1], &byte, 1);
+        }
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return !_should_terminate;
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner) override {
+            std::lock_guard<std::mutex> lock(_tx_mutex);
+            uint32_t sent = 0;
+            while (sent < size) {
+                if (_should_terminate) {
+                    throw mav::NetworkInterfaceInterrupt();
+                }
+                auto length = ::write(_fd, data + sent, size - sent);
+                if (length < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw mav::NetworkError("Could not write to serial port", errno);
+                }
+                sent += static_cast<uint32_t>(length);
+            }
+            std::lock_guard<std::mutex> stats_lock(_stats_mutex);
+            _stats.bytes_written += size;
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            uint32_t copied = 0;
+            while (copied < size) {
+                if (_rx_begin == _rx_end) {
+                    _fillReceiveBuffer();
+                }
+                auto chunk = std::min<size_t>(size - copied, _rx_end - _rx_begin);
+                std::memcpy(destination + copied, _rx_buffer.data() + _rx_begin, chunk);
+                _rx_begin += chunk;
+                copied += static_cast<uint32_t>(chunk);
+            }
+            return {0, 0, true};
+        }
+
+        /*
+         * True if ASYNC_LOW_LATENCY was requested and the driver accepted it.
+         */
+        [[nodiscard]] bool lowLatency() const {
+            return _low_latency;
+        }
+
+        [[nodiscard]] SerialStats stats() const {
+            std::lock_guard<std::mutex> lock(_stats_mutex);
+            return _stats;
+        }
+
+        [[nodiscard]] const SerialConfig& config() const {
+            return _config;
+        }
+    };
+}
+
+#endif //LIBMAV_EXAMPLE_TUNEDSERIAL_H
@@ -34,26 +34,40 @@
 
 
 #include <iostream>
+#include <string_view>
 
 #include <mav/MessageSet.h>
 #include <mav/Message.h>
 #include <mav/Network.h>
 #include <mav/UDPServer.h>
 
+#include <example/MessageFields.h>
+#include <example/ParameterClient.h>
+#include <example/Snapshot.h>
+
 
 int main(int argc, char** argv) {
     /*
      * libmav does not include any messages. All messages to be used are just loaded from an
      * XML file. This project contains the official mavlink repo as a submodule, so we can just
      * use the development.xml file from there.
+     * Parsing development.xml and all of its includes takes a moment. The build therefore also produces a
+     * snapshot, a single pre-resolved file without documentation, that loads considerably faster. It is only
+     * used if it was generated from the same definitions this program was built with, otherwise we fall back
+     * to the original XML.
      */
-    mav::MessageSet message_set{"mavlink/development.xml"};
+    mav::MessageSet message_set;
+    if (!example::addFromSnapshot(message_set, "mavlink/development.snapshot.xml", example::msg::SOURCE_HASH)) {
+        message_set.addFromXML("mavlink/development.xml");
+    }
     /*
      * We connect to PX4 SITL here. You may wonder why we use UDPServer and not UDPClient here. MAVLink works in
      * the opposite order of what you'd expect here, in fact, PX4 SITL just sends a mavlink stream to 127.0.0.1:14550,
      * no matter if someone is listening there or not. So we'll have to put a server to listen on this port
      * to receive the stream. The UDPClient you would use in case you had a real mavlink UDP server listening on
      * known port.
+     * To exchange frames with a process on the same machine without the network stack, e.g. a simulator, an
+     * example::SharedMemoryServer phy{"/libmav-example"} from <example/SharedMemory.h> can be used here instead.
      */
     mav::UDPServer phy{14550};
 
@@ -154,6 +168,17 @@ int main(int argc, char** argv) {
      */
     std::cout << response["flight_sw_version"].as<int>() << std::endl;
 
+    /*
+     * Looking up a field by name is convenient, but it costs a string lookup on every access. For hot paths, the
+     * build generates constexpr field descriptors from the same development.xml (see tools/generate_fields.py).
+     * Reading through them is a load from a fixed offset, and the field type is known at compile time.
+     * Since the descriptors are baked in at build time, check once that they match the loaded message set.
+     */
+    if (example::matches(message_set, example::msg::MESSAGES)) {
+        uint16_t typed_product_id = example::get(response, example::msg::AUTOPILOT_VERSION::product_id);
+        std::cout << "Product ID (typed): " << typed_product_id << std::endl;
+    }
+
 
     /*
      * In this example, we request a param value from the Autpilot. The transaction is simular to the example above
@@ -181,6 +206,16 @@ int main(int argc, char** argv) {
      */
     std::string param_id = response["param_id"];
 
+    /*
+     * That copies the string. The typed accessors hand out a std::string_view into the message instead, and
+     * example::view() does the same for numeric arrays like AUTOPILOT_VERSION uid2. Like the views on raw
+     * frames (example::FrameView), they respect MAVLink v2 payload truncation without copying.
+     */
+    if (example::matches(message_set, example::msg::MESSAGES)) {
+        std::string_view param_id_view = example::getString(response, example::msg::PARAM_VALUE::param_id);
+        std::cout << "Param ID (view): " << param_id_view << std::endl;
+    }
+
     /*
      * This is another mavlink oddity: In some protocols, float fields are used to transmit 32-bit integers.
      * Since libmav sees this value as a float value, you have to explicitly tell it to unpack the bytes as an integer.
@@ -191,5 +226,15 @@ int main(int argc, char** argv) {
 
     std::cout << "Param ID: " << param_id << std::endl;
     std::cout << "Param Value: " << param_value << std::endl;
+
+    /*
+     * Requesting parameters one by one like above is fine for a few values. To download the whole table, the
+     * ParameterClient helper requests the full list, keeps track of which indices arrived and re-requests
+     * the missing ones, with several requests in flight at a time.
+     */
+    example::ParameterClient parameters{message_set, connection};
+    if (parameters.fetchAll(5000)) {
+        std::cout << "Downloaded " << parameters.count() << " parameters" << std::endl;
+    }
     return 0;
 }
@@ -0,0 +1,324 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <mav/Message.h>
+#include <mav/Network.h>
+
+#include <example/Expectations.h>
+#include <example/PeerTable.h>
+#include <example/ShardedReceiver.h>
+#include <example/SpscQueue.h>
+
+#include "Interfaces.h"
+#include "Test.h"
+
+/*
+ * The lock-free and sharded primitives, each driven from several threads at once. Under a sanitizer build
+ * (-fsanitize=thread) these double as race tests.
+ */
+
+namespace {
+
+    mav::Message heartbeat(uint8_t system_id, uint8_t sequence = 0) {
+        auto message = test::messageSet().create("HEARTBEAT");
+        message.finalize(sequence, {system_id, 1});
+        return message;
+    }
+
+    // Waits for the condition with a generous timeout, so a lost wakeup fails the test instead of hanging it
+    template <typename F>
+    bool eventually(F condition) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+        while (!condition()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+        return true;
+    }
+
+    // Serves its datagrams, then blocks like an idle socket until it is closed
+    class IdleAfterDatagrams : public test::DatagramInterface {
+    private:
+        mutable std::mutex _mutex;
+        mutable std::condition_variable _closed_signal;
+        mutable bool _closed = false;
+
+    public:
+        void close() const override {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _closed_signal.notify_all();
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            try {
+                return DatagramInterface::receive(destination, size);
+            } catch (const mav::NetworkInterfaceInterrupt&) {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _closed_signal.wait(lock, [this] { return _closed; });
+                throw;
+            }
+        }
+    };
+}
+
+static test::Register spsc_queue_bounds{"concurrency/spsc_queue_bounds", [] {
+    example::SpscQueue<int> queue(5);
+    TEST_CHECK(queue.capacity() == 8);
+    for (int i = 0; i < 8; i++) {
+        TEST_CHECK(queue.push(int{i}));
+    }
+    int rejected = 99;
+    TEST_CHECK(!queue.push(std::move(rejected)));
+    TEST_CHECK(queue.size() == 8);
+    int item = -1;
+    for (int i = 0; i < 8; i++) {
+        TEST_CHECK(queue.pop(item) && item == i);
+    }
+    TEST_CHECK(!queue.pop(item));
+    TEST_CHECK(queue.empty());
+}};
+
+static test::Register spsc_queue_threads{"concurrency/spsc_queue_threads", [] {
+    constexpr int COUNT = 200000;
+    example::SpscQueue<int> queue(64);
+    std::thread producer([&queue] {
+        for (int i = 0; i < COUNT; i++) {
+            int item = i;
+            while (!queue.push(std::move(item))) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    int expected = 0;
+    bool in_order = true;
+    while (expected < COUNT) {
+        int item;
+        if (!queue.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        in_order = in_order && item == expected;
+        expected++;
+    }
+    producer.join();
+    TEST_CHECK(in_order);
+    TEST_CHECK(queue.empty());
+}};
+
+static test::Register expectation_table_matching{"concurrency/expectation_table_matching", [] {
+    example::ExpectationTable table;
+    int any = 0;
+    int from_two = 0;
+    int predicate_false = 0;
+    table.arm(0, -1, -1, nullptr, [&any](const mav::Message &) { any++; });
+    auto ticket = table.arm(0, 2, -1, nullptr, [&from_two](const mav::Message &) { from_two++; });
+    auto never = table.arm(0, -1, -1, [](const mav::Message &) { return false; },
+                           [&predicate_false](const mav::Message &) { predicate_false++; });
+
+    table.dispatch(heartbeat(1));
+    TEST_CHECK(any == 1);
+    TEST_CHECK(from_two == 0);
+    table.dispatch(heartbeat(2));
+    table.dispatch(heartbeat(2));
+    // each expectation fires once
+    TEST_CHECK(any == 1);
+    TEST_CHECK(from_two == 1);
+    TEST_CHECK(!table.cancel(ticket));
+    TEST_CHECK(table.cancel(never));
+    table.dispatch(heartbeat(1));
+    TEST_CHECK(predicate_false == 0);
+}};
+
+static test::Register expectation_table_rearm{"concurrency/expectation_table_rearm_during_dispatch", [] {
+    // a completion that arms the next expectation, like a coroutine awaiting the next message in a loop
+    example::ExpectationTable table;
+    std::vector<int> fired;
+    std::function<void(const mav::Message &)> completion = [&](const mav::Message &message) {
+        fired.push_back(example::FrameHeader{message.data()}.sequence());
+        table.arm(0, -1, -1, nullptr, completion);
+    };
+    table.arm(0, -1, -1, nullptr, completion);
+    table.dispatch(heartbeat(1, 1));
+    TEST_CHECK((fired == std::vector<int>{1}));
+    table.dispatch(heartbeat(1, 2));
+    TEST_CHECK((fired == std::vector<int>{1, 2}));
+}};
+
+static test::Register expectation_table_threads{"concurrency/expectation_table_threads", [] {
+    // arming and cancelling on one thread while another dispatches: every expectation is either cancelled
+    // or completed, exactly once
+    constexpr int COUNT = 20000;
+    example::ExpectationTable table;
+    std::atomic<int> completed{0};
+    std::atomic<int> cancelled{0};
+    std::atomic_bool armed_all{false};
+    std::thread dispatcher([&] {
+        auto message = heartbeat(1);
+        while (!armed_all || completed + cancelled < COUNT) {
+            table.dispatch(message);
+        }
+    });
+    for (int i = 0; i < COUNT; i++) {
+        auto ticket = table.arm(0, -1, -1, nullptr, [&completed](const mav::Message &) { completed++; });
+        if (i % 2 == 0 && table.cancel(ticket)) {
+            cancelled++;
+        }
+    }
+    armed_all = true;
+    bool settled = eventually([&] { return completed + cancelled >= COUNT; });
+    if (!settled) {
+        // unblock the dispatcher before failing
+        cancelled += COUNT;
+    }
+    dispatcher.join();
+    TEST_CHECK(settled);
+    TEST_CHECK(completed + cancelled == COUNT);
+}};
+
+static test::Register sharded_receiver_order{"concurrency/sharded_receiver_order", [] {
+    constexpr int PARTNERS = 8;
+    constexpr int FRAMES = 200;
+    IdleAfterDatagrams interface;
+    for (int i = 0; i < FRAMES; i++) {
+        for (int partner = 0; partner < PARTNERS; partner++) {
+            interface.add(test::frame(static_cast<uint8_t>(i)),
+                          {test::DatagramInterface::LOCALHOST, 20000 + partner, false});
+        }
+    }
+    // a frame that fails verification is counted, not delivered
+    auto corrupted = test::frame(0);
+    corrupted[11] ^= 0xFF;
+    interface.add(corrupted);
+
+    std::mutex mutex;
+    std::map<int, std::vector<int>> received;
+    std::atomic<int> count{0};
+    example::ShardConfig config;
+    config.shards = 3;
+    config.queue_capacity = PARTNERS * FRAMES;
+    example::ShardedReceiver receiver(test::messageSet(), interface, [&](const example::PooledFrame &frame) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received[frame.partner().port()].push_back(frame.view().header().sequence());
+        count++;
+    }, config);
+
+    TEST_CHECK(eventually([&count] { return count == PARTNERS * FRAMES; }));
+    receiver.stop();
+    TEST_CHECK(!receiver.error());
+    TEST_CHECK(received.size() == PARTNERS);
+    for (const auto &[port, sequences] : received) {
+        // frames of one partner stay in order
+        TEST_CHECK(sequences.size() == FRAMES);
+        for (int i = 0; i < FRAMES; i++) {
+            TEST_CHECK(sequences[i] == static_cast<uint8_t>(i));
+        }
+    }
+    uint64_t frames = 0;
+    uint64_t bad_checksum = 0;
+    for (size_t shard = 0; shard < receiver.shardCount(); shard++) {
+        frames += receiver.stats(shard).frames;
+        bad_checksum += receiver.stats(shard).bad_checksum;
+        TEST_CHECK(receiver.stats(shard).queue_full == 0);
+    }
+    TEST_CHECK(frames == PARTNERS * FRAMES);
+    TEST_CHECK(bad_checksum == 1);
+}};
+
+static test::Register peer_table_threads{"concurrency/peer_table_threads", [] {
+    constexpr int THREADS = 4;
+    constexpr int PEERS = 500;
+    example::PeerTable<int> table;
+    std::vector<std::thread> threads;
+    std::atomic<int> mismatches{0};
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&table, &mismatches, t] {
+            example::PeerTable<int>::LastHit cache;
+            for (int round = 0; round < 4; round++) {
+                for (int i = 0; i < PEERS; i++) {
+                    mav::ConnectionPartner partner{test::DatagramInterface::LOCALHOST, t * PEERS + i, false};
+                    table.seen(cache, partner, t * PEERS + i);
+                    auto value = table.find(cache, partner);
+                    if (!value || *value != t * PEERS + i) {
+                        mismatches++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    TEST_CHECK(mismatches == 0);
+    TEST_CHECK(table.size() == THREADS * PEERS);
+    TEST_CHECK(table.stats().inserted == THREADS * PEERS);
+}};
+
+static test::Register peer_table_eviction{"concurrency/peer_table_eviction", [] {
+    example::PeerTableConfig config;
+    config.idle_timeout = std::chrono::milliseconds{20};
+    example::PeerTable<int> table(config);
+    example::PeerTable<int>::LastHit cache;
+    mav::ConnectionPartner quiet{test::DatagramInterface::LOCALHOST, 1, false};
+    mav::ConnectionPartner busy{test::DatagramInterface::LOCALHOST, 2, false};
+    table.seen(cache, quiet, 1);
+    table.seen(cache, busy, 2);
+    std::this_thread::sleep_for(std::chrono::milliseconds{30});
+    TEST_CHECK(table.find(cache, busy) == 2);
+    std::vector<int> evicted;
+    TEST_CHECK(table.evictIdle([&evicted](const mav::ConnectionPartner &, int value) {
+        evicted.push_back(value);
+    }) == 1);
+    TEST_CHECK((evicted == std::vector<int>{1}));
+    TEST_CHECK(!table.find(quiet));
+
+    // a cached entry is not served any more once its peer is erased
+    TEST_CHECK(table.erase(busy));
+    TEST_CHECK(!table.find(cache, busy));
+    TEST_CHECK(table.size() == 0);
+}};
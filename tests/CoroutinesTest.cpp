@@ -0,0 +1,119 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <example/Coroutines.h>
+
+#include "Test.h"
+
+/*
+ * Task and syncWait(), only built with -DLIBMAV_EXAMPLE_COROUTINES=ON.
+ */
+
+namespace {
+
+    example::Task<int> square(int value) {
+        co_return value * value;
+    }
+
+    example::Task<int> sumOfSquares(int count) {
+        int sum = 0;
+        for (int i = 1; i <= count; i++) {
+            sum += co_await square(i);
+        }
+        co_return sum;
+    }
+
+    example::Task<void> fail() {
+        throw std::runtime_error("failed");
+        co_return;
+    }
+
+    example::Task<std::string> catchFailure() {
+        try {
+            co_await fail();
+        } catch (const std::runtime_error &e) {
+            co_return e.what();
+        }
+        co_return "not thrown";
+    }
+
+    // Suspends and is resumed from another thread, like an expectation completed by the receive thread
+    struct ResumeOnThread {
+        std::thread &thread;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            // the awaiter lives in the coroutine frame, which may be gone once the thread started
+            auto &target = thread;
+            target = std::thread([handle] { handle.resume(); });
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    example::Task<std::thread::id> resumedOn(std::thread &thread) {
+        co_await ResumeOnThread{thread};
+        co_return std::this_thread::get_id();
+    }
+}
+
+static test::Register coroutines_task_chain{"coroutines/task_chain", [] {
+    TEST_CHECK(example::syncWait(sumOfSquares(10)) == 385);
+}};
+
+static test::Register coroutines_task_exceptions{"coroutines/task_exceptions", [] {
+    TEST_CHECK(example::syncWait(catchFailure()) == "failed");
+    bool thrown = false;
+    try {
+        example::syncWait(fail());
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    TEST_CHECK(thrown);
+}};
+
+static test::Register coroutines_resume_on_thread{"coroutines/resume_on_thread", [] {
+    std::thread thread;
+    auto resumed_on = example::syncWait(resumedOn(thread));
+    TEST_CHECK(resumed_on == thread.get_id());
+    thread.join();
+}};
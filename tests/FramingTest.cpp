@@ -0,0 +1,308 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <mav/Network.h>
+
+#include <example/BatchedUDP.h>
+#include <example/CrcExtraCache.h>
+#include <example/FrameAssembler.h>
+#include <example/FrameReader.h>
+#include <example/MessageFilter.h>
+#include <example/Multiplexer.h>
+#include <example/Signing.h>
+#include <example/Tlog.h>
+
+#include "Interfaces.h"
+#include "Test.h"
+
+/*
+ * The decorators that frame what they receive: each has to pass on every frame of a datagram that carries
+ * several, recover from noise, and keep frames of different reads apart where the interface requires it.
+ */
+
+namespace {
+
+    // HEARTBEAT and ATTITUDE, with their payload lengths in the common message set
+    constexpr uint32_t HEARTBEAT = 0;
+    constexpr uint32_t ATTITUDE = 30;
+    constexpr int ATTITUDE_LENGTH = 28;
+
+    std::vector<int> assemble(example::FrameAssembler &assembler, const test::Bytes &bytes, size_t chunk) {
+        example::CrcExtraCache crc_extra(test::messageSet());
+        std::vector<int> sequences;
+        for (size_t offset = 0; offset < bytes.size(); offset += chunk) {
+            assembler.push(bytes.data() + offset, std::min(chunk, bytes.size() - offset), &crc_extra,
+                           [&sequences](const uint8_t *frame, int) {
+                sequences.push_back(example::FrameHeader{frame}.sequence());
+            });
+        }
+        return sequences;
+    }
+}
+
+static test::Register frame_reader_multi_frame_datagram{"framing/frame_reader_multi_frame_datagram", [] {
+    test::DatagramInterface interface;
+    interface.add(test::concat({test::frame(0), test::frame(1), test::frame(2)}));
+    interface.add(test::frame(9));
+    example::FrameReader reader(test::messageSet(), interface);
+    std::vector<uint8_t> destination(example::MAX_FRAME_SIZE);
+    mav::ConnectionPartner partner;
+    std::vector<int> sequences;
+    try {
+        while (true) {
+            reader.read(destination.data(), partner);
+            sequences.push_back(destination[4]);
+        }
+    } catch (const mav::NetworkInterfaceInterrupt&) {}
+    TEST_CHECK((sequences == std::vector<int>{0, 1, 2, 9}));
+    TEST_CHECK(reader.stats().frames == 4);
+}};
+
+static test::Register frame_reader_resync{"framing/frame_reader_resync", [] {
+    // a corrupted frame whose length covers the start of the next, a false magic byte and plain noise
+    auto corrupted = test::frame(1, ATTITUDE, ATTITUDE_LENGTH);
+    corrupted[12] ^= 0xFF;
+    corrupted.resize(16);
+    test::DatagramInterface interface;
+    interface.add(test::concat({test::frame(0), corrupted, test::frame(2), {0x12, example::MAGIC_V2, 0x34},
+                                test::frame(3)}));
+    example::FrameReader reader(test::messageSet(), interface);
+    std::vector<uint8_t> destination(example::MAX_FRAME_SIZE);
+    mav::ConnectionPartner partner;
+    std::vector<int> sequences;
+    try {
+        while (true) {
+            reader.read(destination.data(), partner);
+            sequences.push_back(destination[4]);
+        }
+    } catch (const mav::NetworkInterfaceInterrupt&) {}
+    TEST_CHECK((sequences == std::vector<int>{0, 2, 3}));
+    TEST_CHECK(reader.stats().bad_checksum >= 1);
+}};
+
+static test::Register frame_reader_unknown{"framing/frame_reader_unknown_message", [] {
+    for (bool keep : {false, true}) {
+        test::DatagramInterface interface;
+        interface.add(test::concat({test::frame(0), test::frame(1, test::UNKNOWN_MESSAGE_ID), test::frame(2)}));
+        example::FrameReader reader(test::messageSet(), interface);
+        reader.setKeepUnknown(keep);
+        std::vector<uint8_t> destination(example::MAX_FRAME_SIZE);
+        mav::ConnectionPartner partner;
+        std::vector<int> sequences;
+        try {
+            while (true) {
+                reader.read(destination.data(), partner);
+                sequences.push_back(destination[4]);
+            }
+        } catch (const mav::NetworkInterfaceInterrupt&) {}
+        TEST_CHECK(sequences == (keep ? std::vector<int>{0, 1, 2} : std::vector<int>{0, 2}));
+        TEST_CHECK(reader.stats().unknown_message == 1);
+    }
+}};
+
+static test::Register filtering_interface_multi_frame_datagram{"framing/filtering_interface_multi_frame_datagram", [] {
+    test::DatagramInterface interface;
+    interface.add(test::concat({test::frame(0), test::frame(1, ATTITUDE, ATTITUDE_LENGTH), test::frame(2)}));
+    interface.add(test::concat({test::frame(3), test::frame(4)}));
+    example::MessageFilter filter;
+    filter.allowMessage(HEARTBEAT);
+    example::FilteringInterface filtering(interface, filter);
+    TEST_CHECK((test::receiveSequences(filtering) == std::vector<int>{0, 2, 3, 4}));
+    TEST_CHECK(filtering.stats().accepted == 4);
+    TEST_CHECK(filtering.stats().rejected == 1);
+}};
+
+static test::Register signing_interface_round_trip{"framing/signing_interface_round_trip", [] {
+    auto key = example::SigningKey::fromPassphrase("test");
+    test::DatagramInterface sender_phy;
+    example::SigningInterface sender(test::messageSet(), sender_phy, key, 1);
+    for (uint8_t sequence : {0, 1, 2}) {
+        auto frame = test::frame(sequence);
+        sender.send(frame.data(), static_cast<uint32_t>(frame.size()), {});
+    }
+    TEST_CHECK(sender_phy.sent.size() == 3);
+    TEST_CHECK(example::FrameHeader{sender_phy.sent[0].data()}.isSigned());
+
+    // all signed frames in one datagram, followed by an unsigned and a tampered one
+    auto tampered = sender_phy.sent[2];
+    tampered[12] ^= 0xFF;
+    test::DatagramInterface receiver_phy;
+    receiver_phy.add(test::concat({sender_phy.sent[0], sender_phy.sent[1], sender_phy.sent[2], test::frame(7),
+                                   tampered}));
+    receiver_phy.add(test::concat({test::frame(8)}));
+    example::SigningInterface receiver(test::messageSet(), receiver_phy, key, 2);
+    std::vector<test::Bytes> frames;
+    try {
+        while (true) {
+            frames.push_back(test::receiveFrame(receiver));
+        }
+    } catch (const mav::NetworkInterfaceInterrupt&) {}
+    TEST_CHECK(frames.size() == 3);
+    for (size_t i = 0; i < frames.size(); i++) {
+        // handed on as plain v2 frames, with a checksum that still verifies
+        TEST_CHECK(test::sequenceOf(frames[i]) == static_cast<uint8_t>(i));
+        TEST_CHECK(!example::FrameHeader{frames[i].data()}.isSigned());
+        TEST_CHECK(frames[i] == test::frame(static_cast<uint8_t>(i)));
+    }
+    auto stats = receiver.stats();
+    TEST_CHECK(stats.verified == 3);
+    TEST_CHECK(stats.unsigned_rejected == 2);
+    TEST_CHECK(stats.bad_signature + stats.replayed == 1);
+}};
+
+static test::Register frame_assembler_chunks{"framing/frame_assembler_chunks", [] {
+    auto stream = test::concat({test::frame(0), test::frame(1, ATTITUDE, ATTITUDE_LENGTH), test::frame(2),
+                                test::frame(3)});
+    for (size_t chunk : {size_t{1}, size_t{7}, size_t{64}, stream.size()}) {
+        example::FrameAssembler assembler;
+        TEST_CHECK((assemble(assembler, stream, chunk) == std::vector<int>{0, 1, 2, 3}));
+        TEST_CHECK(assembler.idle());
+    }
+}};
+
+static test::Register frame_assembler_resync{"framing/frame_assembler_resync", [] {
+    // a truncated frame swallows the start of the next one, which the assembler has to find again
+    auto truncated = test::frame(1);
+    truncated.resize(8);
+    auto stream = test::concat({test::frame(0), truncated, test::frame(2), {0x00, example::MAGIC_V2},
+                                test::frame(3), test::frame(4)});
+    for (size_t chunk : {size_t{1}, size_t{5}, stream.size()}) {
+        example::FrameAssembler assembler;
+        TEST_CHECK((assemble(assembler, stream, chunk) == std::vector<int>{0, 2, 3, 4}));
+    }
+}};
+
+static test::Register frame_assembler_keep_unknown{"framing/frame_assembler_keep_unknown", [] {
+    auto stream = test::concat({test::frame(0), test::frame(1, test::UNKNOWN_MESSAGE_ID), test::frame(2)});
+    example::FrameAssembler dropping;
+    TEST_CHECK((assemble(dropping, stream, stream.size()) == std::vector<int>{0, 2}));
+    example::FrameAssembler keeping;
+    keeping.setKeepUnknown(true);
+    TEST_CHECK((assemble(keeping, stream, stream.size()) == std::vector<int>{0, 1, 2}));
+    TEST_CHECK(keeping.stats().unknown_frames == 1);
+}};
+
+static test::Register multiplexer_stream_source{"framing/multiplexer_stream_source", [] {
+    int fds[2];
+    TEST_CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    mav::ConnectionPartner serial{0, 1, true};
+    example::MultiplexedInterface mux(test::messageSet());
+    mux.addSource(std::make_shared<example::StreamSource>(fds[0], serial));
+
+    auto bytes = test::concat({test::frame(0), {0x55}, test::frame(1), test::frame(2)});
+    TEST_CHECK(::write(fds[1], bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()));
+    for (int sequence : {0, 1}) {
+        auto frame = test::receiveFrame(mux);
+        TEST_CHECK(test::sequenceOf(frame) == sequence);
+    }
+    // a read that does not fit the rest of the frame drops it, instead of mixing it with the next frame
+    uint8_t header[example::HEADER_SIZE_V2];
+    TEST_CHECK(mux.receive(header, 1) == serial);
+    TEST_CHECK(mux.discardedBytes() == 0);
+    mux.markMessageBoundary();
+    TEST_CHECK(mux.discardedBytes() == test::frame(2).size() - 1);
+
+    // sends go back to the source the partner was heard on
+    auto reply = test::frame(5);
+    mux.send(reply.data(), static_cast<uint32_t>(reply.size()), serial);
+    test::Bytes received(reply.size());
+    TEST_CHECK(::read(fds[1], received.data(), received.size()) == static_cast<ssize_t>(reply.size()));
+    TEST_CHECK(received == reply);
+    mux.send(reply.data(), static_cast<uint32_t>(reply.size()), {0x7F000001, 1234, false});
+    TEST_CHECK(mux.unroutableCount() == 1);
+    ::close(fds[1]);
+}};
+
+static test::Register batched_udp_multi_frame_datagram{"framing/batched_udp_multi_frame_datagram", [] {
+    example::BatchedUDPServer server(24550, "127.0.0.1");
+    example::BatchedUDPClient client("127.0.0.1", 24550);
+    auto datagram = test::concat({test::frame(0), test::frame(1), test::frame(2)});
+    client.send(datagram.data(), static_cast<uint32_t>(datagram.size()), {});
+    client.send(datagram.data(), 5, {});
+    auto last = test::frame(3);
+    client.send(last.data(), static_cast<uint32_t>(last.size()), {});
+
+    example::FrameReader reader(test::messageSet(), server);
+    std::vector<uint8_t> destination(example::MAX_FRAME_SIZE);
+    mav::ConnectionPartner partner;
+    for (int sequence : {0, 1, 2, 3}) {
+        reader.read(destination.data(), partner);
+        TEST_CHECK(destination[4] == sequence);
+    }
+    TEST_CHECK(server.stats().datagrams_received == 3);
+
+    // the partner is the client's ephemeral port, so replies find their way back
+    server.send(last.data(), static_cast<uint32_t>(last.size()), partner);
+    example::FrameReader client_reader(test::messageSet(), client);
+    TEST_CHECK(client_reader.read(destination.data(), partner) == static_cast<int>(last.size()));
+    TEST_CHECK(destination[4] == 3);
+}};
+
+static test::Register tlog_recorder{"framing/tlog_recorder", [] {
+    const std::string path = "test_recorder.tlog";
+    test::DatagramInterface interface;
+    interface.add(test::concat({test::frame(0), test::frame(1, ATTITUDE, ATTITUDE_LENGTH), test::frame(2)}));
+    {
+        example::TlogRecorder recorder(test::messageSet(), interface, path);
+        TEST_CHECK((test::receiveSequences(recorder) == std::vector<int>{0, 1, 2}));
+        // a coalesced write of two frames is two entries
+        auto sent = test::concat({test::frame(10), test::frame(11)});
+        recorder.send(sent.data(), static_cast<uint32_t>(sent.size()), {});
+        TEST_CHECK(recorder.framesRecorded() == 5);
+    }
+    example::TlogReader reader(path);
+    TEST_CHECK(reader.valid());
+    TEST_CHECK(reader.hasIndex());
+    std::vector<int> sequences;
+    example::TlogReader::Entry entry;
+    while (reader.next(entry)) {
+        sequences.push_back(entry.frame.header().sequence());
+    }
+    TEST_CHECK((sequences == std::vector<int>{0, 1, 2, 10, 11}));
+    TEST_CHECK(reader.offsetsFor(ATTITUDE) && reader.offsetsFor(ATTITUDE)->size() == 1);
+    std::remove(path.c_str());
+    std::remove((path + ".idx").c_str());
+}};
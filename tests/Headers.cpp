@@ -0,0 +1,83 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+
+
+#include <example/BatchedUDP.h>
+#include <example/Broadcaster.h>
+#include <example/ColumnarDecoder.h>
+#include <example/CommandClient.h>
+#include <example/Crc.h>
+#include <example/CrcExtraCache.h>
+#include <example/EpollTCPServer.h>
+#include <example/Expectations.h>
+#include <example/FieldHandle.h>
+#include <example/Fields.h>
+#include <example/Frame.h>
+#include <example/FrameAssembler.h>
+#include <example/FramePool.h>
+#include <example/FrameReader.h>
+#include <example/Lookup.h>
+#include <example/MappedFile.h>
+#include <example/MessageFilter.h>
+#include <example/Metrics.h>
+#include <example/Multiplexer.h>
+#include <example/ParameterClient.h>
+#include <example/PeerTable.h>
+#include <example/PeriodicScheduler.h>
+#include <example/Router.h>
+#include <example/SendQueue.h>
+#include <example/Sha256.h>
+#include <example/ShardedReceiver.h>
+#include <example/SharedMemory.h>
+#include <example/Signing.h>
+#include <example/Snapshot.h>
+#include <example/SpscQueue.h>
+#include <example/StreamSubscriptions.h>
+#include <example/TickArena.h>
+#include <example/Tlog.h>
+#include <example/TunedSerial.h>
+
+#include "Test.h"
+
+/*
+ * Includes every header, so that each one is compiled on its own even before it has a behavior test.
+ * Coroutines.h needs C++20 and is covered by CoroutinesTest.cpp in the -DLIBMAV_EXAMPLE_COROUTINES=ON build.
+ */
+
+static test::Register headers_self_contained{"headers/self_contained", [] {
+    TEST_CHECK(example::MAX_FRAME_SIZE == example::HEADER_SIZE_V2 + example::MAX_PAYLOAD_SIZE +
+                                          example::CHECKSUM_SIZE + example::SIGNATURE_SIZE);
+}};
@@ -0,0 +1,184 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_TEST_INTERFACES_H
+#define LIBMAV_EXAMPLE_TEST_INTERFACES_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <initializer_list>
+#include <vector>
+
+#include <mav/Network.h>
+
+#include <example/CrcExtraCache.h>
+#include <example/Frame.h>
+
+#include "Test.h"
+
+/*
+ * Frame builders and in-memory interfaces shared by the tests.
+ */
+namespace test {
+
+    using Bytes = std::vector<uint8_t>;
+
+    // Not in any message set. None of its bytes is a magic byte, which would make resynchronizing after it
+    // find a false frame start that swallows the next frame.
+    constexpr uint32_t UNKNOWN_MESSAGE_ID = 0x123456;
+
+    /*
+     * A v2 frame with a counting payload. The checksum uses the CRC_EXTRA of the message set, or 0 for
+     * unknown ids, so a frame of a known id verifies unless its bytes are altered afterwards.
+     */
+    inline Bytes frame(uint8_t sequence, uint32_t message_id = 0, int payload_length = 9, uint8_t system_id = 1) {
+        Bytes result = {example::MAGIC_V2, static_cast<uint8_t>(payload_length), 0, 0, sequence, system_id, 1,
+                        static_cast<uint8_t>(message_id), static_cast<uint8_t>(message_id >> 8),
+                        static_cast<uint8_t>(message_id >> 16)};
+        for (int i = 0; i < payload_length; i++) {
+            result.push_back(static_cast<uint8_t>(i + 1));
+        }
+        example::CrcExtraCache crc_extra(messageSet());
+        int extra = crc_extra.get(message_id);
+        auto checksum = example::frameChecksum(result.data(), static_cast<uint8_t>(extra < 0 ? 0 : extra));
+        result.push_back(static_cast<uint8_t>(checksum & 0xFF));
+        result.push_back(static_cast<uint8_t>(checksum >> 8));
+        return result;
+    }
+
+    inline Bytes concat(std::initializer_list<Bytes> parts) {
+        Bytes result;
+        for (const auto &part : parts) {
+            result.insert(result.end(), part.begin(), part.end());
+        }
+        return result;
+    }
+
+    /*
+     * Serves queued datagrams with the semantics of mav::UDPServer: every read is served from a single
+     * datagram, bytes too few for a read are dropped with their datagram, and so is the rest of the current
+     * datagram on markMessageBoundary(). Throws NetworkInterfaceInterrupt once all datagrams are read.
+     * Sends are captured.
+     */
+    class DatagramInterface : public mav::NetworkInterface {
+    private:
+        struct Datagram {
+            Bytes bytes;
+            mav::ConnectionPartner partner;
+        };
+
+        std::deque<Datagram> _datagrams;
+        size_t _offset = 0;
+
+    public:
+        static constexpr uint32_t LOCALHOST = 0x7F000001;
+
+        std::vector<Bytes> sent;
+
+        void add(Bytes datagram, const mav::ConnectionPartner &partner = {LOCALHOST, 14550, false}) {
+            _datagrams.push_back({std::move(datagram), partner});
+        }
+
+        void close() const override {}
+
+        [[nodiscard]] bool isConnectionOpen() const override {
+            return true;
+        }
+
+        void send(const uint8_t *data, uint32_t size, mav::ConnectionPartner) override {
+            sent.emplace_back(data, data + size);
+        }
+
+        mav::ConnectionPartner receive(uint8_t *destination, uint32_t size) override {
+            while (!_datagrams.empty() && _datagrams.front().bytes.size() - _offset < size) {
+                _datagrams.pop_front();
+                _offset = 0;
+            }
+            if (_datagrams.empty()) {
+                throw mav::NetworkInterfaceInterrupt();
+            }
+            const auto &datagram = _datagrams.front();
+            std::memcpy(destination, datagram.bytes.data() + _offset, size);
+            _offset += size;
+            return datagram.partner;
+        }
+
+        void markMessageBoundary() override {
+            if (!_datagrams.empty()) {
+                _datagrams.pop_front();
+                _offset = 0;
+            }
+        }
+    };
+
+    /*
+     * Reads one frame the way the libmav runtime does: byte by byte up to a magic byte, then the header,
+     * then the rest of the frame.
+     */
+    inline Bytes receiveFrame(mav::NetworkInterface &interface) {
+        Bytes result(example::MAX_FRAME_SIZE);
+        do {
+            interface.receive(result.data(), 1);
+        } while (!example::FrameHeader::isMagic(result[0]));
+        int header_size = example::FrameHeader::headerSize(result[0]);
+        interface.receive(result.data() + 1, header_size - 1);
+        int length = example::FrameHeader{result.data()}.frameLength();
+        interface.receive(result.data() + header_size, length - header_size);
+        result.resize(length);
+        return result;
+    }
+
+    inline uint8_t sequenceOf(const Bytes &frame) {
+        return example::FrameHeader{frame.data()}.sequence();
+    }
+
+    /*
+     * Sequence numbers of all frames receiveFrame() gets from the interface until it is exhausted.
+     */
+    inline std::vector<int> receiveSequences(mav::NetworkInterface &interface) {
+        std::vector<int> sequences;
+        try {
+            while (true) {
+                sequences.push_back(sequenceOf(receiveFrame(interface)));
+            }
+        } catch (const mav::NetworkInterfaceInterrupt&) {
+            // all datagrams read
+        }
+        return sequences;
+    }
+}
+
+#endif //LIBMAV_EXAMPLE_TEST_INTERFACES_H
@@ -0,0 +1,89 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023, libmav development team
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name libmav nor the names of itsl contributors may be
+ *    used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ * ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ ****************************************************************************/
+
+
+#ifndef LIBMAV_EXAMPLE_TEST_H
+#define LIBMAV_EXAMPLE_TEST_H
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mav/MessageSet.h>
+
+/*
+ * Minimal test harness for libmav-example-tests, in the style of bench/Bench.h. A test is a function that
+ * throws on failure, usually through TEST_CHECK. The runner runs all registered tests, or those whose name
+ * contains the filter argument, and fails if any of them failed.
+ */
+namespace test {
+
+    struct Failure : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+
+    using Function = std::function<void()>;
+
+    inline std::vector<std::pair<std::string, Function>>& registry() {
+        static std::vector<std::pair<std::string, Function>> tests;
+        return tests;
+    }
+
+    struct Register {
+        Register(std::string name, Function function) {
+            registry().emplace_back(std::move(name), std::move(function));
+        }
+    };
+
+    inline void check(bool condition, const char *expression, const char *file, int line) {
+        if (!condition) {
+            throw Failure(std::string(file) + ":" + std::to_string(line) + ": " + expression);
+        }
+    }
+
+    /*
+     * The message set is loaded once and shared by all tests. Like the example, the tests expect to be run
+     * from the build directory, which ctest does.
+     */
+    inline const mav::MessageSet& messageSet() {
+        static const mav::MessageSet message_set{"mavlink/development.xml"};
+        return message_set;
+    }
+}
+
+#define TEST_CHECK(condition) ::test::check((condition), #condition, __FILE__, __LINE__)
+
+#endif //LIBMAV_EXAMPLE_TEST_H
@@ -0,0 +1,394 @@
+#!/usr/bin/env python3
+"""
+Generates constexpr MAVLink field descriptors from a message definition XML.
+
+The output header contains one namespace per message with its id, CRC_EXTRA and
+one example::Field / example::ArrayField per field, carrying the payload offset
+of that field in MAVLink wire order. The accessors in include/example/Fields.h
+take these descriptors and read the field at a fixed offset instead of looking
+it up by name.
+
+With a second output path, it also writes flat lookup tables for message names
+and enum entries (see include/example/Lookup.h): open-addressing hash indexes
+for name -> value, and tables sorted by value for the reverse direction.
+
+usage: generate_fields.py <message_definition.xml> <output.h> [<tables.h>]
+"""
+
+import hashlib
+import os
+import sys
+import xml.etree.ElementTree as ET
+
+BASE_TYPES = {
+    'char': ('char', 1),
+    'uint8_t': ('uint8_t', 1),
+    'int8_t': ('int8_t', 1),
+    'uint16_t': ('uint16_t', 2),
+    'int16_t': ('int16_t', 2),
+    'uint32_t': ('uint32_t', 4),
+    'int32_t': ('int32_t', 4),
+    'float': ('float', 4),
+    'uint64_t': ('uint64_t', 8),
+    'int64_t': ('int64_t', 8),
+    'double': ('double', 8),
+}
+
+CPP_KEYWORDS = {
+    'alignas', 'alignof', 'and', 'asm', 'auto', 'bool', 'break', 'case', 'catch', 'char', 'class',
+    'const', 'constexpr', 'continue', 'default', 'delete', 'do', 'double', 'else', 'enum', 'explicit',
+    'export', 'extern', 'false', 'float', 'for', 'friend', 'goto', 'if', 'inline', 'int', 'long',
+    'mutable', 'namespace', 'new', 'not', 'operator', 'or', 'private', 'protected', 'public',
+    'register', 'return', 'short', 'signed', 'sizeof', 'static', 'struct', 'switch', 'template',
+    'this', 'throw', 'true', 'try', 'typedef', 'typename', 'union', 'unsigned', 'using', 'virtual',
+    'void', 'volatile', 'while', 'xor',
+}
+
+
+class MavField:
+    def __init__(self, name, type_string, is_extension):
+        self.name = name
+        self.type_string = type_string
+        self.is_extension = is_extension
+        self.array_length = 0
+        if '[' in type_string:
+            type_string, length = type_string.split('[')
+            self.array_length = int(length.rstrip(']'))
+        if type_string == 'uint8_t_mavlink_version':
+            type_string = 'uint8_t'
+        if type_string not in BASE_TYPES:
+            raise ValueError('Unknown field type "{}" for field {}'.format(type_string, name))
+        self.type = type_string
+        self.base_size = BASE_TYPES[type_string][1]
+        self.offset = 0
+
+    @property
+    def byte_size(self):
+        return self.base_size * max(self.array_length, 1)
+
+
+class MavMessage:
+    def __init__(self, name, message_id, fields):
+        self.name = name
+        self.id = message_id
+        self.declared_fields = fields
+        # MAVLink wire order: base fields sorted by type size (stable), extensions appended as declared
+        base = sorted([f for f in fields if not f.is_extension], key=lambda f: f.base_size, reverse=True)
+        self.fields = base + [f for f in fields if f.is_extension]
+        offset = 0
+        for field in self.fields:
+            field.offset = offset
+            offset += field.byte_size
+        self.max_payload_size = offset
+        self.crc_extra = self._crc_extra(base)
+
+    def _crc_extra(self, base_fields):
+        crc = X25()
+        crc.accumulate_str(self.name + ' ')
+        for field in base_fields:
+            crc.accumulate_str(field.type + ' ')
+            crc.accumulate_str(field.name + ' ')
+            if field.array_length:
+                crc.accumulate(field.array_length)
+        return (crc.crc & 0xFF) ^ (crc.crc >> 8)
+
+
+class MavEnumEntry:
+    def __init__(self, name, value):
+        self.name = name
+        self.value = value
+
+
+class X25:
+    def __init__(self):
+        self.crc = 0xFFFF
+
+    def accumulate(self, byte):
+        tmp = (byte ^ (self.crc & 0xFF)) & 0xFF
+        tmp = (tmp ^ (tmp << 4)) & 0xFF
+        self.crc = ((self.crc >> 8) ^ (tmp << 8) ^ (tmp << 3) ^ (tmp >> 4)) & 0xFFFF
+
+    def accumulate_str(self, string):
+        for byte in string.encode('ascii'):
+            self.accumulate(byte)
+
+
+class MavEnum:
+    def __init__(self, name):
+        self.name = name
+        self.entries = []
+
+
+class Definitions:
+    def __init__(self):
+        self.messages = {}
+        self.enums = {}
+        # Source files in include order, used for the source hash
+        self.sources = []
+
+    @property
+    def source_hash(self):
+        digest = hashlib.sha256()
+        for source in self.sources:
+            with open(source, 'rb') as f:
+                digest.update(f.read())
+        return digest.hexdigest()
+
+
+def load(xml_path, definitions=None):
+    """Loads messages and enums from xml_path and all of its includes."""
+    definitions = Definitions() if definitions is None else definitions
+    xml_path = os.path.abspath(xml_path)
+    if xml_path in definitions.sources:
+        return definitions
+
+    root = ET.parse(xml_path).getroot()
+    for include in root.findall('include'):
+        load(os.path.join(os.path.dirname(xml_path), include.text.strip()), definitions)
+    definitions.sources.append(xml_path)
+
+    for enum in root.iter('enum'):
+        mav_enum = definitions.enums.setdefault(enum.get('name'), MavEnum(enum.get('name')))
+        next_value = 0
+        for entry in enum.findall('entry'):
+            value = entry.get('value')
+            value = int(value, 0) if value is not None else next_value
+            next_value = value + 1
+            mav_enum.entries.append(MavEnumEntry(entry.get('name'), value))
+
+    for message in root.iter('message'):
+        fields = []
+        is_extension = False
+        for child in message:
+            if child.tag == 'extensions':
+                is_extension = True
+            elif child.tag == 'field':
+                fields.append(MavField(child.get('name'), child.get('type'), is_extension))
+        definitions.messages[message.get('name')] = MavMessage(message.get('name'), int(message.get('id')), fields)
+    return definitions
+
+
+def identifier(name):
+    return name + '_' if name in CPP_KEYWORDS else name
+
+
+def render(definitions, source_name):
+    messages = definitions.messages
+    lines = [
+        '// Generated by tools/generate_fields.py from {}. Do not edit.'.format(source_name),
+        '#ifndef LIBMAV_EXAMPLE_MESSAGEFIELDS_H',
+        '#define LIBMAV_EXAMPLE_MESSAGEFIELDS_H',
+        '',
+        '#include <cstdint>',
+        '',
+        '#include <example/Fields.h>',
+        '',
+        'namespace example {',
+        'namespace msg {',
+        '',
+        '    // SHA-256 over the source XML files, see tools/generate_snapshot.py',
+        '    constexpr const char* SOURCE_HASH = "{}";'.format(definitions.source_hash),
+        '',
+    ]
+    for message in sorted(messages.values(), key=lambda m: m.id):
+        lines.append('    namespace {} {{'.format(message.name))
+        lines.append('        constexpr uint32_t ID = {};'.format(message.id))
+        lines.append('        constexpr uint8_t CRC_EXTRA = {};'.format(message.crc_extra))
+        lines.append('        constexpr int MAX_PAYLOAD_SIZE = {};'.format(message.max_payload_size))
+        for field in message.fields:
+            cpp_type = BASE_TYPES[field.type][0]
+            if field.array_length:
+                descriptor = 'ArrayField<{}, {}>'.format(cpp_type, field.array_length)
+            else:
+                descriptor = 'Field<{}>'.format(cpp_type)
+            lines.append('        constexpr {} {}{{ID, {}, "{}"}};'.format(
+                descriptor, identifier(field.name), field.offset, field.name))
+        lines.append('    }')
+        lines.append('')
+
+    lines.append('    constexpr MessageInfo MESSAGES[] = {')
+    for message in sorted(messages.values(), key=lambda m: m.id):
+        lines.append('        {{{}, {}, {}, "{}"}},'.format(
+            message.id, message.crc_extra, message.max_payload_size, message.name))
+    lines.append('    };')
+    lines += [
+        '',
+        '} // namespace msg',
+        '} // namespace example',
+        '',
+        '#endif // LIBMAV_EXAMPLE_MESSAGEFIELDS_H',
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def name_hash(name):
+    """FNV-1a, must match example::nameHash() in include/example/Lookup.h."""
+    value = 2166136261
+    for byte in name.encode('ascii'):
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def hash_slots(names):
+    """Open-addressing table with linear probing, at most half full."""
+    size = 1
+    while size < 2 * len(names):
+        size *= 2
+    slots = [-1] * size
+    for index, name in enumerate(names):
+        slot = name_hash(name) & (size - 1)
+        while slots[slot] != -1:
+            slot = (slot + 1) & (size - 1)
+        slots[slot] = index
+    return slots
+
+
+def render_int_array(lines, declaration, values, per_line=16):
+    lines.append('    {} = {{'.format(declaration))
+    for start in range(0, len(values), per_line):
+        lines.append('        ' + ', '.join(str(v) for v in values[start:start + per_line]) + ',')
+    lines.append('    };')
+
+
+def render_tables(definitions, source_name):
+    messages = sorted(definitions.messages.values(), key=lambda m: m.id)
+    enums = sorted(definitions.enums.values(), key=lambda e: e.name)
+
+    # Entry names are unique across enums in the MAVLink definitions; should a dialect repeat one,
+    # the first definition wins, like it does for the by-name lookups in the message set. That is
+    # decided in definition order (includes first, enums and entries as declared), not in table order.
+    winners = set()
+    seen = set()
+    for mav_enum in definitions.enums.values():
+        for entry in mav_enum.entries:
+            if entry.name not in seen:
+                seen.add(entry.name)
+                winners.add(id(entry))
+    enum_entries = []
+    enum_infos = []
+    for mav_enum in enums:
+        first = len(enum_entries)
+        for entry in sorted(mav_enum.entries, key=lambda e: e.value):
+            if id(entry) in winners:
+                enum_entries.append(entry)
+        enum_infos.append((mav_enum.name, first, len(enum_entries) - first))
+
+    message_slots = hash_slots([m.name for m in messages])
+    entry_slots = hash_slots([e.name for e in enum_entries])
+
+    lines = [
+        '// Generated by tools/generate_fields.py from {}. Do not edit.'.format(source_name),
+        '#ifndef LIBMAV_EXAMPLE_MESSAGETABLES_H',
+        '#define LIBMAV_EXAMPLE_MESSAGETABLES_H',
+        '',
+        '#include <cstddef>',
+        '#include <cstdint>',
+        '#include <optional>',
+        '#include <string_view>',
+        '',
+        '#include <example/Lookup.h>',
+        '',
+        'namespace example {',
+        'namespace msg {',
+        'namespace tables {',
+        '',
+        '    // Sorted by message id',
+        '    inline constexpr size_t MESSAGE_COUNT = {};'.format(len(messages)),
+        '    inline constexpr NameEntry MESSAGES[] = {',
+    ]
+    for message in messages:
+        lines.append('        {{"{}", {}}},'.format(message.name, message.id))
+    if not messages:
+        lines.append('        {"", 0},')
+    lines.append('    };')
+    render_int_array(lines, 'inline constexpr int32_t MESSAGE_SLOTS[]', message_slots)
+    lines.append('    inline constexpr NameIndex MESSAGE_INDEX{{MESSAGES, MESSAGE_SLOTS, {}}};'.format(
+        len(message_slots) - 1))
+    lines += [
+        '',
+        '    // Grouped by enum, see ENUMS, and sorted by value within each enum',
+        '    inline constexpr NameEntry ENUM_ENTRIES[] = {',
+    ]
+    for entry in enum_entries:
+        lines.append('        {{"{}", {}u}},'.format(entry.name, entry.value))
+    if not enum_entries:
+        lines.append('        {"", 0u},')
+    lines.append('    };')
+    render_int_array(lines, 'inline constexpr int32_t ENUM_ENTRY_SLOTS[]', entry_slots)
+    lines.append('    inline constexpr NameIndex ENUM_ENTRY_INDEX{{ENUM_ENTRIES, ENUM_ENTRY_SLOTS, {}}};'.format(
+        len(entry_slots) - 1))
+    lines += [
+        '',
+        '    // Sorted by name',
+        '    inline constexpr size_t ENUM_COUNT = {};'.format(len(enum_infos)),
+        '    inline constexpr EnumInfo ENUMS[] = {',
+    ]
+    for name, first, count in enum_infos:
+        lines.append('        {{"{}", {}, {}}},'.format(name, first, count))
+    if not enum_infos:
+        lines.append('        {"", 0, 0},')
+    lines += [
+        '    };',
+        '',
+        '} // namespace tables',
+        '',
+        '    constexpr std::optional<uint32_t> messageId(std::string_view name) {',
+        '        auto entry = tables::MESSAGE_INDEX.find(name);',
+        '        return entry ? std::optional<uint32_t>(static_cast<uint32_t>(entry->value)) : std::nullopt;',
+        '    }',
+        '',
+        '    constexpr const char* messageName(uint32_t id) {',
+        '        auto entry = findByValue(tables::MESSAGES, tables::MESSAGE_COUNT, id);',
+        '        return entry ? entry->name : nullptr;',
+        '    }',
+        '',
+        '    constexpr std::optional<uint64_t> enumValue(std::string_view entry_name) {',
+        '        auto entry = tables::ENUM_ENTRY_INDEX.find(entry_name);',
+        '        return entry ? std::optional<uint64_t>(entry->value) : std::nullopt;',
+        '    }',
+        '',
+        '    constexpr const char* enumEntryName(std::string_view enum_name, uint64_t value) {',
+        '        auto info = findEnum(tables::ENUMS, tables::ENUM_COUNT, enum_name);',
+        '        if (!info) {',
+        '            return nullptr;',
+        '        }',
+        '        auto entry = findByValue(tables::ENUM_ENTRIES + info->first, info->count, value);',
+        '        return entry ? entry->name : nullptr;',
+        '    }',
+        '',
+        '} // namespace msg',
+        '} // namespace example',
+        '',
+        '#endif // LIBMAV_EXAMPLE_MESSAGETABLES_H',
+        '',
+    ]
+    return '\n'.join(lines)
+
+
+def write_if_changed(path, content):
+    """Leaves an unchanged file alone, so that nothing depending on it is rebuilt. The build tracks
+    when to regenerate with a stamp file instead of the outputs' timestamps, see CMakeLists.txt."""
+    if os.path.exists(path):
+        with open(path) as f:
+            if f.read() == content:
+                return
+    os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+    with open(path, 'w') as f:
+        f.write(content)
+
+
+def main(argv):
+    if len(argv) not in (3, 4):
+        sys.stderr.write(__doc__)
+        return 1
+    definitions = load(argv[1])
+    source_name = os.path.basename(argv[1])
+    write_if_changed(argv[2], render(definitions, source_name))
+    if len(argv) == 4:
+        write_if_changed(argv[3], render_tables(definitions, source_name))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
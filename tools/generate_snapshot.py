@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+Generates a self-contained snapshot of a message definition XML.
+
+The snapshot has all <include>s resolved, and drops everything libmav does not need to build a
+MessageSet (descriptions, units, documentation-only elements). Enum entry values are written out
+explicitly. The result is typically a small fraction of the size of the original file tree and can
+be loaded with a single MessageSet::addFromXMLString() call, see include/example/Snapshot.h.
+
+The first line carries a SHA-256 over the source files, so a snapshot that no longer matches the
+definitions the program was built with is detected and ignored.
+
+usage: generate_snapshot.py <message_definition.xml> <output.xml>
+"""
+
+import sys
+from xml.sax.saxutils import quoteattr
+
+from generate_fields import load, write_if_changed
+
+
+SNAPSHOT_MAGIC = '<!-- libmav-example snapshot sha256='
+
+
+def render(definitions):
+    lines = [SNAPSHOT_MAGIC + definitions.source_hash + ' -->', '<mavlink>', '<enums>']
+    for enum in definitions.enums.values():
+        lines.append('<enum name={}>'.format(quoteattr(enum.name)))
+        for entry in enum.entries:
+            lines.append('<entry name={} value="{}"/>'.format(quoteattr(entry.name), entry.value))
+        lines.append('</enum>')
+    lines += ['</enums>', '<messages>']
+    for message in definitions.messages.values():
+        lines.append('<message id="{}" name={}>'.format(message.id, quoteattr(message.name)))
+        in_extensions = False
+        for field in message.declared_fields:
+            if field.is_extension and not in_extensions:
+                lines.append('<extensions/>')
+                in_extensions = True
+            lines.append('<field type={} name={}/>'.format(quoteattr(field.type_string), quoteattr(field.name)))
+        lines.append('</message>')
+    lines += ['</messages>', '</mavlink>', '']
+    return '\n'.join(lines)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 1
+    write_if_changed(argv[2], render(load(argv[1])))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))